@@ -0,0 +1,374 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+#include "api.hpp"
+#include "logger.hpp"
+#include "modules.hpp"
+#include "utils.hpp"
+
+// Micro-benchmarks of rdm's hot paths over synthetic inputs, results are printed (or written) as JSON
+// Usage: rdm-bench [--repetitions N] [--warmup N] [--filter text] [--output file]
+
+namespace fs = std::filesystem;
+using namespace rdm;
+
+// Every C++ allocation goes through these, Lua's own allocator isn't counted
+static std::atomic<uint64_t> s_allocations = 0;
+
+void* operator new(size_t size) {
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size == 0 ? 1 : size)) return memory;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, size_t) noexcept { std::free(memory); }
+
+namespace {
+    using Parameters = std::vector<std::pair<std::string, std::string>>;
+
+    struct Settings {
+        size_t repetitions = 100;
+        size_t warmup = 10;
+        std::string filter;
+        std::string output;
+    };
+
+    struct Result {
+        std::string name;
+        Parameters parameters;
+        size_t batch;
+        double medianNs;
+        double p99Ns;
+        double meanNs;
+        double allocations;
+    };
+
+    struct Benchmark {
+        std::string name;
+        Parameters parameters;
+        // Calls per repetition, so very fast functions are still measurable
+        size_t batch = 1;
+        std::function<void()> body;
+        // Runs before every repetition and isn't timed
+        std::function<void()> setup;
+    };
+
+    void appendJsonString(std::ostream &out, const std::string &value) {
+        out << '"';
+        for (char c : value) {
+            if (c == '"' || c == '\\') {
+                out << '\\' << c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                out << ' ';
+            } else {
+                out << c;
+            }
+        }
+        out << '"';
+    }
+
+    // Nearest-rank percentile of sorted samples
+    double getPercentile(const std::vector<double> &samples, double percentile) {
+        size_t rank = static_cast<size_t>(percentile * samples.size() + 0.999999);
+        return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+    }
+
+    Result run(const Settings &settings, const Benchmark &benchmark) {
+        auto repeat = [&]() {
+            if (benchmark.setup) benchmark.setup();
+            uint64_t allocations = s_allocations.load(std::memory_order_relaxed);
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < benchmark.batch; ++i) benchmark.body();
+            auto end = std::chrono::steady_clock::now();
+            allocations = s_allocations.load(std::memory_order_relaxed) - allocations;
+            return std::make_pair(std::chrono::duration<double, std::nano>(end - start).count() / benchmark.batch, allocations);
+        };
+
+        for (size_t i = 0; i < settings.warmup; ++i) repeat();
+
+        std::vector<double> samples;
+        samples.reserve(settings.repetitions);
+        uint64_t allocations = 0;
+        for (size_t i = 0; i < settings.repetitions; ++i) {
+            auto [duration, count] = repeat();
+            samples.push_back(duration);
+            allocations += count;
+        }
+        std::sort(samples.begin(), samples.end());
+
+        double total = 0;
+        for (double sample : samples) total += sample;
+        size_t middle = samples.size() / 2;
+        double median = samples.size() % 2 == 0 ? (samples[middle - 1] + samples[middle]) / 2 : samples[middle];
+        double calls = static_cast<double>(settings.repetitions * benchmark.batch);
+        return { benchmark.name, benchmark.parameters, benchmark.batch, median, getPercentile(samples, 0.99), total / samples.size(), allocations / calls };
+    }
+
+    void writeResults(std::ostream &out, const Settings &settings, const std::vector<Result> &results) {
+        out << "{\n  \"rdm_version\": ";
+        appendJsonString(out, RDM_VERSION);
+        // Results of builds with different -Dlua_impl are only comparable knowing which one ran
+        out << ",\n  \"lua\": ";
+        #ifdef RDM_LUAJIT
+        appendJsonString(out, LUAJIT_VERSION);
+        #else
+        appendJsonString(out, LUA_RELEASE);
+        #endif
+        out << ",\n  \"repetitions\": " << settings.repetitions << ",\n  \"warmup\": " << settings.warmup << ",\n  \"benchmarks\": [";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Result& result = results[i];
+            out << (i == 0 ? "\n" : ",\n") << "    { \"name\": ";
+            appendJsonString(out, result.name);
+            out << ", \"parameters\": {";
+            for (size_t j = 0; j < result.parameters.size(); ++j) {
+                out << (j == 0 ? " " : ", ");
+                appendJsonString(out, result.parameters[j].first);
+                out << ": ";
+                appendJsonString(out, result.parameters[j].second);
+            }
+            out << (result.parameters.empty() ? "}" : " }");
+            out << ", \"batch\": " << result.batch
+                << ", \"median_ns\": " << result.medianNs
+                << ", \"p99_ns\": " << result.p99Ns
+                << ", \"mean_ns\": " << result.meanNs
+                << ", \"allocations\": " << result.allocations << " }";
+        }
+        out << "\n  ]\n}\n";
+    }
+
+    void writeFile(const fs::path &path, size_t size) {
+        fs::create_directories(path.parent_path());
+        std::ofstream file(path, std::ios::binary);
+        std::string line(63, 'x');
+        line.push_back('\n');
+        for (size_t written = 0; written < size; written += line.size()) file.write(line.data(), std::min(line.size(), size - written));
+    }
+
+    // Spreads count files over nested directories, ten entries per directory
+    void createTree(const fs::path &root, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            fs::path path = root;
+            for (size_t level = i / 10; level > 0; level /= 10) path /= "d" + std::to_string(level % 10);
+            writeFile(path / ("file" + std::to_string(i) + (i % 3 == 0 ? ".sh" : ".conf")), 16);
+        }
+    }
+
+    fs::path createModule(const fs::path &dir, size_t entries) {
+        fs::path path = dir / ("rdm-bench" + std::to_string(entries) + ".lua");
+        std::ofstream module(path);
+        module << "local files = {}\n"
+               << "for i = 1, " << entries << " do\n"
+               << "    if i % 2 == 0 then\n"
+               << "        files['.config/bench/text' .. i] = 'content ' .. i\n"
+               << "    else\n"
+               << "        files['.config/bench/file' .. i] = File('data/small.txt'):exec()\n"
+               << "    end\n"
+               << "end\n"
+               << "function RDM_GetFiles() return files end\n";
+        return path;
+    }
+
+    // Pure Lua work, like the modules that generate keymaps or theme permutations
+    void createComputeModule(const fs::path &dir, size_t lines) {
+        std::ofstream module(dir / "rdm-benchcompute.lua");
+        module << "function RDM_GetFiles()\n"
+               << "    local files = {}\n"
+               << "    for theme = 1, 10 do\n"
+               << "        local lines = {}\n"
+               << "        for key = 1, " << lines / 10 << " do\n"
+               << "            lines[#lines + 1] = string.format('map <leader>%d%d :colorscheme theme%d<cr>', theme, key, (theme * key) % 97)\n"
+               << "        end\n"
+               << "        files['.config/bench/keymaps' .. theme] = table.concat(lines, '\\n')\n"
+               << "    end\n"
+               << "    return files\n"
+               << "end\n";
+    }
+
+    std::vector<Benchmark> createBenchmarks(const fs::path &workDir, std::unique_ptr<ModuleManager> &moduleManager) {
+        std::vector<Benchmark> benchmarks;
+
+        const std::vector<std::pair<std::string, std::string>> patterns = {
+            { "*.sh", "install.sh" },
+            { "+(*.py|*.sh)", "scripts/run.py" },
+            { "*.conf", "some/deeply/nested/directory/file.txt" },
+        };
+        for (auto& entry : patterns) {
+            const std::string pattern = entry.first, name = entry.second;
+            benchmarks.push_back({ "fileMatchesPattern", { { "pattern", pattern }, { "name", name } }, 1000, [pattern, name]() {
+                volatile bool matches = fileMatchesPattern(name, pattern);
+                (void)matches;
+            }, nullptr });
+        }
+
+        fs::path base = workDir / "allowed";
+        fs::path nested = base;
+        for (size_t depth = 0; depth < 8; ++depth) nested /= "level" + std::to_string(depth);
+        writeFile(nested / "file", 16);
+        const std::vector<std::pair<std::string, fs::path>> paths = {
+            { "1", base / "level0" },
+            { "8", nested / "file" },
+            { "escape", base / ".." / "outside" },
+        };
+        for (bool mustExist : { false, true }) {
+            for (auto& entry : paths) {
+                const fs::path path = entry.second;
+                Parameters parameters = { { "depth", entry.first }, { "must_exist", mustExist ? "true" : "false" } };
+                benchmarks.push_back({ "isAllowedPath", std::move(parameters), 100, [base, path, mustExist]() {
+                    volatile bool allowed = isAllowedPath(base, path, mustExist);
+                    (void)allowed;
+                }, nullptr });
+            }
+        }
+
+        for (size_t count : { 100, 1000, 10000 }) {
+            fs::path root = workDir / ("tree" + std::to_string(count));
+            createTree(root, count);
+            benchmarks.push_back({ "getDirectoryFilesRecursive", { { "files", std::to_string(count) } }, 1, [root]() {
+                volatile size_t files = getDirectoryFilesRecursive(root).size();
+                (void)files;
+            }, nullptr });
+        }
+
+        // lapi_Read and getGeneratedFiles resolve paths against the module that is running
+        fs::path moduleDir = workDir / "module";
+        writeFile(moduleDir / "data" / "small.txt", 64);
+        ModulesAndFlags maf;
+        for (size_t entries : { 10, 100, 1000 }) {
+            createModule(moduleDir, entries);
+            maf.modules.insert("bench" + std::to_string(entries));
+        }
+        const size_t computeLines = 10000;
+        createComputeModule(moduleDir, computeLines);
+        maf.modules.insert("benchcompute");
+        moduleManager = std::make_unique<ModuleManager>(moduleDir, workDir / "home", maf);
+        ModuleList& modules = moduleManager->getModules();
+
+        // A thread of a module has an empty stack of its own and still finds the module
+        lua_State* moduleState = modules.at("bench10").getState();
+        lua_State* thread = lua_newthread(moduleState);
+        luaL_ref(moduleState, LUA_REGISTRYINDEX);
+        for (size_t size : { 4096, 1 << 20 }) {
+            std::string name = "data/read" + std::to_string(size);
+            writeFile(moduleDir / name, size);
+            benchmarks.push_back({ "lapi_Read", { { "bytes", std::to_string(size) } }, 1, [thread, name]() {
+                lua_settop(thread, 0);
+                lua_pushstring(thread, name.c_str());
+                lapi_Read(thread);
+            }, nullptr });
+        }
+
+        for (size_t entries : { 10, 100, 1000 }) {
+            Module* module = &modules.at("bench" + std::to_string(entries));
+            benchmarks.push_back({ "getGeneratedFiles", { { "entries", std::to_string(entries) } }, 1, [module]() {
+                auto files = module->getGeneratedFiles();
+                volatile size_t count = files.has_value() ? files->size() : 0;
+                (void)count;
+            }, nullptr });
+        }
+
+        Module* computeModule = &modules.at("benchcompute");
+        benchmarks.push_back({ "luaCompute", { { "lines", std::to_string(computeLines) } }, 1, [computeModule]() {
+            auto files = computeModule->getGeneratedFiles();
+            volatile size_t count = files.has_value() ? files->size() : 0;
+            (void)count;
+        }, nullptr });
+
+        for (size_t size : { 4096, 1 << 20 }) {
+            fs::path source = workDir / "copy" / ("source" + std::to_string(size));
+            fs::path dest = workDir / "copy" / ("dest" + std::to_string(size));
+            writeFile(source, size);
+            benchmarks.push_back({ "copyFileOrSym", { { "bytes", std::to_string(size) } }, 1, [source, dest]() {
+                copyFileOrSym(source, dest);
+            }, [dest]() {
+                fs::remove(dest);
+            } });
+        }
+        return benchmarks;
+    }
+
+    bool parseSettings(int argc, char* argv[], Settings &settings) {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                return false;
+            }
+            std::string value = argv[++i];
+            if (arg == "--repetitions" || arg == "--warmup") {
+                char* end;
+                unsigned long long number = std::strtoull(value.c_str(), &end, 10);
+                if (*end != '\0' || (arg == "--repetitions" && number == 0)) {
+                    std::cerr << "Invalid value for " << arg << ": " << value << std::endl;
+                    return false;
+                }
+                (arg == "--repetitions" ? settings.repetitions : settings.warmup) = number;
+            } else if (arg == "--filter") {
+                settings.filter = value;
+            } else if (arg == "--output") {
+                settings.output = value;
+            } else {
+                std::cerr << "Unknown option " << arg << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    Settings settings;
+    if (!parseSettings(argc, argv, settings)) return EXIT_FAILURE;
+    logger::setLevel(logger::Level::Error);
+
+    std::string workTemplate = (fs::temp_directory_path() / "rdm-bench-XXXXXX").string();
+    if (mkdtemp(workTemplate.data()) == nullptr) {
+        std::cerr << "Couldn't create a temporary directory: " << std::strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+    fs::path workDir = workTemplate;
+
+    std::vector<Result> results;
+    {
+        std::unique_ptr<ModuleManager> moduleManager;
+        for (auto& benchmark : createBenchmarks(workDir, moduleManager)) {
+            if (!settings.filter.empty() && benchmark.name.find(settings.filter) == std::string::npos) continue;
+            results.push_back(run(settings, benchmark));
+            const Result& result = results.back();
+            std::cerr << result.name;
+            for (auto& [key, value] : result.parameters) std::cerr << ' ' << key << '=' << value;
+            std::cerr << ": median " << result.medianNs << " ns, p99 " << result.p99Ns << " ns, " << result.allocations << " allocations" << std::endl;
+        }
+    }
+    fs::remove_all(workDir);
+
+    if (settings.output.empty()) {
+        writeResults(std::cout, settings, results);
+        return EXIT_SUCCESS;
+    }
+
+    std::ofstream output(settings.output);
+    writeResults(output, settings, results);
+    if (!output) {
+        std::cerr << "Couldn't write " << settings.output << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
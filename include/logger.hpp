@@ -3,52 +3,84 @@
 // This is a simple logging helper I use throughout my C++ applications
 // - Rikai
 
+#include <sstream>
+#include <string>
+
+// Records are formatted on the calling thread and written in large batches by a background thread,
+// errors, warnings and debug messages go to stderr and everything else to stdout
+namespace logger {
+    enum class Level {
+        Output, // Always printed, for command output like 'rdm list'
+        Error,
+        Warning,
+        Info,
+        Debug
+    };
+
+    enum class Format {
+        Text,
+        Json // One JSON object per line (NDJSON), without colors or separators
+    };
+
+    void setLevel(Level level);
+    Level getLevel();
+    void setFormat(Format format);
+    Format getFormat();
+    // Blocks until every queued record has been written, must be called before handing the terminal to a child process
+    void flush();
+    void write(Level level, const char* tag, std::string &&name, std::string &&message);
+    void writeSeparator();
+
+    inline bool isEnabled(Level level) {
+        return level <= getLevel();
+    }
+}
+
 #ifndef _NLOG
-#include <iostream>
+
+#define LOG_RECORD(level, tag, name, x) do { \
+    if (logger::isEnabled(level)) { \
+        std::ostringstream logName_, logMessage_; \
+        logName_ << name; \
+        logMessage_ << x; \
+        logger::write(level, tag, logName_.str(), logMessage_.str()); \
+    } \
+} while(0)
+
 #ifndef _NCOLOR
 #define INFO_TAG "\033[92m[INFO]\033[m "
 #define ERR_TAG "\033[91m[ERROR]\033[m "
 #define WARN_TAG "\033[93m[WARNING]\033[m "
 #define DEBUG_TAG "\033[95m[DEBUG]\033[m "
-#define LOG_CUSTOM(name, x) do {std::cout << "\033[94m[" << name << "]\033[m " << x << std::endl;} while(0)
-#define LOG_CUSTOM_INFO(name, x) do {std::cout << "\033[94m[" << name << "]" << INFO_TAG << x << std::endl;} while(0)
-#define LOG_CUSTOM_ERR(name, x) do {std::cerr << "\033[94m[" << name << "]" << ERR_TAG << x << std::endl;} while(0)
-#define LOG_CUSTOM_WARN(name, x) do {std::cerr << "\033[94m[" << name << "]" << WARN_TAG << x << std::endl;} while(0)
 #else
 #define INFO_TAG "[INFO] "
 #define ERR_TAG "[ERROR] "
 #define WARN_TAG "[WARNING] "
 #define DEBUG_TAG "[DEBUG] "
-#define LOG_CUSTOM(name, x) do {std::cout << "[" << name << "]" << x << std::endl;} while(0)
-#define LOG_CUSTOM_INFO(name, x) do {std::cout << "[" << name << "]" << INFO_TAG << x << std::endl;} while(0)
-#define LOG_CUSTOM_ERR(name, x) do {std::cerr << "[" << name << "]" << ERR_TAG << x << std::endl;} while(0)
-#define LOG_CUSTOM_WARN(name, x) do {std::cerr << "[" << name << "]" << WARN_TAG << x << std::endl;} while(0)
 #endif
-#define LOG(x) do {std::cout << x << std::endl;} while(0)
-#define LOG_INFO(x) do {std::cout << INFO_TAG << x << std::endl;} while(0)
-#define LOG_ERR(x) do {std::cerr << ERR_TAG << x << std::endl;} while(0)
-#define LOG_WARN(x) do {std::cerr << WARN_TAG << x << std::endl;} while(0)
-#define LOG_SEP() do {std::cout << "+------------------------------------------------+" << std::endl;} while(0)
+#define LOG_CUSTOM(name, x) LOG_RECORD(logger::Level::Info, nullptr, name, x)
+#define LOG_CUSTOM_INFO(name, x) LOG_RECORD(logger::Level::Info, INFO_TAG, name, x)
+#define LOG_CUSTOM_ERR(name, x) LOG_RECORD(logger::Level::Error, ERR_TAG, name, x)
+#define LOG_CUSTOM_WARN(name, x) LOG_RECORD(logger::Level::Warning, WARN_TAG, name, x)
+#define LOG_CUSTOM_DEBUG(name, x) LOG_RECORD(logger::Level::Debug, DEBUG_TAG, name, x)
+#define LOG(x) LOG_RECORD(logger::Level::Output, nullptr, "", x)
+#define LOG_INFO(x) LOG_RECORD(logger::Level::Info, INFO_TAG, "", x)
+#define LOG_ERR(x) LOG_RECORD(logger::Level::Error, ERR_TAG, "", x)
+#define LOG_WARN(x) LOG_RECORD(logger::Level::Warning, WARN_TAG, "", x)
+#define LOG_DEBUG(x) LOG_RECORD(logger::Level::Debug, DEBUG_TAG, "", x)
+#define LOG_SEP() do { if (logger::isEnabled(logger::Level::Info)) logger::writeSeparator(); } while(0)
+#define LOG_FLUSH() logger::flush()
 #else
 #define LOG(x)
 #define LOG_INFO(x)
 #define LOG_ERR(x)
 #define LOG_WARN(x)
+#define LOG_DEBUG(x)
 #define LOG_CUSTOM(name, x)
 #define LOG_CUSTOM_INFO(name, x)
 #define LOG_CUSTOM_ERR(name, x)
 #define LOG_CUSTOM_WARN(name, x)
-#define LOG_SEP()
-#endif
-
-#if defined(_DEBUG) && ! defined(_NLOG)
-#ifndef _NCOLOR
-#define LOG_CUSTOM_DEBUG(name, x) do {std::cerr << "\033[94m[" << name << "]" << DEBUG_TAG << x << std::endl;} while(0)
-#else
-#define LOG_CUSTOM_DEBUG(name, x) do {std::cerr << "[" << name << "]" << DEBUG_TAG << x << std::endl;} while(0)
-#endif
-#define LOG_DEBUG(x) do {std::cerr << DEBUG_TAG << x << std::endl;} while(0)
-#else
-#define LOG_DEBUG(x)
 #define LOG_CUSTOM_DEBUG(name, x)
+#define LOG_SEP()
+#define LOG_FLUSH()
 #endif
\ No newline at end of file
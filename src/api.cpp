@@ -1,7 +1,15 @@
 #include "api.hpp"
+#include <algorithm>
 #include <fstream>
 #include <cstdlib>
 #include <filesystem>
+#include <memory>
+#include <new>
+#include <string_view>
+#include "bundle.hpp"
+#include "fscache.hpp"
+#include "patch.hpp"
+#include "stream.hpp"
 #include "utils.hpp"
 #include "modules.hpp"
 #include "logger.hpp"
@@ -9,6 +17,83 @@
 namespace fs = std::filesystem;
 
 namespace rdm {
+    static const char* FILE_STREAM_METATABLE = "rdm_file_stream";
+    static const char* BUFFER_METATABLE = "rdm_buffer";
+    static const char* DESCRIPTOR_METATABLE = "file_descriptor";
+    static constexpr lua_Integer DEFAULT_CHUNK_SIZE = 1 << 16;
+    static constexpr size_t MAX_PATCH_DEPTH = 64;
+    // Light userdata sentinels, only their addresses matter
+    static char s_patchNull;
+    static char s_patchRemove;
+
+    // Gives a FileDescriptor its methods
+    static void setDescriptorMetatable(lua_State* L) {
+        if (luaL_newmetatable(L, DESCRIPTOR_METATABLE)) {
+            lua_newtable(L);
+            lua_pushcfunction(L, lapi_descriptorExec);
+            lua_setfield(L, -2, "exec");
+            lua_pushcfunction(L, lapi_descriptorIgnore);
+            lua_setfield(L, -2, "ignore");
+            lua_pushcfunction(L, lapi_descriptorMode);
+            lua_setfield(L, -2, "mode");
+            lua_setfield(L, -2, "__index");
+        }
+        lua_setmetatable(L, -2);
+    }
+
+    // A text FileDescriptor keeping the string or Buffer at index as its content
+    static void pushTextDescriptor(lua_State* L, int index) {
+        index = lua_absindex(L, index);
+        lua_newtable(L);
+        lua_pushstring(L, "string");
+        lua_setfield(L, -2, "type");
+        lua_pushvalue(L, index);
+        lua_setfield(L, -2, "content");
+        setDescriptorMetatable(L);
+    }
+
+    // Only strings of octal digits ('0600', '755'), a Lua number like 0600 would be read as decimal
+    static bool parseMode(lua_State* L, int index, lua_Integer &mode) {
+        if (lua_type(L, index) != LUA_TSTRING) return false;
+        std::string_view text = lua_tostring(L, index);
+        if (text.empty() || text.size() > 4 || text.find_first_not_of("01234567") != std::string_view::npos) return false;
+        mode = 0;
+        for (char digit : text) mode = mode * 8 + (digit - '0');
+        return true;
+    }
+
+    // Scripts packed in a bundle are written to a temporary file so they can be executed
+    static int runExecutable(const fs::path &file) {
+        Bundle* bundle = Bundle::getActive();
+        // Queued log records must reach the terminal before anything the child prints
+        LOG_FLUSH();
+        // Scripts may create or delete the files the module lists afterwards
+        clearDirectoryCache();
+        if (bundle == nullptr || !bundle->contains(file)) return std::system(file.c_str());
+
+        const BundleEntry* entry = bundle->find(file);
+        fs::path tempFile = entry != nullptr ? bundle->materialize(*entry) : fs::path();
+        if (tempFile.empty()) return -1;
+        int exitCode = std::system(tempFile.c_str());
+        fs::remove(tempFile);
+        return exitCode;
+    }
+
+    // Replaces Lua's print so its output is ordered with (and formatted like) rdm's own messages
+    int lapi_Print(lua_State* L) {
+        int top = lua_gettop(L);
+        std::string line;
+        for (int i = 1; i <= top; ++i) {
+            size_t length;
+            const char* value = luaL_tolstring(L, i, &length);
+            if (i > 1) line.push_back('\t');
+            line.append(value, length);
+            lua_pop(L, 1);
+        }
+        LOG(line);
+        return 0;
+    }
+
     int lapi_Read(lua_State* L) {
         if (lua_gettop(L) != 1) {
             lua_pushnil(L);
@@ -20,14 +105,23 @@ namespace rdm {
 
             std::string fileName = lua_tostring(L, -1);
 
-            fs::path fileToRead(Module::getCurrentlyExecutingFile().parent_path());
+            fs::path fileToRead(Module::fromState(L)->getDirectory());
             fileToRead.append(fileName);
 
-            if (!isAllowedPath(Module::getCurrentlyExecutingFile().parent_path(), fileToRead, true)) {
+            if (!isAllowedPath(Module::fromState(L)->getDirectory(), fileToRead, true)) {
                 lua_pushnil(L);
                 return 1;
             }
 
+            Bundle* bundle = Bundle::getActive();
+            if (bundle != nullptr && bundle->contains(fileToRead)) {
+                const BundleEntry* entry = bundle->find(fileToRead);
+                std::string_view data = entry != nullptr ? bundle->getData(*entry) : std::string_view();
+                if (data.ends_with('\n')) data.remove_suffix(1);
+                lua_pushlstring(L, data.data(), data.size());
+                return 1;
+            }
+
             std::string buff;
             std::ifstream file;
             file.open(fileToRead);
@@ -45,6 +139,446 @@ namespace rdm {
         return 1;
     }
 
+    // Resolves the only argument against the directory of the module, false if it points outside of it
+    static bool getModulePath(lua_State* L, fs::path &path) {
+        if (lua_gettop(L) != 1 || !lua_isstring(L, 1)) return false;
+        fs::path base = Module::fromState(L)->getDirectory();
+        path = (base / lua_tostring(L, 1)).lexically_normal();
+        return isCachedAllowedPath(base, path);
+    }
+
+    int lapi_Glob(lua_State* L) {
+        if (lua_gettop(L) != 1 || !lua_isstring(L, 1)) {
+            lua_pushnil(L);
+            return 1;
+        }
+
+        std::vector<std::string> matches = globFiles(Module::fromState(L)->getDirectory(), lua_tostring(L, 1));
+        lua_createtable(L, matches.size(), 0);
+        for (size_t i = 0; i < matches.size(); ++i) {
+            lua_pushlstring(L, matches[i].data(), matches[i].size());
+            lua_rawseti(L, -2, i + 1);
+        }
+        return 1;
+    }
+
+    int lapi_ListDir(lua_State* L) {
+        fs::path dir;
+        const std::vector<DirectoryEntry>* entries = getModulePath(L, dir) ? getCachedDirectoryEntries(dir) : nullptr;
+        if (entries == nullptr) {
+            lua_pushnil(L);
+            return 1;
+        }
+
+        lua_createtable(L, entries->size(), 0);
+        for (size_t i = 0; i < entries->size(); ++i) {
+            lua_pushlstring(L, (*entries)[i].name.data(), (*entries)[i].name.size());
+            lua_rawseti(L, -2, i + 1);
+        }
+        return 1;
+    }
+
+    int lapi_Stat(lua_State* L) {
+        fs::path file;
+        const EntryStat* info = getModulePath(L, file) ? getCachedStat(file) : nullptr;
+        if (info == nullptr) {
+            lua_pushnil(L);
+            return 1;
+        }
+
+        lua_createtable(L, 0, 4);
+        lua_pushstring(L, getEntryTypeName(info->type));
+        lua_setfield(L, -2, "type");
+        lua_pushinteger(L, info->size);
+        lua_setfield(L, -2, "size");
+        lua_pushinteger(L, info->mode);
+        lua_setfield(L, -2, "mode");
+        lua_pushinteger(L, info->mtime);
+        lua_setfield(L, -2, "mtime");
+        return 1;
+    }
+
+    static int fileStreamGc(lua_State* L) {
+        static_cast<FileStream*>(luaL_checkudata(L, 1, FILE_STREAM_METATABLE))->~FileStream();
+        return 0;
+    }
+
+    static int fileStreamClose(lua_State* L) {
+        static_cast<FileStream*>(luaL_checkudata(L, 1, FILE_STREAM_METATABLE))->close();
+        return 0;
+    }
+
+    static int readStream(lua_State* L, bool lines) {
+        FileStream* stream = static_cast<FileStream*>(lua_touserdata(L, lua_upvalueindex(1)));
+        bool failed;
+        {
+            // Lua errors skip C++ destructors, the string must be gone before raising one
+            std::string piece;
+            if (lines ? stream->readLine(piece) : stream->readChunk(lua_tointeger(L, lua_upvalueindex(2)), piece)) {
+                lua_pushlstring(L, piece.data(), piece.size());
+                return 1;
+            }
+            failed = stream->hasFailed();
+        }
+        if (failed) return luaL_error(L, "Couldn't read the rest of the file");
+        lua_pushnil(L);
+        return 1;
+    }
+
+    static int readLinesIterator(lua_State* L) {
+        return readStream(L, true);
+    }
+
+    static int readChunksIterator(lua_State* L) {
+        return readStream(L, false);
+    }
+
+    // Returns the iterator, two nils and the stream as the closing value, so a for loop closes the file even when left early
+    static int openFileStream(lua_State* L, lua_CFunction iterator, lua_Integer chunkSize) {
+        std::string fileName = luaL_checkstring(L, 1);
+        fs::path parent = Module::fromState(L)->getDirectory();
+        fs::path fileToRead = parent / fileName;
+
+        FileStream* stream = new (lua_newuserdatauv(L, sizeof(FileStream), 0)) FileStream();
+        if (luaL_newmetatable(L, FILE_STREAM_METATABLE)) {
+            lua_pushcfunction(L, fileStreamGc);
+            lua_setfield(L, -2, "__gc");
+            lua_pushcfunction(L, fileStreamClose);
+            lua_setfield(L, -2, "__close");
+        }
+        lua_setmetatable(L, -2);
+
+        // The iterator still works, it just doesn't return anything
+        if (!isAllowedPath(parent, fileToRead, true) || !stream->open(fileToRead)) {
+            LOG_CUSTOM_ERR(Module::fromState(L)->getName(), "File '" << fileName << "' is not allowed or doesn't exist.");
+        }
+
+        lua_pushvalue(L, -1);
+        lua_pushinteger(L, chunkSize);
+        lua_pushcclosure(L, iterator, 2);
+        lua_pushnil(L);
+        lua_pushnil(L);
+        lua_rotate(L, -4, -1);
+        return 4;
+    }
+
+    int lapi_ReadLines(lua_State* L) {
+        return openFileStream(L, readLinesIterator, 0);
+    }
+
+    int lapi_ReadChunks(lua_State* L) {
+        lua_Integer chunkSize = luaL_optinteger(L, 2, DEFAULT_CHUNK_SIZE);
+        luaL_argcheck(L, chunkSize > 0, 2, "the chunk size must be positive");
+        return openFileStream(L, readChunksIterator, chunkSize);
+    }
+
+    using SharedBuffer = std::shared_ptr<std::string>;
+
+    static SharedBuffer* getSharedBuffer(lua_State* L) {
+        return static_cast<SharedBuffer*>(luaL_checkudata(L, 1, BUFFER_METATABLE));
+    }
+
+    // Content given to rdm (see getBufferContent) must not change, so a shared buffer gets its own copy before writing
+    static std::string& getWritableBuffer(lua_State* L) {
+        SharedBuffer* buffer = getSharedBuffer(L);
+        if (buffer->use_count() > 1) *buffer = std::make_shared<std::string>(**buffer);
+        return **buffer;
+    }
+
+    static int bufferGc(lua_State* L) {
+        getSharedBuffer(L)->~SharedBuffer();
+        return 0;
+    }
+
+    // Appends every argument (strings, numbers or other buffers) and returns the buffer so calls can be chained
+    static int bufferAdd(lua_State* L) {
+        std::string& buffer = getWritableBuffer(L);
+        int top = lua_gettop(L);
+        for (int i = 2; i <= top; ++i) {
+            if (SharedBuffer* other = static_cast<SharedBuffer*>(luaL_testudata(L, i, BUFFER_METATABLE))) {
+                buffer.append(**other);
+                continue;
+            }
+            size_t length;
+            const char* value = luaL_checklstring(L, i, &length);
+            buffer.append(value, length);
+        }
+        lua_settop(L, 1);
+        return 1;
+    }
+
+    // Same arguments as string.format, which is kept as an upvalue
+    static int bufferAddFormatted(lua_State* L) {
+        getSharedBuffer(L);
+        luaL_checkstring(L, 2);
+        int top = lua_gettop(L);
+        lua_pushvalue(L, lua_upvalueindex(1));
+        for (int i = 2; i <= top; ++i) lua_pushvalue(L, i);
+        lua_call(L, top - 1, 1);
+
+        size_t length;
+        const char* value = lua_tolstring(L, -1, &length);
+        getWritableBuffer(L).append(value, length);
+        lua_settop(L, 1);
+        return 1;
+    }
+
+    static int bufferToString(lua_State* L) {
+        const std::string& buffer = **getSharedBuffer(L);
+        lua_pushlstring(L, buffer.data(), buffer.size());
+        return 1;
+    }
+
+    static int bufferLength(lua_State* L) {
+        lua_pushinteger(L, (*getSharedBuffer(L))->size());
+        return 1;
+    }
+
+    // Like string.exec, the descriptor keeps the buffer itself as its content
+    static int bufferExec(lua_State* L) {
+        getSharedBuffer(L);
+        pushTextDescriptor(L, 1);
+        lua_pushboolean(L, true);
+        lua_setfield(L, -2, "exec");
+        return 1;
+    }
+
+    static int bufferMode(lua_State* L) {
+        getSharedBuffer(L);
+        return lapi_stringMode(L);
+    }
+
+    int lapi_Buffer(lua_State* L) {
+        new (lua_newuserdatauv(L, sizeof(SharedBuffer), 0)) SharedBuffer(std::make_shared<std::string>());
+        if (luaL_newmetatable(L, BUFFER_METATABLE)) {
+            lua_newtable(L);
+            lua_pushcfunction(L, bufferAdd);
+            lua_setfield(L, -2, "add");
+            lua_getglobal(L, "string");
+            lua_getfield(L, -1, "format");
+            lua_remove(L, -2);
+            lua_pushcclosure(L, bufferAddFormatted, 1);
+            lua_setfield(L, -2, "addf");
+            lua_pushcfunction(L, bufferExec);
+            lua_setfield(L, -2, "exec");
+            lua_pushcfunction(L, bufferMode);
+            lua_setfield(L, -2, "mode");
+            lua_pushcfunction(L, bufferToString);
+            lua_setfield(L, -2, "tostring");
+            lua_setfield(L, -2, "__index");
+            lua_pushcfunction(L, bufferToString);
+            lua_setfield(L, -2, "__tostring");
+            lua_pushcfunction(L, bufferLength);
+            lua_setfield(L, -2, "__len");
+            lua_pushcfunction(L, bufferGc);
+            lua_setfield(L, -2, "__gc");
+        }
+        lua_setmetatable(L, -2);
+        return 1;
+    }
+
+    std::shared_ptr<const std::string> getBufferContent(lua_State* L, int index) {
+        SharedBuffer* buffer = static_cast<SharedBuffer*>(luaL_testudata(L, index, BUFFER_METATABLE));
+        return buffer != nullptr ? *buffer : nullptr;
+    }
+
+    static bool isPatchArray(lua_State* L, int index, lua_Integer &length) {
+        length = luaL_len(L, index);
+        if (length == 0) return false;
+        lua_Integer keys = 0;
+        lua_pushnil(L);
+        while (lua_next(L, index) != 0) {
+            lua_pop(L, 1);
+            if (!lua_isinteger(L, -1) || lua_tointeger(L, -1) < 1 || lua_tointeger(L, -1) > length) {
+                lua_pop(L, 1);
+                return false;
+            }
+            keys++;
+        }
+        return keys == length;
+    }
+
+    // Tables with the keys 1..n become arrays, any other table (even an empty one) is an object with string keys
+    static bool toPatchValue(lua_State* L, int index, PatchValue &value, std::string &error, size_t depth) {
+        index = lua_absindex(L, index);
+        if (depth > MAX_PATCH_DEPTH) {
+            error = "The patch is nested too deeply";
+            return false;
+        }
+
+        switch (lua_type(L, index)) {
+            case LUA_TBOOLEAN:
+                value.type = PatchValue::Type::Boolean;
+                value.boolean = lua_toboolean(L, index);
+                return true;
+            case LUA_TNUMBER:
+                if (lua_isinteger(L, index)) {
+                    value.type = PatchValue::Type::Integer;
+                    value.integer = lua_tointeger(L, index);
+                } else {
+                    value.type = PatchValue::Type::Number;
+                    value.number = lua_tonumber(L, index);
+                }
+                return true;
+            case LUA_TSTRING: {
+                size_t length;
+                const char* string = lua_tolstring(L, index, &length);
+                value.type = PatchValue::Type::String;
+                value.string.assign(string, length);
+                return true;
+            }
+            case LUA_TLIGHTUSERDATA:
+                if (lua_touserdata(L, index) == &s_patchNull) {
+                    value.type = PatchValue::Type::Null;
+                    return true;
+                }
+                if (lua_touserdata(L, index) == &s_patchRemove) {
+                    value.type = PatchValue::Type::Remove;
+                    return true;
+                }
+                break;
+            case LUA_TUSERDATA:
+                if (auto content = getBufferContent(L, index)) {
+                    value.type = PatchValue::Type::String;
+                    value.string = *content;
+                    return true;
+                }
+                break;
+            case LUA_TTABLE: {
+                // Each level keeps its key and value on the stack, only LUA_MINSTACK slots are guaranteed in total
+                if (!lua_checkstack(L, 3)) {
+                    error = "The patch is nested too deeply";
+                    return false;
+                }
+                lua_Integer length;
+                if (isPatchArray(L, index, length)) {
+                    value.type = PatchValue::Type::Array;
+                    value.items.resize(length);
+                    for (lua_Integer i = 1; i <= length; ++i) {
+                        lua_rawgeti(L, index, i);
+                        bool converted = toPatchValue(L, -1, value.items[i - 1], error, depth + 1);
+                        lua_pop(L, 1);
+                        if (!converted) return false;
+                    }
+                    return true;
+                }
+
+                value.type = PatchValue::Type::Object;
+                lua_pushnil(L);
+                while (lua_next(L, index) != 0) {
+                    if (lua_type(L, -2) != LUA_TSTRING) {
+                        lua_pop(L, 2);
+                        error = "Table keys must be strings";
+                        return false;
+                    }
+                    auto& member = value.members.emplace_back(lua_tostring(L, -2), PatchValue());
+                    bool converted = toPatchValue(L, -1, member.second, error, depth + 1);
+                    lua_pop(L, 1);
+                    if (!converted) {
+                        lua_pop(L, 1);
+                        return false;
+                    }
+                }
+                std::sort(value.members.begin(), value.members.end(), [](const auto &a, const auto &b) {
+                    return a.first < b.first;
+                });
+                return true;
+            }
+        }
+        error = std::string("Unsupported value of type ") + luaL_typename(L, index);
+        return false;
+    }
+
+    // Config text can be a string or a Buffer
+    static bool getConfigText(lua_State* L, int index, std::string_view &text) {
+        if (lua_type(L, index) == LUA_TSTRING) {
+            size_t length;
+            const char* string = lua_tolstring(L, index, &length);
+            text = std::string_view(string, length);
+            return true;
+        }
+        // The Buffer stays on the stack, so its content outlives the call
+        if (auto content = getBufferContent(L, index)) {
+            text = *content;
+            return true;
+        }
+        return false;
+    }
+
+    using PatchFunction = bool (*)(std::string_view, const PatchValue&, std::string&, std::string&);
+
+    static int patchConfig(lua_State* L, const char* format, PatchFunction patchFunction) {
+        const std::string name = Module::fromState(L)->getName();
+        std::string_view text;
+        if (lua_gettop(L) != 2 || !getConfigText(L, 1, text) || !lua_istable(L, 2)) {
+            LOG_CUSTOM_ERR(name, "Invalid arguments, make sure to call patch as: " << format << ".patch(text, table)");
+            lua_pushnil(L);
+            return 1;
+        }
+
+        PatchValue patch;
+        std::string result, error;
+        if (!toPatchValue(L, 2, patch, error, 0) || !patchFunction(text, patch, result, error)) {
+            LOG_CUSTOM_ERR(name, "Couldn't patch " << format << ": " << error);
+            lua_pushnil(L);
+            return 1;
+        }
+        lua_pushlstring(L, result.data(), result.size());
+        return 1;
+    }
+
+    int lapi_JsonPatch(lua_State* L) {
+        return patchConfig(L, "Json", patchJson);
+    }
+
+    int lapi_TomlPatch(lua_State* L) {
+        return patchConfig(L, "Toml", patchToml);
+    }
+
+    // Ini.set(text, section, key, value), a nil value removes the key
+    int lapi_IniSet(lua_State* L) {
+        std::string_view text;
+        int type = lua_type(L, 4);
+        if (lua_gettop(L) < 3 || !getConfigText(L, 1, text) || lua_type(L, 2) != LUA_TSTRING || lua_type(L, 3) != LUA_TSTRING || (type != LUA_TNIL && type != LUA_TNONE && type != LUA_TSTRING && type != LUA_TNUMBER && type != LUA_TBOOLEAN)) {
+            LOG_CUSTOM_ERR(Module::fromState(L)->getName(), "Invalid arguments, make sure to call set as: Ini.set(text, section, key, value)");
+            lua_pushnil(L);
+            return 1;
+        }
+
+        std::string value;
+        if (type == LUA_TBOOLEAN) {
+            value = lua_toboolean(L, 4) ? "true" : "false";
+        } else if (type == LUA_TSTRING || type == LUA_TNUMBER) {
+            value = lua_tostring(L, 4);
+        }
+        std::string result = setIniValue(text, lua_tostring(L, 2), lua_tostring(L, 3), type == LUA_TNIL || type == LUA_TNONE ? nullptr : &value);
+        lua_pushlstring(L, result.data(), result.size());
+        return 1;
+    }
+
+    void registerConfigLibraries(lua_State* L) {
+        lua_newtable(L);
+        lua_pushcfunction(L, lapi_JsonPatch);
+        lua_setfield(L, -2, "patch");
+        lua_pushlightuserdata(L, &s_patchNull);
+        lua_setfield(L, -2, "null");
+        lua_pushlightuserdata(L, &s_patchRemove);
+        lua_setfield(L, -2, "remove");
+        lua_setglobal(L, "Json");
+
+        lua_newtable(L);
+        lua_pushcfunction(L, lapi_TomlPatch);
+        lua_setfield(L, -2, "patch");
+        lua_pushlightuserdata(L, &s_patchRemove);
+        lua_setfield(L, -2, "remove");
+        lua_setglobal(L, "Toml");
+
+        lua_newtable(L);
+        lua_pushcfunction(L, lapi_IniSet);
+        lua_setfield(L, -2, "set");
+        lua_setglobal(L, "Ini");
+    }
+
     int lapi_File(lua_State* L) {
         return createFileDescriptor(L, "bytes");
     }
@@ -59,18 +593,18 @@ namespace rdm {
 
             std::string fileName = lua_tostring(L, -1);
 
-            fs::path fileToExec(Module::getCurrentlyExecutingFile().parent_path());
+            fs::path fileToExec(Module::fromState(L)->getDirectory());
             fileToExec.append(fileName);
 
-            std::string name = Module::getNameFromPath(Module::getCurrentlyExecutingFile());
-            if (!isAllowedPath(Module::getCurrentlyExecutingFile().parent_path(), fileToExec, true)) {
+            std::string name = Module::fromState(L)->getName();
+            if (!isAllowedPath(Module::fromState(L)->getDirectory(), fileToExec, true)) {
                 LOG_CUSTOM_ERR(name, "File '" << fileName << "' is not allowed or doesn't exist.");
                 lua_pushnil(L);
                 return 1;
             }
 
             LOG_CUSTOM_INFO(name, "Executing '" << fileName << "'...");
-            int exitCode = std::system(fileToExec.c_str());
+            int exitCode = runExecutable(fileToExec);
             lua_pushnumber(L, exitCode);
         } else {
             lua_pushnil(L);
@@ -84,20 +618,22 @@ namespace rdm {
 
             std::string fileName = lua_tostring(L, -1);
 
-            fs::path fileToExec(Module::getCurrentlyExecutingFile().parent_path());
+            fs::path fileToExec(Module::fromState(L)->getDirectory());
             fileToExec.append(fileName);
 
-            std::string name = Module::getNameFromPath(Module::getCurrentlyExecutingFile());
-            if (!isAllowedPath(Module::getCurrentlyExecutingFile().parent_path(), fileToExec, true)) {
+            std::string name = Module::fromState(L)->getName();
+            if (!isAllowedPath(Module::fromState(L)->getDirectory(), fileToExec, true)) {
                 LOG_CUSTOM_ERR(name, "File '" << fileName << "' is not allowed or doesn't exist.");
                 lua_pushnil(L);
                 return 1;
             }
 
-            std::filesystem::permissions(fileToExec, std::filesystem::perms::owner_exec, std::filesystem::perm_options::add);
+            if (Bundle::getActive() == nullptr || !Bundle::getActive()->contains(fileToExec)) {
+                std::filesystem::permissions(fileToExec, std::filesystem::perms::owner_exec, std::filesystem::perm_options::add);
+            }
 
             LOG_CUSTOM_INFO(name, "Executing '" << fileName << "'...");
-            int exitCode = std::system(fileToExec.c_str());
+            int exitCode = runExecutable(fileToExec);
             lua_pushnumber(L, exitCode);
         } else {
             lua_pushnil(L);
@@ -111,7 +647,7 @@ namespace rdm {
             lua_pushboolean(L, 0);
         } else {
             std::string module = lua_tostring(L, -1);
-            lua_pushboolean(L, ModuleManager::shouldProcessModule(module));
+            lua_pushboolean(L, Module::fromState(L)->getManager().shouldProcessModule(module));
         }
         return 1;
     }
@@ -122,7 +658,7 @@ namespace rdm {
             lua_pushboolean(L, 0);
         } else {
             std::string flag = lua_tostring(L, -1);
-            lua_pushboolean(L, ModuleManager::isFlagSet(flag));
+            lua_pushboolean(L, Module::fromState(L)->getManager().isFlagSet(flag));
         }
         return 1;
     }
@@ -133,13 +669,14 @@ namespace rdm {
             lua_pushboolean(L, 0);
         } else {
             std::string item = lua_tostring(L, -1);
-            lua_pushboolean(L, ModuleManager::isFlagSet(item) || ModuleManager::shouldProcessModule(item));
+            const ModuleManager& manager = Module::fromState(L)->getManager();
+            lua_pushboolean(L, manager.isFlagSet(item) || manager.shouldProcessModule(item));
         }
         return 1;
     }
 
     int lapi_IsPreview(lua_State* L) {
-        lua_pushboolean(L, ModuleManager::isFlagSet("preview"));
+        lua_pushboolean(L, Module::fromState(L)->getManager().isFlagSet("preview"));
         return 1;
     }
 
@@ -147,19 +684,24 @@ namespace rdm {
         if (lua_gettop(L) != 1 || !lua_isstring(L, -1)) {
             lua_pushnil(L);
         } else {
-            std::string content = lua_tostring(L, -1);
-
-            lua_newtable(L);
-            lua_pushstring(L, "type");
-            lua_pushstring(L, "string");
-            lua_settable(L, -3);
-            lua_pushstring(L, "content");
-            lua_pushstring(L, content.c_str());
-            lua_settable(L, -3);
-            lua_pushstring(L, "exec");
+            pushTextDescriptor(L, 1);
             lua_pushboolean(L, true);
-            lua_settable(L, -3);
+            lua_setfield(L, -2, "exec");
+        }
+        return 1;
+    }
+
+    int lapi_stringMode(lua_State* L) {
+        lua_Integer mode;
+        if (lua_gettop(L) != 2 || !parseMode(L, 2, mode)) {
+            LOG_CUSTOM_ERR(Module::fromState(L)->getName(), "Invalid arguments, make sure to call mode as: text:mode(\"0600\")");
+            lua_pushnil(L);
+            return 1;
         }
+
+        pushTextDescriptor(L, 1);
+        lua_pushinteger(L, mode);
+        lua_setfield(L, -2, "mode");
         return 1;
     }
 
@@ -174,7 +716,7 @@ namespace rdm {
             lua_pushboolean(L, true);
             lua_settable(L, -3);
         } else {
-            const std::string name = Module::getNameFromPath(Module::getCurrentlyExecutingFile());
+            const std::string name = Module::fromState(L)->getName();
             if (lua_istable(L, -1)) {
                 if (lua_getfield(L, -1, "path") == LUA_TSTRING) {
                     LOG_CUSTOM_ERR(name, "Invalid exec arguments for descriptor: " << lua_tostring(L, -1));
@@ -189,17 +731,79 @@ namespace rdm {
         return 1;
     }
 
+    int lapi_descriptorIgnore(lua_State* L) {
+        int top = lua_gettop(L);
+        if (top < 2 || !lua_istable(L, 1)) {
+            LOG_CUSTOM_ERR(Module::fromState(L)->getName(), "Invalid arguments, make sure to call ignore as: descriptor:ignore(pattern, ...)");
+            lua_pushnil(L);
+            return 1;
+        }
+
+        if (lua_getfield(L, 1, "ignore") != LUA_TTABLE) {
+            lua_pop(L, 1);
+            lua_newtable(L);
+            lua_pushvalue(L, -1);
+            lua_setfield(L, 1, "ignore");
+        }
+
+        lua_Integer length = luaL_len(L, -1);
+        for (int i = 2; i <= top; ++i) {
+            if (!lua_isstring(L, i)) {
+                LOG_CUSTOM_ERR(Module::fromState(L)->getName(), "Invalid ignore pattern at argument " << i - 1 << ": Not a string");
+                continue;
+            }
+            lua_pushvalue(L, i);
+            lua_rawseti(L, -2, ++length);
+        }
+
+        lua_pushvalue(L, 1);
+        return 1;
+    }
+
+    int lapi_descriptorMode(lua_State* L) {
+        int top = lua_gettop(L);
+        lua_Integer mode;
+        if ((top != 2 && top != 3) || !lua_istable(L, 1) || !parseMode(L, 2, mode) || (top == 3 && !lua_isstring(L, 3))) {
+            LOG_CUSTOM_ERR(Module::fromState(L)->getName(), "Invalid arguments, make sure to call mode as: descriptor:mode(\"0600\") or descriptor:mode(\"0600\", pattern)");
+            lua_pushnil(L);
+            return 1;
+        }
+
+        if (top == 2) {
+            lua_pushinteger(L, mode);
+            lua_setfield(L, 1, "mode");
+            lua_pushvalue(L, 1);
+            return 1;
+        }
+
+        if (lua_getfield(L, 1, "modes") != LUA_TTABLE) {
+            lua_pop(L, 1);
+            lua_newtable(L);
+            lua_pushvalue(L, -1);
+            lua_setfield(L, 1, "modes");
+        }
+        lua_createtable(L, 0, 2);
+        lua_pushvalue(L, 3);
+        lua_setfield(L, -2, "pattern");
+        lua_pushinteger(L, mode);
+        lua_setfield(L, -2, "mode");
+        lua_rawseti(L, -2, luaL_len(L, -2) + 1);
+
+        lua_pushvalue(L, 1);
+        return 1;
+    }
+
     int createFileDescriptor(lua_State* L, std::string name) {
         if (lua_gettop(L) != 1 || !lua_isstring(L, -1)) {
             lua_pushnil(L);
         } else {
             std::string fileName = lua_tostring(L, -1);
 
-            fs::path sourceFile(Module::getCurrentlyExecutingFile().parent_path());
+            fs::path sourceFile(Module::fromState(L)->getDirectory());
             sourceFile.append(fileName);
 
-            if (!isAllowedPath(Module::getCurrentlyExecutingFile().parent_path(), sourceFile, true)) {
-                LOG_CUSTOM_ERR(Module::getNameFromPath(Module::getCurrentlyExecutingFile()), "Invalid path, not a module subdirectory or it doesn't exist.");
+            if (!isAllowedPath(Module::fromState(L)->getDirectory(), sourceFile, true)) {
+                LOG_CUSTOM_ERR(Module::fromState(L)->getName(), "Invalid path, not a module subdirectory or it doesn't exist.");
                 lua_pushnil(L);
                 return 1;
             }
@@ -212,14 +816,7 @@ namespace rdm {
             lua_pushstring(L, sourceFile.c_str());
             lua_settable(L, -3);
 
-            // Modify table (FileDescriptor) metatable to allow execs
-            if(luaL_newmetatable(L, "file_descriptor")) {
-                lua_newtable(L);
-                lua_pushcfunction(L, lapi_descriptorExec);
-                lua_setfield(L, -2, "exec");
-                lua_setfield(L, -2, "__index");
-            }
-            lua_setmetatable(L, -2);
+            setDescriptorMetatable(L);
         }
         return 1;
     }
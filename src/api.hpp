@@ -1,9 +1,14 @@
 #pragma once
-#include <lua.hpp>
+#include "luacompat.hpp"
+#include <memory>
 #include <string>
 
 namespace rdm {
+    int lapi_Print(lua_State* L);
     int lapi_Read(lua_State* L);
+    int lapi_ReadLines(lua_State* L);
+    int lapi_ReadChunks(lua_State* L);
+    int lapi_Buffer(lua_State* L);
     int lapi_FlagIsSet(lua_State* L);
     int lapi_ModuleIsSet(lua_State* L);
     int lapi_IsSet(lua_State* L);
@@ -12,9 +17,23 @@ namespace rdm {
     int lapi_Spawn(lua_State* L);
     int lapi_File(lua_State* L);
     int lapi_Directory(lua_State* L);
+    int lapi_Glob(lua_State* L);
+    int lapi_ListDir(lua_State* L);
+    int lapi_Stat(lua_State* L);
+    int lapi_JsonPatch(lua_State* L);
+    int lapi_TomlPatch(lua_State* L);
+    int lapi_IniSet(lua_State* L);
 
     int lapi_stringExec(lua_State* L);
     int lapi_descriptorExec(lua_State* L);
+    int lapi_descriptorIgnore(lua_State* L);
+    int lapi_descriptorMode(lua_State* L);
+    int lapi_stringMode(lua_State* L);
+
+    // The Json, Toml and Ini tables, with their patch functions and sentinel values
+    void registerConfigLibraries(lua_State* L);
 
     int createFileDescriptor(lua_State* L, std::string name);
+    // The content of the Buffer at index, shared instead of copied, or nullptr if the value isn't a Buffer
+    std::shared_ptr<const std::string> getBufferContent(lua_State* L, int index);
 }
\ No newline at end of file
@@ -0,0 +1,317 @@
+#include "bundle.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "logger.hpp"
+#include "luacompat.hpp"
+#include "modules.hpp"
+#include "utils.hpp"
+
+namespace rdm {
+    const std::string Bundle::EXTENSION = ".rdmb";
+    thread_local Bundle* Bundle::s_activeBundle = nullptr;
+
+    static constexpr char BUNDLE_MAGIC[4] = { 'R', 'D', 'M', 'B' };
+
+    static int bytecodeWriter(lua_State*, const void* data, size_t size, void* userData) {
+        static_cast<std::string*>(userData)->append(static_cast<const char*>(data), size);
+        return 0;
+    }
+
+    Bundle::Bundle(const fs::path &file, const fs::path &root) : m_root(root.lexically_normal()) {
+        int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            m_errorString = std::string("Couldn't open bundle: ") + std::strerror(errno);
+            return;
+        }
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(BundleHeader)) {
+            m_errorString = "Not a valid bundle: file is too small";
+            close(fd);
+            return;
+        }
+
+        void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            m_errorString = std::string("Couldn't map bundle: ") + std::strerror(errno);
+            return;
+        }
+
+        m_data = static_cast<const char*>(mapping);
+        m_size = info.st_size;
+
+        const BundleHeader* header = reinterpret_cast<const BundleHeader*>(m_data);
+        if (std::memcmp(header->magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC)) != 0) {
+            m_errorString = "Not a valid bundle: bad magic";
+        } else if (header->version != VERSION) {
+            m_errorString = "Unsupported bundle version " + std::to_string(header->version);
+        } else if (header->tocOffset > m_size || header->entryCount > (m_size - header->tocOffset) / sizeof(BundleEntry) || header->stringsOffset > m_size) {
+            m_errorString = "Not a valid bundle: corrupted table of contents";
+        } else if (header->tocOffset % alignof(BundleEntry) != 0) {
+            // The entries are read in place, a misaligned table would be misaligned loads
+            m_errorString = "Not a valid bundle: unaligned table of contents, pack it again";
+        } else {
+            m_entries = reinterpret_cast<const BundleEntry*>(m_data + header->tocOffset);
+            m_entryCount = header->entryCount;
+            // Subtractions only, crafted offsets can't wrap around the checks
+            const uint64_t stringsSize = m_size - header->stringsOffset;
+            for (uint64_t i = 0; i < m_entryCount; ++i) {
+                const BundleEntry& entry = m_entries[i];
+                if (entry.size > m_size || entry.offset > m_size - entry.size || entry.pathLength > stringsSize || entry.pathOffset > stringsSize - entry.pathLength) {
+                    m_errorString = "Not a valid bundle: entry out of bounds";
+                    m_entries = nullptr;
+                    m_entryCount = 0;
+                    break;
+                }
+            }
+            if (m_entries != nullptr) madvise(mapping, m_size, MADV_WILLNEED);
+        }
+    }
+
+    Bundle::~Bundle() {
+        if (s_activeBundle == this) s_activeBundle = nullptr;
+        if (m_data != nullptr) munmap(const_cast<char*>(m_data), m_size);
+    }
+
+    bool Bundle::isOpen() const {
+        return m_entries != nullptr;
+    }
+
+    std::string Bundle::getErrorString() const {
+        return m_errorString;
+    }
+
+    const fs::path& Bundle::getRoot() const {
+        return m_root;
+    }
+
+    std::string_view Bundle::getData(const BundleEntry &entry) const {
+        return std::string_view(m_data + entry.offset, entry.size);
+    }
+
+    std::string_view Bundle::getEntryPath(const BundleEntry &entry) const {
+        const BundleHeader* header = reinterpret_cast<const BundleHeader*>(m_data);
+        return std::string_view(m_data + header->stringsOffset + entry.pathOffset, entry.pathLength);
+    }
+
+    std::string Bundle::relativeKey(const fs::path &path) const {
+        fs::path relative = path.lexically_normal().lexically_relative(m_root);
+        std::string key = relative.string();
+        if (key.empty() || key.starts_with("..")) return std::string();
+        if (key.ends_with('/')) key.pop_back();
+        return key;
+    }
+
+    const BundleEntry* Bundle::lowerBound(std::string_view key) const {
+        return std::lower_bound(m_entries, m_entries + m_entryCount, key, [this](const BundleEntry &entry, std::string_view value) {
+            return getEntryPath(entry) < value;
+        });
+    }
+
+    const BundleEntry* Bundle::find(const fs::path &path) const {
+        std::string key = relativeKey(path);
+        if (key.empty() || key == ".") return nullptr;
+        const BundleEntry* entry = lowerBound(key);
+        if (entry == m_entries + m_entryCount || getEntryPath(*entry) != key) return nullptr;
+        return entry;
+    }
+
+    const BundleEntry* Bundle::findModule(const fs::path &path) const {
+        const BundleEntry* entry = find(path);
+        if (entry == nullptr) return nullptr;
+        std::string_view key = getEntryPath(*entry);
+        for (; entry != m_entries + m_entryCount && getEntryPath(*entry) == key; ++entry) {
+            if (entry->type == BundleEntryType::Module) return entry;
+        }
+        return nullptr;
+    }
+
+    bool Bundle::contains(const fs::path &path) const {
+        return isOpen() && !relativeKey(path).empty();
+    }
+
+    bool Bundle::exists(const fs::path &path) const {
+        std::string key = relativeKey(path);
+        if (key.empty()) return false;
+        if (key == ".") return true;
+        if (find(path) != nullptr) return true;
+
+        std::string prefix = key + "/";
+        const BundleEntry* entry = lowerBound(prefix);
+        return entry != m_entries + m_entryCount && getEntryPath(*entry).starts_with(prefix);
+    }
+
+    std::vector<fs::path> Bundle::getDirectoryFiles(const fs::path &dir) const {
+        std::vector<fs::path> files;
+        std::string key = relativeKey(dir);
+        if (key.empty()) return files;
+
+        std::string prefix = key == "." ? std::string() : key + "/";
+        for (const BundleEntry* entry = lowerBound(prefix); entry != m_entries + m_entryCount; ++entry) {
+            std::string_view entryPath = getEntryPath(*entry);
+            if (!entryPath.starts_with(prefix)) break;
+            if (entry->type == BundleEntryType::Module) continue;
+            files.push_back(m_root / entryPath);
+        }
+        return files;
+    }
+
+    std::vector<fs::path> Bundle::getModulePaths() const {
+        std::vector<fs::path> modules;
+        for (uint64_t i = 0; i < m_entryCount; ++i) {
+            if (m_entries[i].type == BundleEntryType::Module) modules.push_back(m_root / getEntryPath(m_entries[i]));
+        }
+        return modules;
+    }
+
+    bool Bundle::extract(const BundleEntry &entry, const fs::path &dest) const {
+        fs::create_directories(dest.parent_path());
+        std::string_view data = getData(entry);
+
+        if (entry.type == BundleEntryType::Symlink) {
+            std::error_code error;
+            fs::create_symlink(std::string(data), dest, error);
+            return !error;
+        }
+
+        int fd = open(dest.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, entry.mode & 07777);
+        if (fd < 0) return false;
+        bool success = writeAll(fd, data.data(), data.size());
+        close(fd);
+        return success;
+    }
+
+    fs::path Bundle::materialize(const BundleEntry &entry) const {
+        std::string tempPath = fs::temp_directory_path() / "rdm-XXXXXX";
+        int fd = mkstemp(tempPath.data());
+        if (fd < 0) return fs::path();
+
+        std::string_view data = getData(entry);
+        bool success = writeAll(fd, data.data(), data.size()) && fchmod(fd, S_IRWXU) == 0;
+        close(fd);
+        if (!success) {
+            fs::remove(tempPath);
+            return fs::path();
+        }
+        return tempPath;
+    }
+
+    bool Bundle::pack(const fs::path &root, const fs::path &output) {
+        struct PendingEntry {
+            std::string path;
+            BundleEntryType type;
+            uint32_t mode;
+            fs::path source;
+            std::string content;
+        };
+
+        std::vector<PendingEntry> pending;
+        for (auto& file : getDirectoryFilesRecursive(root)) {
+            std::string relative = file.lexically_relative(root).string();
+            if (fs::is_symlink(file)) {
+                pending.push_back({ relative, BundleEntryType::Symlink, 0777, fs::path(), fs::read_symlink(file).string() });
+                continue;
+            }
+
+            uint32_t mode = static_cast<uint32_t>(fs::status(file).permissions());
+            pending.push_back({ relative, BundleEntryType::File, mode, file, std::string() });
+
+            std::string fileName = file.filename();
+            if (fileName.starts_with(ModuleManager::MODULE_PREFIX) && fileName.ends_with(".lua")) {
+                lua_State* L = luaL_newstate();
+                if (luaL_loadfile(L, file.c_str()) != LUA_OK) {
+                    LOG_CUSTOM_ERR(Module::getNameFromPath(file), "Couldn't compile module: " << lua_tostring(L, -1));
+                    lua_close(L);
+                    return false;
+                }
+                std::string bytecode;
+                lua_dump(L, bytecodeWriter, &bytecode, 0);
+                lua_close(L);
+                pending.push_back({ relative, BundleEntryType::Module, mode, fs::path(), std::move(bytecode) });
+            }
+        }
+
+        std::sort(pending.begin(), pending.end(), [](const PendingEntry &a, const PendingEntry &b) {
+            if (a.path != b.path) return a.path < b.path;
+            return a.type < b.type;
+        });
+
+        std::ofstream out(output, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            LOG_ERR("Couldn't open " << output << " for writing");
+            return false;
+        }
+
+        BundleHeader header{};
+        std::memcpy(header.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC));
+        header.version = VERSION;
+        header.entryCount = pending.size();
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        std::vector<BundleEntry> entries;
+        entries.reserve(pending.size());
+        std::string strings;
+        uint64_t offset = sizeof(header);
+        for (auto& item : pending) {
+            BundleEntry entry{};
+            entry.offset = offset;
+            entry.pathOffset = strings.size();
+            entry.pathLength = item.path.size();
+            entry.mode = item.mode;
+            entry.type = item.type;
+            strings.append(item.path);
+
+            if (item.source.empty()) {
+                out.write(item.content.data(), item.content.size());
+                entry.size = item.content.size();
+            } else {
+                // The size is what was actually copied, a file changing while packing must not shift the other entries
+                std::ifstream in(item.source, std::ios::binary);
+                char buffer[64 * 1024];
+                entry.size = 0;
+                while (in && out) {
+                    in.read(buffer, sizeof(buffer));
+                    out.write(buffer, in.gcount());
+                    entry.size += in.gcount();
+                }
+                std::error_code error;
+                uint64_t expectedSize = fs::file_size(item.source, error);
+                if (!in.eof() || !out || error || entry.size != expectedSize) {
+                    LOG_ERR("Couldn't pack " << item.source << ", it couldn't be read or changed while packing");
+                    return false;
+                }
+            }
+            offset += entry.size;
+            entries.push_back(entry);
+        }
+
+        // Padded so the table of contents can be read straight from the mapping
+        const uint64_t padding = (alignof(BundleEntry) - offset % alignof(BundleEntry)) % alignof(BundleEntry);
+        out.write("\0\0\0\0\0\0\0\0", padding);
+        offset += padding;
+
+        header.tocOffset = offset;
+        header.stringsOffset = offset + entries.size() * sizeof(BundleEntry);
+        out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(BundleEntry));
+        out.write(strings.data(), strings.size());
+        out.seekp(0);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.close();
+
+        return !out.fail();
+    }
+
+    Bundle* Bundle::getActive() {
+        return s_activeBundle;
+    }
+
+    void Bundle::setActive(Bundle* bundle) {
+        s_activeBundle = bundle;
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace rdm {
+    // On-disk layout of a .rdmb bundle:
+    // [BundleHeader][payloads...][BundleEntry table sorted by path][path strings]
+    // Payloads are stored uncompressed so they can be copied straight out of the mapping.
+    enum class BundleEntryType : uint32_t {
+        File,
+        Symlink,
+        Module
+    };
+
+    struct BundleHeader {
+        char magic[4];
+        uint32_t version;
+        uint64_t entryCount;
+        uint64_t tocOffset;
+        uint64_t stringsOffset;
+    };
+
+    struct BundleEntry {
+        uint64_t offset;
+        uint64_t size;
+        uint32_t pathOffset;
+        uint32_t pathLength;
+        uint32_t mode;
+        BundleEntryType type;
+    };
+
+    static_assert(sizeof(BundleHeader) == 32);
+    static_assert(sizeof(BundleEntry) == 32);
+
+    class Bundle {
+        public:
+        Bundle(const fs::path &file, const fs::path &root);
+        Bundle(Bundle& other) = delete;
+        Bundle& operator=(const Bundle&) = delete;
+        ~Bundle();
+
+        bool isOpen() const;
+        std::string getErrorString() const;
+        const fs::path& getRoot() const;
+
+        const BundleEntry* find(const fs::path &path) const;
+        const BundleEntry* findModule(const fs::path &path) const;
+        bool contains(const fs::path &path) const;
+        bool exists(const fs::path &path) const;
+        std::vector<fs::path> getDirectoryFiles(const fs::path &dir) const;
+        std::vector<fs::path> getModulePaths() const;
+        std::string_view getData(const BundleEntry &entry) const;
+        std::string_view getEntryPath(const BundleEntry &entry) const;
+        bool extract(const BundleEntry &entry, const fs::path &dest) const;
+        fs::path materialize(const BundleEntry &entry) const;
+
+        static bool pack(const fs::path &root, const fs::path &output);
+        static Bundle* getActive();
+        static void setActive(Bundle* bundle);
+
+        static constexpr uint32_t VERSION = 1;
+        static const std::string EXTENSION;
+
+        private:
+        std::string relativeKey(const fs::path &path) const;
+        const BundleEntry* lowerBound(std::string_view key) const;
+
+        const fs::path m_root;
+        std::string m_errorString;
+        const char* m_data = nullptr;
+        size_t m_size = 0;
+        const BundleEntry* m_entries = nullptr;
+        uint64_t m_entryCount = 0;
+
+        // Per thread, so that contexts running on different threads can each use their own bundle
+        static thread_local Bundle* s_activeBundle;
+    };
+}
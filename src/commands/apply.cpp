@@ -1,23 +1,89 @@
 #include "commands.hpp"
 #include "logger.hpp"
+#include "src/bundle.hpp"
+#include "src/executor.hpp"
 #include "src/modules.hpp"
+#include "src/ownership.hpp"
+#include "src/plan.hpp"
 #include "src/utils.hpp"
+#include <cstdint>
 #include <cstdlib>
-#include <fstream>
+#include <memory>
+#include <optional>
 
 using namespace rdm;
 
-#define LOG_CUSTOM_INFO_VERBOSE(name, x) if (modulesAndFlags.programFlags.contains(Flag::VERBOSE)) LOG_CUSTOM_INFO(name, x);
-#define LOG_CUSTOM_WARN_VERBOSE(name, x) if (modulesAndFlags.programFlags.contains(Flag::VERBOSE)) LOG_CUSTOM_WARN(name, x);
+static constexpr NameTable<uint64_t, 4> SIZE_UNITS = {{ { "", 1 }, { "K", 1ull << 10 }, { "M", 1ull << 20 }, { "G", 1ull << 30 } }};
+
+// Bytes with an optional binary unit, e.g. '512M'
+static bool parseSize(const std::string &value, uint64_t &result) {
+    char* end = nullptr;
+    unsigned long long size = std::strtoull(value.c_str(), &end, 10);
+    std::optional<uint64_t> unit = findByName(SIZE_UNITS, end);
+    if (end == value.c_str() || value.starts_with('-') || !unit.has_value()) return false;
+    result = size * *unit;
+    return true;
+}
+
+static void previewPlan(const ApplyPlan &plan, const DestinationFilter &filter, bool verbose) {
+    std::string currentModule;
+    for (auto& entry : plan.getEntries()) {
+        const std::string& moduleName = entry.owner;
+        if (moduleName != currentModule) {
+            if (verbose && !currentModule.empty()) {
+                LOG_SEP();
+                LOG_CUSTOM_INFO(currentModule, "Finished processing");
+            }
+            currentModule = moduleName;
+            LOG_SEP();
+        }
 
-int rdm::commands::apply(Command cmd, int argc, char **argv) {
-    if (!fs::exists(RDM_DATA_DIR) || fs::is_empty(RDM_DATA_DIR)) {
-        LOG_ERR("RDM data dir is empty or doesn't exist, run either 'rdm init' or 'rdm clone' to initialize it before running this command");
-        return EXIT_FAILURE;
+        const fs::path file = plan.getDestinationRoot() / entry.destination;
+        LOG_SEP();
+        LOG_CUSTOM(moduleName, file << ":");
+
+        switch (entry.data->getDataType()) {
+            case FileDataType::Text:
+                LOG(entry.data->getContent());
+                break;
+            case FileDataType::RawData:
+                LOG("Raw Copy");
+                break;
+            case FileDataType::Directory: {
+                fs::path sourcePath = entry.data->getPath();
+                LOG_CUSTOM(moduleName, "Copy of directory " << sourcePath.c_str() << ":");
+                auto files = getDirectoryFilesRecursive(sourcePath, PathFilter(entry.data->getIgnorePatterns()), [&](const fs::path &relativePath, bool isDirectory) {
+                    fs::path destination = entry.destination / relativePath;
+                    return !filter.empty() && (isDirectory ? !filter.mayContainSelected(destination) : !filter.isSelected(destination));
+                });
+                size_t fileCount = files.size();
+                size_t filesToPrint = fileCount >= 16 ? 16 : fileCount;
+                for (size_t i{0}; i < filesToPrint; ++i) {
+                    fs::path extraPath = files.at(i).lexically_relative(sourcePath);
+                    LOG(" - " << (file / extraPath).c_str());
+                }
+                if (fileCount > filesToPrint) {
+                    LOG(" + " << fileCount - filesToPrint << " more...");
+                }
+                break;
+            }
+            default:
+                LOG_CUSTOM_ERR(moduleName, "Received a file with an invalid data type: " << file);
+        }
     }
 
+    if (verbose && !currentModule.empty()) {
+        LOG_SEP();
+        LOG_CUSTOM_INFO(currentModule, "Finished processing");
+    }
+}
+
+int rdm::commands::apply(Command cmd, int argc, char **argv) {
     auto modulesAndFlags = parseModulesAndFlags(argv + 2, argc - 2);
 
+    std::unique_ptr<Bundle> bundle;
+    if (!prepareModuleSource(modulesAndFlags, bundle)) return EXIT_FAILURE;
+
     if (modulesAndFlags.modules.empty()) {
         LOG_INFO("No modules specified, defaulting to all modules");
     } else {
@@ -46,7 +112,7 @@ int rdm::commands::apply(Command cmd, int argc, char **argv) {
     LOG_SEP();
     LOG_CUSTOM("Stage", "Loading all requested modules...");
     LOG_SEP();
-    ModuleManager moduleManager = ModuleManager(RDM_DATA_DIR / "home", getUserHome(), modulesAndFlags);
+    ModuleManager moduleManager = ModuleManager(getDataDir() / "home", getUserHome(), modulesAndFlags);
 
     for (auto& moduleName : modulesAndFlags.modules) {
         if (!moduleManager.getModules().contains(moduleName)) {
@@ -54,190 +120,70 @@ int rdm::commands::apply(Command cmd, int argc, char **argv) {
         }
     }
 
-    if (cmd == Command::APPLY_SAFE) {
-        LOG_CUSTOM("Safety", "Cleaning backup directory...");
-        setupBackupDir("home");
-    }
-
     LOG_SEP();
     LOG_CUSTOM("Stage", "Running init operations...");
     LOG_SEP();
     moduleManager.runInits();
 
     LOG_SEP();
-    LOG_CUSTOM("Stage", "Running file operations...");
+    LOG_CUSTOM("Stage", "Planning file operations...");
     LOG_SEP();
-    int processedModules = 0;
-    for (auto& [moduleName, module]: moduleManager.getModules()) {
-        if (moduleManager.shouldProcessModule(moduleName)) {
-            std::optional<FileContentMap> generatedFiles = module.getGeneratedFiles();
-            processedModules++;
-
-            if (cmd == Command::PREVIEW) LOG_SEP();
-
-            if (!generatedFiles.has_value()) {
-                LOG_CUSTOM_ERR(moduleName, "The module '" << moduleName << "' was found but had errors [" << module.getExitCode() << "]: " << module.getErrorString());
-                continue;
-            } else if (generatedFiles.value().empty()) {
-                LOG_CUSTOM_DEBUG(moduleName, "The module '" << moduleName << "' was found but returned no files.");
-                continue;
-            } else {
-                LOG_CUSTOM_INFO_VERBOSE(moduleName, "Started processing");
-            }
+    // Modules are always evaluated against the home, the plan is relative so it can be copied to any root
+    const DestinationFilter filter = getDestinationFilter(modulesAndFlags);
+    ApplyPlan plan(moduleManager, getUserHome(), filter);
+    size_t processedModules = plan.getModules().size();
 
-            int skippedFiles = 0;
-            int modifiedFiles = 0;
-            int processedFiles = 0;
-            int savedFiles = 0;
-            for (auto& fileKV : generatedFiles.value()) {
-                const FileData& fileData = fileKV.second;
-                const FileDataType& dataType = fileData.getDataType();
-                const fs::path file = fileKV.first;
-                if (cmd == Command::PREVIEW) {
-                    LOG_SEP();
-                    LOG_CUSTOM(moduleName, file << ":");
-                }
+    const std::vector<fs::path> destinationRoots = getDestinationRoots(modulesAndFlags);
 
-                LOG_CUSTOM_DEBUG(moduleName, "Processing: " << file);
-                LOG_CUSTOM_DEBUG(moduleName, (dataType == FileDataType::Directory ? "Directory: " : "File: ") << file.stem());
-                LOG_CUSTOM_DEBUG(moduleName, "Destination: " << file.parent_path());
-                
-                if (cmd != Command::PREVIEW) {
-                    fs::create_directories(file.parent_path());
-
-                    if (dataType != FileDataType::Directory) {
-                        processedFiles++;
-                        if (fs::exists(file)) {
-                            if (cmd == Command::APPLY_SOFT) {
-                                skippedFiles++;
-                                LOG_CUSTOM_INFO_VERBOSE(moduleName, "Skipping " << file);
-                                continue;
-                            }
-
-                            if (cmd == Command::APPLY_SAFE) {
-                                LOG_CUSTOM_INFO_VERBOSE(moduleName, "Creating backup of " << file);
-                                backupEntry("home", file);
-                                savedFiles++;
-                            }
-
-                            if (fs::is_directory(file)) {
-                                skippedFiles++;
-                                LOG_CUSTOM_ERR(moduleName, "Tried to replace a directory with a file at " << file << ", skipping to prevent data loss!");
-                                continue;
-                            }
-
-                            LOG_CUSTOM_WARN_VERBOSE(moduleName, "Replacing " << file);
-
-                            fs::remove(file);
-                        } else {
-                            LOG_CUSTOM_INFO_VERBOSE(moduleName, "Creating " << file);
-                        }
-                    }
-                }
+    LOG_SEP();
+    LOG_CUSTOM("Stage", "Running file operations...");
+    LOG_SEP();
+    if (cmd == Command::PREVIEW) {
+        previewPlan(plan, filter, modulesAndFlags.programFlags.contains(Flag::VERBOSE));
+    } else {
+        ExecutorOptions options;
+        options.verbose = modulesAndFlags.programFlags.contains(Flag::VERBOSE);
+        if (cmd == Command::APPLY_SOFT) options.replaceMode = ReplaceMode::Skip;
+        if (cmd == Command::APPLY_SAFE) options.replaceMode = ReplaceMode::Backup;
+
+        std::string backend = getOptionValue(modulesAndFlags, Option::IO_BACKEND);
+        if (backend == "sync") {
+            options.backend = IOBackend::Sync;
+        } else if (backend == "uring") {
+            options.backend = IOBackend::Uring;
+        } else if (!backend.empty() && backend != "auto") {
+            LOG_WARN("Unknown I/O backend '" << backend << "', valid values are auto, sync and uring");
+        }
 
-                switch (dataType) {
-                    case FileDataType::Text:
-                        if (cmd == Command::PREVIEW) {
-                            LOG(fileData.getContent());
-                        } else {
-                            std::ofstream handle = std::ofstream(file);
-                            handle << fileData.getContent();
-                            handle.close();
-                            
-                            if (fileData.isExecutable()) {
-                                LOG_CUSTOM_INFO_VERBOSE(moduleName, "Making " << file << " executable");
-                                std::filesystem::permissions(file, std::filesystem::perms::owner_exec | std::filesystem::perms::group_exec | std::filesystem::perms::others_exec, std::filesystem::perm_options::add);
-                            }
-                            
-                            modifiedFiles++;
-                        }
-                        break;
-                    case FileDataType::RawData:
-                        if (cmd == Command::PREVIEW) {
-                            LOG("Raw Copy");
-                        } else {
-                            if (fs::exists(file) && fs::is_directory(file)) {
-                                LOG_CUSTOM_ERR(moduleName, "Tried to replace a directory with a file: '" << file << "' skipping to prevent data loss!");
-                                break;
-                            }
-
-                            copyFileOrSym(fileData.getPath(), file);
-
-                            if (fileData.isExecutable()) {
-                                LOG_CUSTOM_INFO_VERBOSE(moduleName, "Making " << file << " executable");
-                                std::filesystem::permissions(file, std::filesystem::perms::owner_exec | std::filesystem::perms::group_exec | std::filesystem::perms::others_exec, std::filesystem::perm_options::add);
-                            }
-
-                            modifiedFiles++;
-                        }
-                        break;
-                    case FileDataType::Directory:
-                        if (cmd == Command::PREVIEW) {
-                            fs::path sourcePath = fileData.getPath();
-                            LOG_CUSTOM(moduleName, "Copy of directory " << sourcePath.c_str() << ":");
-                            auto files = getDirectoryFilesRecursive(sourcePath);
-                            size_t fileCount = files.size();
-                            size_t filesToPrint = fileCount >= 16 ? 16 : fileCount;
-                            for (size_t i{0}; i < filesToPrint; ++i) {
-                                fs::path extraPath = files.at(i).lexically_relative(sourcePath);
-                                LOG(" - " << (file / extraPath).c_str());
-                            }
-                            if (fileCount > filesToPrint) {
-                                LOG(" + " << fileCount - filesToPrint << " more...");
-                            }
-                        } else {
-                            bool shouldAlwaysExec = fileData.isExecutable() && (fileData.getExecutablePattern().empty() || fileData.getExecutablePattern() == "*");
-
-                            fs::path sourcePath = fileData.getPath();
-                            fs::path destinationPath = file;
-                            for (auto& file : getDirectoryFilesRecursive(sourcePath)) {
-                                processedFiles++;
-                                fs::path extraPath = file.lexically_relative(sourcePath);
-                                fs::path destinationFile = destinationPath / extraPath;
-                                fs::path sourceFile = sourcePath / extraPath;
-
-                                if (fs::exists(fs::symlink_status(destinationFile))) {
-                                    if (cmd == Command::APPLY_SOFT) {
-                                        LOG_CUSTOM_INFO_VERBOSE(moduleName, "Skipping " << destinationFile);
-                                        skippedFiles++;
-                                        continue;
-                                    }
-                                    if (cmd == Command::APPLY_SAFE) {
-                                        LOG_CUSTOM_INFO_VERBOSE(moduleName, "Creating backup of " << destinationFile);
-                                        backupEntry("home", destinationFile);
-                                        savedFiles++;
-                                    }
-                                    LOG_CUSTOM_WARN_VERBOSE(moduleName, "Replacing " << destinationFile);
-                                    fs::remove(destinationFile);
-                                } else {
-                                    LOG_CUSTOM_INFO_VERBOSE(moduleName, "Creating " << destinationFile);
-                                }
-
-                                copyFileOrSym(sourceFile, destinationFile);
-
-                                if (shouldAlwaysExec ||
-                                    (fileData.isExecutable() && fileMatchesPattern(destinationFile.filename(), fileData.getExecutablePattern()))
-                                ) {
-                                    LOG_CUSTOM_INFO_VERBOSE(moduleName, "Making " << destinationFile << " executable");
-                                    std::filesystem::permissions(destinationFile, std::filesystem::perms::owner_exec | std::filesystem::perms::group_exec | std::filesystem::perms::others_exec, std::filesystem::perm_options::add);
-                                }
-
-                                modifiedFiles++;
-                            }
-                        }
-                        break;
-                    default:
-                        LOG_CUSTOM_ERR(moduleName, "Received a file with an invalid data type: " << file);
-                }
-            }
+        std::string largeFileSize = getOptionValue(modulesAndFlags, Option::LARGE_FILE_SIZE);
+        if (!largeFileSize.empty() && !parseSize(largeFileSize, options.largeFileSize)) {
+            LOG_WARN("Ignoring the invalid size '" << largeFileSize << "', use a number of bytes with an optional K, M or G unit");
+        }
 
-            if (cmd != Command::PREVIEW) LOG_CUSTOM_INFO(moduleName, "Processed " << processedFiles << " total files");
-            if (cmd != Command::PREVIEW) LOG_CUSTOM_INFO(moduleName, "Created or modified " << modifiedFiles << " files");
-            if (cmd == Command::APPLY_SAFE) LOG_CUSTOM_INFO(moduleName, "Backed up " << savedFiles << " files that were already present");
-            if (cmd != Command::PREVIEW && skippedFiles > 0) LOG_CUSTOM_INFO(moduleName, "Skipped " << skippedFiles << " files that were already present");
-            if (modulesAndFlags.programFlags.contains(Flag::VERBOSE)) {
-                if(cmd == Command::PREVIEW) LOG_SEP();
-                LOG_CUSTOM_INFO(moduleName, "Finished processing");
+        const bool prune = modulesAndFlags.programFlags.contains(Flag::PRUNE);
+        // Every root gets its own executor, they only share the read-only plan
+        std::vector<ExecutionReport> reports(destinationRoots.size());
+        parallelFor(destinationRoots.size(), [&](size_t i) {
+            ExecutorOptions rootOptions = options;
+            rootOptions.backupGroup = getBackupGroup(destinationRoots.at(i));
+            if (cmd == Command::APPLY_SAFE) {
+                LOG_CUSTOM("Safety", "Cleaning backup directory " << getBackupDir(rootOptions.backupGroup).c_str() << "...");
+                setupBackupDir(rootOptions.backupGroup);
+            }
+            reports.at(i) = executePlan(plan, destinationRoots.at(i), rootOptions);
+            updateOwnership(plan, reports.at(i), destinationRoots.at(i), filter, prune, rootOptions);
+        });
+
+        for (size_t i = 0; i < destinationRoots.size(); ++i) {
+            if (destinationRoots.size() > 1) LOG_CUSTOM("Root", destinationRoots.at(i).c_str());
+            for (auto& moduleName : plan.getModules()) {
+                if (!reports.at(i).contains(moduleName)) continue;
+                const ExecutionStats& stats = reports.at(i).at(moduleName);
+                LOG_CUSTOM_INFO(moduleName, "Processed " << stats.processedFiles << " total files");
+                LOG_CUSTOM_INFO(moduleName, "Created or modified " << stats.modifiedFiles << " files");
+                if (cmd == Command::APPLY_SAFE) LOG_CUSTOM_INFO(moduleName, "Backed up " << stats.savedFiles << " files that were already present");
+                if (stats.skippedFiles > 0) LOG_CUSTOM_INFO(moduleName, "Skipped " << stats.skippedFiles << " files that were already present");
+                if (prune) LOG_CUSTOM_INFO(moduleName, "Pruned " << stats.prunedFiles << " files it no longer produces");
             }
         }
     }
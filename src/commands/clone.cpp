@@ -39,8 +39,8 @@ int rdm::commands::clone(Command, int argc, char **argv) {
     if (argc > 3) {
         std::string extraArg = argv[3];
         if (extraArg == "--replace") {
-            LOG_WARN("Deleting all files in " << RDM_DATA_DIR.c_str() << "...");
-            fs::remove_all(RDM_DATA_DIR);
+            LOG_WARN("Deleting all files in " << getDataDir().c_str() << "...");
+            fs::remove_all(getDataDir());
         }
     }
 
@@ -52,8 +52,8 @@ int rdm::commands::clone(Command, int argc, char **argv) {
     git_clone_options options = GIT_CLONE_OPTIONS_INIT;
     git_repository* repo = nullptr;
 
-    LOG_INFO("Attempting to clone repository into " << RDM_DATA_DIR.c_str() << "...");
-    int cloneResult = git_clone(&repo, repoURL.c_str(), RDM_DATA_DIR.c_str(), &options);
+    LOG_INFO("Attempting to clone repository into " << getDataDir().c_str() << "...");
+    int cloneResult = git_clone(&repo, repoURL.c_str(), getDataDir().c_str(), &options);
 
     if (cloneResult != 0) {
         LOG_CUSTOM_ERR("git", "Clone error: " << git_error_last()->message);
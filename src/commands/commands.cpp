@@ -6,42 +6,14 @@
 #include <filesystem>
 
 namespace rdm::commands {
-    const fs::path RDM_DATA_DIR = getDataDir();
-    const std::unordered_map<std::string, Command> COMMAND_MAP = {
-        { "apply",      Command::APPLY      },
-        { "apply-safe", Command::APPLY_SAFE },
-        { "apply-soft", Command::APPLY_SOFT },
-        { "clone",      Command::CLONE      },
-        { "dir",        Command::DIR        },
-        { "help",       Command::HELP       },
-        { "init",       Command::INIT       },
-        { "list",       Command::LIST       },
-        { "preview",    Command::PREVIEW    },
-        { "restore",    Command::RESTORE    },
-    };
-
-    const std::unordered_map<Command, CommandHandler> COMMAND_HANDLER_MAP = {
-        { Command::APPLY,      apply   },
-        { Command::APPLY_SAFE, apply   },
-        { Command::APPLY_SOFT, apply   },
-        { Command::CLONE,      clone   },
-        { Command::DIR,        dir     },
-        { Command::HELP,       help    },
-        { Command::INIT,       init    },
-        { Command::LIST,       list    },
-        { Command::PREVIEW,    apply   },
-        { Command::RESTORE,    restore },
-        { Command::UNKNOWN,    unknown },
-    };
-
     int dir(Command, int, char*[]) {
-        LOG(RDM_DATA_DIR.c_str());
+        LOG(getDataDir().c_str());
         return EXIT_SUCCESS;
     }
 
     int init(Command, int argc, char*[]) {
         ensureDataDirExists(true);
-        LOG("Initialized rdm at " << RDM_DATA_DIR.c_str());
+        LOG("Initialized rdm at " << getDataDir().c_str());
         if (argc > 2) {
             LOG_WARN("Detected an extra argument, if you meant to initialize from a repository, use 'rdm clone <url>' instead");
         }
@@ -56,15 +28,38 @@ namespace rdm::commands {
     }
 
     int runCommandHandler(Command cmd, int argc, char* argv[]) {
-        CommandHandler handler = COMMAND_HANDLER_MAP.at(Command::UNKNOWN);
-        if (COMMAND_HANDLER_MAP.contains(cmd)) handler = COMMAND_HANDLER_MAP.at(cmd);
+        CommandHandler handler = unknown;
+        for (auto& entry : COMMANDS) {
+            if (entry.command == cmd) handler = entry.handler;
+        }
         return handler(cmd, argc, argv);
     }
 
-    Command parseCommand(const std::string &raw_cmd) {
-        Command cmd = Command::UNKNOWN;
-        if (COMMAND_MAP.contains(raw_cmd)) cmd = COMMAND_MAP.at(raw_cmd);
-        return cmd;
+    Command parseCommand(std::string_view raw_cmd) {
+        for (auto& entry : COMMANDS) {
+            if (entry.name == raw_cmd) return entry.command;
+        }
+        return Command::UNKNOWN;
+    }
+
+    // Modules are either loaded from the bundle passed with --bundle or from the data dir
+    bool prepareModuleSource(const ModulesAndFlags &maf, std::unique_ptr<Bundle> &bundle) {
+        std::string bundlePath = getOptionValue(maf, Option::BUNDLE);
+        if (!bundlePath.empty()) {
+            bundle = std::make_unique<Bundle>(bundlePath, getDataDir() / "home");
+            if (!bundle->isOpen()) {
+                LOG_ERR(bundle->getErrorString());
+                return false;
+            }
+            Bundle::setActive(bundle.get());
+            LOG_INFO("Using modules from bundle " << bundlePath);
+        } else if (!fs::exists(getDataDir()) || fs::is_empty(getDataDir())) {
+            LOG_ERR("RDM data dir is empty or doesn't exist, run either 'rdm init' or 'rdm clone' to initialize it before running this command");
+            return false;
+        } else if (!copyRDMLib()) {
+            LOG_DEBUG("Couldn't copy RDM lib.");
+        }
+        return true;
     }
 }
 
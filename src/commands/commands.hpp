@@ -1,8 +1,12 @@
 #pragma once
 
+#include <array>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <filesystem>
+#include <memory>
+#include "src/bundle.hpp"
+#include "src/utils.hpp"
 
 namespace fs = std::filesystem;
 
@@ -13,31 +17,66 @@ namespace rdm::commands {
         APPLY_SAFE,
         APPLY_SOFT,
         CLONE,
+        COMPLETE,
+        DIFF,
         DIR,
+        EXPORT,
         HELP,
         INIT,
         LIST,
+        PACK,
         PREVIEW,
-        RESTORE
+        REMOVE,
+        RESTORE,
+        STATUS
     };
 
     typedef int (*CommandHandler)(Command, int, char*[]);
 
-    extern const std::unordered_map<std::string, Command> COMMAND_MAP;
-    extern const std::unordered_map<Command, CommandHandler> COMMAND_HANDLER_MAP;
-    extern const fs::path RDM_DATA_DIR;
-
     // In commands.cpp
     int dir(Command cmd, int argc, char* argv[]);
     int init(Command cmd, int argc, char* argv[]);
     int unknown(Command cmd, int argc, char* argv[]);
     int runCommandHandler(Command cmd, int argc, char* argv[]);
-    Command parseCommand(const std::string &cmd);
+    Command parseCommand(std::string_view cmd);
+    bool prepareModuleSource(const ModulesAndFlags &maf, std::unique_ptr<Bundle> &bundle);
 
     // External
     int apply(Command cmd, int argc, char* argv[]);
     int clone(Command cmd, int argc, char* argv[]);
+    int complete(Command cmd, int argc, char* argv[]);
+    int diff(Command cmd, int argc, char* argv[]);
+    int exportFiles(Command cmd, int argc, char* argv[]);
     int help(Command cmd, int argc, char* argv[]);
     int list(Command cmd, int argc, char* argv[]);
+    int pack(Command cmd, int argc, char* argv[]);
+    int remove(Command cmd, int argc, char* argv[]);
     int restore(Command cmd, int argc, char* argv[]);
+    int status(Command cmd, int argc, char* argv[]);
+
+    struct CommandEntry {
+        std::string_view name;
+        Command command;
+        CommandHandler handler;
+    };
+
+    // Built at compile time, looking up a command doesn't allocate or hash anything
+    inline constexpr std::array<CommandEntry, 16> COMMANDS = {{
+        { "apply",      Command::APPLY,      apply       },
+        { "apply-safe", Command::APPLY_SAFE, apply       },
+        { "apply-soft", Command::APPLY_SOFT, apply       },
+        { "clone",      Command::CLONE,      clone       },
+        { "complete",   Command::COMPLETE,   complete    },
+        { "diff",       Command::DIFF,       diff        },
+        { "dir",        Command::DIR,        dir         },
+        { "export",     Command::EXPORT,     exportFiles },
+        { "help",       Command::HELP,       help        },
+        { "init",       Command::INIT,       init        },
+        { "list",       Command::LIST,       list        },
+        { "pack",       Command::PACK,       pack        },
+        { "preview",    Command::PREVIEW,    apply       },
+        { "remove",     Command::REMOVE,     remove      },
+        { "restore",    Command::RESTORE,    restore     },
+        { "status",     Command::STATUS,     status      },
+    }};
 }
\ No newline at end of file
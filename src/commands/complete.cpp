@@ -0,0 +1,151 @@
+#include "commands.hpp"
+#include "logger.hpp"
+#include "src/moduleindex.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+    constexpr std::string_view BASH_SCRIPT =
+R"(_rdm() {
+    local IFS=$'\n'
+    COMPREPLY=($(rdm complete "${COMP_WORDS[@]:1:COMP_CWORD}" 2>/dev/null))
+}
+complete -o default -F _rdm rdm)";
+
+    constexpr std::string_view ZSH_SCRIPT =
+R"(#compdef rdm
+_rdm() {
+    local -a candidates
+    candidates=("${(@f)$(rdm complete "${(@)words[2,CURRENT]}" 2>/dev/null)}")
+    if [[ -n ${candidates[1]} ]]; then
+        compadd -a candidates
+    else
+        _files
+    fi
+}
+compdef _rdm rdm)";
+
+    constexpr std::string_view FISH_SCRIPT =
+R"(complete -c rdm -f -a '(rdm complete (commandline -opc)[2..-1] (commandline -ct) 2>/dev/null)')";
+
+    constexpr std::array<std::string_view, 8> MODULE_COMMANDS = { "apply", "apply-safe", "apply-soft", "diff", "export", "preview", "remove", "status" };
+    constexpr std::array<std::string_view, 2> FLAGS_OPTIONS = { "-f", "--flags" };
+
+    void addCandidate(std::vector<std::string_view> &candidates, std::string_view prefix, std::string_view candidate) {
+        if (candidate.starts_with(prefix)) candidates.push_back(candidate);
+    }
+
+    // Flags of the given modules and of the ones they add, or of every module if none was given
+    void addFlags(std::vector<std::string_view> &candidates, std::string_view prefix, const std::vector<rdm::ModuleIndexEntry> &index, const std::vector<std::string_view> &modules) {
+        auto findModule = [&index](std::string_view name) -> const rdm::ModuleIndexEntry* {
+            auto entry = std::lower_bound(index.begin(), index.end(), name, [](const rdm::ModuleIndexEntry &a, std::string_view b) {
+                return a.name < b;
+            });
+            return entry != index.end() && entry->name == name ? &*entry : nullptr;
+        };
+
+        std::vector<const rdm::ModuleIndexEntry*> pending;
+        std::unordered_set<const rdm::ModuleIndexEntry*> visited;
+        if (modules.empty()) {
+            for (auto& entry : index) pending.push_back(&entry);
+        } else {
+            for (auto& name : modules) {
+                if (const rdm::ModuleIndexEntry* entry = findModule(name)) pending.push_back(entry);
+            }
+        }
+
+        while (!pending.empty()) {
+            const rdm::ModuleIndexEntry* entry = pending.back();
+            pending.pop_back();
+            if (!visited.insert(entry).second) continue;
+            for (auto& flag : entry->flags) addCandidate(candidates, prefix, flag);
+            for (auto& name : entry->addedModules) {
+                if (const rdm::ModuleIndexEntry* added = findModule(name)) pending.push_back(added);
+            }
+        }
+    }
+
+    int printScript(std::string_view shell) {
+        if (shell == "bash") {
+            LOG(BASH_SCRIPT);
+        } else if (shell == "zsh") {
+            LOG(ZSH_SCRIPT);
+        } else if (shell == "fish") {
+            LOG(FISH_SCRIPT);
+        } else {
+            LOG_ERR("Unknown shell '" << shell << "', valid shells are: bash, zsh, fish");
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+}
+
+// Completes the last word, argv[2..] are the words after 'rdm' up to the cursor
+int rdm::commands::complete(Command, int argc, char* argv[]) {
+    if (argc >= 3 && std::string_view(argv[2]) == "--shell") {
+        if (argc != 4) {
+            LOG_ERR("Missing shell, valid shells are: bash, zsh, fish");
+            return EXIT_FAILURE;
+        }
+        return printScript(argv[3]);
+    }
+
+    std::vector<std::string_view> words(argv + 2, argv + argc);
+    if (words.empty()) words.emplace_back();
+    const std::string_view prefix = words.back();
+    // Candidates point into the index, it must outlive them
+    std::vector<ModuleIndexEntry> index;
+    std::vector<std::string_view> candidates;
+
+    if (words.size() == 1 || (words.size() == 2 && words[0] == "help")) {
+        for (auto& entry : COMMANDS) addCandidate(candidates, prefix, entry.name);
+    } else if (std::find(MODULE_COMMANDS.begin(), MODULE_COMMANDS.end(), words[0]) != MODULE_COMMANDS.end()) {
+        // The value of an option is left to the shell
+        if (findByName(OPTION_MAP, words[words.size() - 2]).has_value()) return EXIT_SUCCESS;
+
+        // Same rules as parseModulesAndFlags, everything after -f is a flag
+        std::vector<std::string_view> modules;
+        bool completingFlags = false;
+        for (size_t i = 1; i + 1 < words.size(); ++i) {
+            if (std::find(FLAGS_OPTIONS.begin(), FLAGS_OPTIONS.end(), words[i]) != FLAGS_OPTIONS.end()) {
+                completingFlags = true;
+            } else if (findByName(OPTION_MAP, words[i]).has_value()) {
+                i++;
+            } else if (!completingFlags && !words[i].starts_with('-')) {
+                modules.push_back(words[i]);
+            }
+        }
+
+        if (prefix.starts_with('-')) {
+            for (auto& [name, flag] : FLAG_MAP) addCandidate(candidates, prefix, name);
+            for (auto& [name, option] : OPTION_MAP) addCandidate(candidates, prefix, name);
+            if (!completingFlags) {
+                for (auto& name : FLAGS_OPTIONS) addCandidate(candidates, prefix, name);
+            }
+        } else if (completingFlags) {
+            index = getModuleIndex(getDataDir() / "home");
+            addFlags(candidates, prefix, index, modules);
+        } else {
+            index = getModuleIndex(getDataDir() / "home");
+            for (auto& entry : index) {
+                if (std::find(modules.begin(), modules.end(), entry.name) == modules.end()) addCandidate(candidates, prefix, entry.name);
+            }
+        }
+    }
+
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    if (candidates.empty()) return EXIT_SUCCESS;
+
+    // A single record, completion runs on every key press
+    std::string output;
+    for (auto& candidate : candidates) output.append(candidate).push_back('\n');
+    output.pop_back();
+    LOG(output);
+    return EXIT_SUCCESS;
+}
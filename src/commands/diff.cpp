@@ -0,0 +1,107 @@
+#include "commands.hpp"
+#include "logger.hpp"
+#include "src/diff.hpp"
+#include "src/modules.hpp"
+#include "src/plan.hpp"
+#include "src/status.hpp"
+#include "src/utils.hpp"
+#include <cstdlib>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace rdm;
+
+static std::string formatMode(mode_t mode) {
+    std::ostringstream out;
+    out << std::oct << (S_IFREG | mode);
+    return out.str();
+}
+
+// Mirrors what apply would do to a single destination, empty if the file is already up to date
+static std::string getOperationDiff(const PlanOperation &operation, const fs::path &destinationRoot, mode_t umask, bool color) {
+    const std::string relative = operation.destination.string();
+    const std::string oldLabel = "a/" + relative;
+    const std::string newLabel = "b/" + relative;
+
+    FileSnapshot desired;
+    if (!getDesiredSnapshot(operation, umask, desired)) {
+        LOG_CUSTOM_ERR(operation.owner, "Couldn't read the source of " << destinationRoot / operation.destination);
+        return std::string();
+    }
+
+    FileSnapshot current;
+    if (!getCurrentSnapshot(destinationRoot / operation.destination, true, current)) {
+        LOG_CUSTOM_ERR(operation.owner, "Couldn't read " << destinationRoot / operation.destination);
+        return std::string();
+    }
+
+    if (current.isDirectory) return "Directory " + oldLabel + " would be kept, the file from '" + operation.owner + "' is skipped\n";
+    if (desired.isSymlink || current.isSymlink) {
+        if (desired.isSymlink && current.isSymlink && desired.content.getContent() == current.content.getContent()) return std::string();
+        std::string from = current.exists ? (current.isSymlink ? "symlink to " + std::string(current.content.getContent()) : "file") : "nothing";
+        std::string to = desired.isSymlink ? "symlink to " + std::string(desired.content.getContent()) : "file";
+        return "Changed " + relative + " from " + from + " to " + to + "\n";
+    }
+
+    std::string_view oldContent = current.content.getContent();
+    std::string_view newContent = desired.content.getContent();
+    std::string out;
+    if (!current.exists) {
+        out = "new file mode " + formatMode(desired.mode) + "\n";
+    } else if (current.mode != desired.mode) {
+        out = "old mode " + formatMode(current.mode) + "\nnew mode " + formatMode(desired.mode) + "\n";
+    }
+
+    if (oldContent == newContent) return out;
+    if (isBinary(oldContent) || isBinary(newContent)) {
+        return out + "Binary files " + (current.exists ? oldLabel : "/dev/null") + " and " + newLabel + " differ\n";
+    }
+    return out + getUnifiedDiff(oldContent, newContent, current.exists ? oldLabel : "/dev/null", newLabel, color);
+}
+
+int rdm::commands::diff(Command, int argc, char **argv) {
+    auto modulesAndFlags = parseModulesAndFlags(argv + 2, argc - 2);
+
+    std::unique_ptr<Bundle> bundle;
+    if (!prepareModuleSource(modulesAndFlags, bundle)) return EXIT_FAILURE;
+
+    // Modules must not have side effects while diffing
+    modulesAndFlags.flags.insert("preview");
+
+    ModuleManager moduleManager = ModuleManager(getDataDir() / "home", getUserHome(), modulesAndFlags);
+    for (auto& moduleName : modulesAndFlags.modules) {
+        if (!moduleManager.getModules().contains(moduleName)) {
+            LOG_ERR("Couldn't find the module '" << moduleName << "', skipping...");
+        }
+    }
+    moduleManager.runInits();
+
+    fs::path destinationRoot = getUserHome();
+    ApplyPlan plan(moduleManager, destinationRoot, getDestinationFilter(modulesAndFlags));
+
+    const mode_t currentUmask = getUmask();
+    #ifndef _NCOLOR
+    bool color = logger::getFormat() == logger::Format::Text && isatty(STDOUT_FILENO);
+    #else
+    bool color = false;
+    #endif
+
+    const std::vector<PlanOperation>& operations = plan.getOperations();
+    std::vector<std::string> diffs(operations.size());
+    parallelFor(operations.size(), [&](size_t i) {
+        diffs[i] = getOperationDiff(operations[i], destinationRoot, currentUmask, color);
+    });
+
+    size_t changedFiles = 0;
+    for (size_t i = 0; i < diffs.size(); ++i) {
+        if (diffs[i].empty()) continue;
+        changedFiles++;
+        diffs[i].pop_back();
+        LOG_CUSTOM(operations[i].owner, (destinationRoot / operations[i].destination).c_str());
+        LOG(diffs[i]);
+    }
+
+    LOG_INFO(changedFiles << " of " << operations.size() << " files would change");
+    return EXIT_SUCCESS;
+}
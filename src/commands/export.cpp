@@ -0,0 +1,138 @@
+#include "commands.hpp"
+#include "logger.hpp"
+#include "src/bundle.hpp"
+#include "src/modules.hpp"
+#include "src/plan.hpp"
+#include "src/tar.hpp"
+#include "src/utils.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_set>
+
+using namespace rdm;
+
+static constexpr mode_t EXEC_PERMISSIONS = S_IXUSR | S_IXGRP | S_IXOTH;
+
+// Same content and modes apply would create, see executor.cpp
+static bool addOperation(TarWriter &tar, const PlanOperation &operation, mode_t umask) {
+    const std::string path = operation.destination.string();
+    const mode_t exec = operation.executable ? EXEC_PERMISSIONS : 0;
+
+    if (operation.type == OperationType::WriteText) {
+        return tar.addFile(path, operation.mode.value_or((0666 | exec) & ~umask), operation.data->getContent());
+    }
+
+    Bundle* bundle = Bundle::getActive();
+    if (bundle != nullptr && bundle->contains(operation.source)) {
+        const BundleEntry* entry = bundle->find(operation.source);
+        if (entry == nullptr) return false;
+        if (entry->type == BundleEntryType::Symlink) return tar.addSymlink(path, std::string(bundle->getData(*entry)));
+        return tar.addFile(path, operation.mode.value_or(((entry->mode & 07777) | exec) & ~umask), bundle->getData(*entry));
+    }
+
+    struct stat info;
+    if (lstat(operation.source.c_str(), &info) != 0) return false;
+    if (S_ISLNK(info.st_mode)) {
+        std::error_code error;
+        fs::path target = fs::read_symlink(operation.source, error);
+        return !error && tar.addSymlink(path, target.string());
+    }
+
+    int fd = open(operation.source.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool success = tar.addFile(path, operation.mode.value_or(((info.st_mode & 07777) | exec) & ~umask), fd, info.st_size);
+    close(fd);
+    return success;
+}
+
+int rdm::commands::exportFiles(Command, int argc, char **argv) {
+    auto modulesAndFlags = parseModulesAndFlags(argv + 2, argc - 2);
+
+    std::string output = getOptionValue(modulesAndFlags, Option::OUTPUT);
+    bool toStdout = output.empty() || output == "-";
+    if (toStdout && isatty(STDOUT_FILENO)) {
+        LOG_ERR("Refusing to write a tar archive to a terminal, use '-o <file>' or redirect the output");
+        return EXIT_FAILURE;
+    }
+
+    int outputFd;
+    if (toStdout) {
+        // The archive keeps the real stdout, anything else printed (logs, spawned scripts) goes to stderr
+        LOG_FLUSH();
+        outputFd = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 3);
+        if (outputFd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+            LOG_ERR("Couldn't set up the output stream: " << std::strerror(errno));
+            return EXIT_FAILURE;
+        }
+    } else {
+        outputFd = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (outputFd < 0) {
+            LOG_ERR("Couldn't open " << output << " for writing: " << std::strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::unique_ptr<Bundle> bundle;
+    if (!prepareModuleSource(modulesAndFlags, bundle)) return EXIT_FAILURE;
+
+    // Exporting must not change the local machine
+    modulesAndFlags.flags.insert("preview");
+
+    ModuleManager moduleManager = ModuleManager(getDataDir() / "home", getUserHome(), modulesAndFlags);
+    for (auto& moduleName : modulesAndFlags.modules) {
+        if (!moduleManager.getModules().contains(moduleName)) {
+            LOG_ERR("Couldn't find the module '" << moduleName << "', skipping...");
+        }
+    }
+    moduleManager.runInits();
+    ApplyPlan plan(moduleManager, getUserHome(), getDestinationFilter(modulesAndFlags));
+
+    // An archive without the files of a failed module would look complete
+    if (!plan.getFailedModules().empty()) {
+        LOG_ERR("Not exporting, " << plan.getFailedModules().size() << " modules failed to return their files");
+        close(outputFd);
+        if (!toStdout) unlink(output.c_str());
+        return EXIT_FAILURE;
+    }
+
+    const mode_t currentUmask = getUmask();
+
+    // SOURCE_DATE_EPOCH makes the archive reproducible
+    time_t mtime = std::time(nullptr);
+    if (const char* sourceDateEpoch = std::getenv("SOURCE_DATE_EPOCH")) mtime = std::strtoll(sourceDateEpoch, nullptr, 10);
+
+    TarWriter tar(outputFd, mtime);
+    std::unordered_set<std::string> directories;
+    size_t exportedFiles = 0;
+    bool success = true;
+    for (auto& operation : plan.getOperations()) {
+        // Operations are sorted by directory, parents are added before their first file
+        fs::path directory;
+        for (auto& component : operation.destination.parent_path()) {
+            directory /= component;
+            if (!directories.insert(directory.string()).second) continue;
+            // Like the executor, the directories of a Directory() with a :mode() get its directory mode
+            fs::path relative = directory.lexically_relative(operation.directoryModeRoot);
+            bool hasMode = operation.directoryMode.has_value() && !relative.empty() && *relative.begin() != "..";
+            success = tar.addDirectory(directory.string(), hasMode ? *operation.directoryMode : 0777 & ~currentUmask) && success;
+        }
+
+        if (addOperation(tar, operation, currentUmask)) {
+            exportedFiles++;
+        } else {
+            LOG_CUSTOM_ERR(operation.owner, "Couldn't export " << operation.destination << ": " << std::strerror(errno));
+            success = false;
+        }
+    }
+
+    success = tar.finish() && success;
+    close(outputFd);
+
+    LOG_INFO("Exported " << exportedFiles << " files from " << plan.getModules().size() << " modules to " << (toStdout ? "stdout" : output));
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
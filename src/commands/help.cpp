@@ -13,12 +13,18 @@ int rdm::commands::help(Command, int argc, char **argv) {
             { "apply-safe", menus::printApplyHelp   },
             { "apply-soft", menus::printApplyHelp   },
             { "clone",      menus::printCloneHelp   },
+            { "complete",   menus::printCompleteHelp },
+            { "diff",       menus::printDiffHelp    },
             { "dir",        menus::printDirHelp     },
+            { "export",     menus::printExportHelp  },
             { "help",       menus::printHelpHelp    },
             { "init",       menus::printInitHelp    },
             { "list",       menus::printListHelp    },
+            { "pack",       menus::printPackHelp    },
             { "preview",    menus::printPreviewHelp },
+            { "remove",     menus::printRemoveHelp  },
             { "restore",    menus::printRestoreHelp },
+            { "status",     menus::printStatusHelp  },
         };
 
         std::string page = argv[2];
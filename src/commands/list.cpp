@@ -1,27 +1,28 @@
 #include "commands.hpp"
 #include "logger.hpp"
+#include "src/moduleindex.hpp"
 #include "src/modules.hpp"
 #include <algorithm>
 #include <cstdlib>
 
 int rdm::commands::list(Command, int, char *[]) {
-    const auto availableModules = ModuleManager::getAvailableModules(RDM_DATA_DIR / "home");
+    std::vector<fs::path> directories;
+    const auto availableModules = ModuleManager::getAvailableModules(getDataDir() / "home", &directories);
+    // The walk is already done, so the completion index is refreshed for free, it is sorted by name
+    const auto index = updateModuleIndex(getDataDir() / "home", availableModules, directories);
     if (availableModules.empty()) {
-        LOG("No rdm modules found in " << RDM_DATA_DIR / "home");
+        LOG("No rdm modules found in " << getDataDir() / "home");
         return EXIT_SUCCESS;
     } else {
         LOG("Available modules:");
     }
-    
-    std::vector<std::string> orderedModules;
-    orderedModules.reserve(availableModules.size());
-    for (auto& [name, path] : availableModules) {
-        orderedModules.push_back(name);
-    }
 
-    std::sort(orderedModules.begin(), orderedModules.end());
-    for (auto& name : orderedModules) {
-        LOG(" - " << name);
+    for (auto& entry : index) {
+        if (entry.description.empty()) {
+            LOG(" - " << entry.name);
+        } else {
+            LOG(" - " << entry.name << ": " << entry.description);
+        }
     }
 
     return EXIT_SUCCESS;
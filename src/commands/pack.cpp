@@ -0,0 +1,26 @@
+#include "commands.hpp"
+#include "logger.hpp"
+#include "src/bundle.hpp"
+#include "src/utils.hpp"
+#include <cstdlib>
+
+int rdm::commands::pack(Command, int argc, char **argv) {
+    fs::path homeDir = getDataDir() / "home";
+    if (!fs::exists(homeDir) || fs::is_empty(homeDir)) {
+        LOG_ERR("RDM home dir is empty or doesn't exist, nothing to pack");
+        return EXIT_FAILURE;
+    }
+
+    auto modulesAndFlags = parseModulesAndFlags(argv + 2, argc - 2);
+    fs::path output = getOptionValue(modulesAndFlags, Option::OUTPUT);
+    if (output.empty()) output = "rdm" + Bundle::EXTENSION;
+
+    LOG_INFO("Packing " << homeDir.c_str() << " into " << output.c_str() << "...");
+    if (!Bundle::pack(homeDir, output)) {
+        LOG_ERR("Couldn't create bundle " << output);
+        return EXIT_FAILURE;
+    }
+
+    LOG_INFO("Done! Apply it with 'rdm apply --bundle " << output.c_str() << "'");
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,56 @@
+#include "commands.hpp"
+#include "logger.hpp"
+#include "src/executor.hpp"
+#include "src/ownership.hpp"
+#include "src/utils.hpp"
+#include <cstdlib>
+#include <unordered_map>
+#include <unordered_set>
+
+int rdm::commands::remove(Command, int argc, char **argv) {
+    auto modulesAndFlags = parseModulesAndFlags(argv + 2, argc - 2);
+    if (modulesAndFlags.modules.empty()) {
+        LOG_ERR("No modules specified, use 'rdm remove <modules...>'");
+        return EXIT_FAILURE;
+    }
+
+    // Only the ownership manifest is read, the modules aren't loaded so a deleted module can still be removed
+    std::unordered_set<std::string> modules(modulesAndFlags.modules.begin(), modulesAndFlags.modules.end());
+    ExecutorOptions options;
+    options.verbose = modulesAndFlags.programFlags.contains(Flag::VERBOSE);
+
+    bool failed = false;
+    for (auto& destinationRoot : getDestinationRoots(modulesAndFlags)) {
+        Ownership ownership = loadOwnership(destinationRoot);
+        const size_t directoryCount = ownership.directories.size();
+        std::vector<OwnedFile> keptFiles;
+        std::unordered_map<std::string, int> removedFiles, leftFiles;
+        for (auto& owned : ownership.files) {
+            if (!modules.contains(owned.module)) {
+                keptFiles.push_back(std::move(owned));
+                continue;
+            }
+            RemoveResult result = removeOwnedFile(destinationRoot, owned, ownership.directories, options);
+            if (result == RemoveResult::Deleted) removedFiles[owned.module]++;
+            // Modified files are no longer rdm's, they are left in place and forgotten
+            if (result == RemoveResult::Modified || result == RemoveResult::Failed) {
+                leftFiles[owned.module]++;
+                failed = true;
+            }
+            if (result == RemoveResult::Failed) keptFiles.push_back(std::move(owned));
+        }
+
+        for (auto& module : modulesAndFlags.modules) {
+            if (!removedFiles.contains(module) && !leftFiles.contains(module)) {
+                LOG_INFO("The module '" << module << "' owns no files in " << destinationRoot);
+                continue;
+            }
+            LOG_CUSTOM_INFO(module, "Removed " << removedFiles[module] << " files from " << destinationRoot);
+            if (leftFiles.contains(module)) LOG_CUSTOM_WARN(module, "Left " << leftFiles.at(module) << " files in " << destinationRoot << " that were modified or couldn't be deleted");
+        }
+        bool changed = keptFiles.size() != ownership.files.size() || ownership.directories.size() != directoryCount;
+        ownership.files = std::move(keptFiles);
+        if (changed && !saveOwnership(destinationRoot, ownership)) failed = true;
+    }
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,59 @@
+#include "commands.hpp"
+#include "logger.hpp"
+#include "src/modules.hpp"
+#include "src/plan.hpp"
+#include "src/status.hpp"
+#include "src/utils.hpp"
+#include <cstdlib>
+#include <iomanip>
+
+int rdm::commands::status(Command, int argc, char **argv) {
+    auto modulesAndFlags = parseModulesAndFlags(argv + 2, argc - 2);
+    bool verbose = modulesAndFlags.programFlags.contains(Flag::VERBOSE);
+
+    std::unique_ptr<Bundle> bundle;
+    if (!prepareModuleSource(modulesAndFlags, bundle)) return EXIT_FAILURE;
+
+    // Modules must not have side effects while checking the state
+    modulesAndFlags.flags.insert("preview");
+
+    ModuleManager moduleManager = ModuleManager(getDataDir() / "home", getUserHome(), modulesAndFlags);
+    for (auto& moduleName : modulesAndFlags.modules) {
+        if (!moduleManager.getModules().contains(moduleName)) {
+            LOG_ERR("Couldn't find the module '" << moduleName << "', skipping...");
+        }
+    }
+    moduleManager.runInits();
+
+    fs::path destinationRoot = getUserHome();
+    ApplyPlan plan(moduleManager, destinationRoot, getDestinationFilter(modulesAndFlags));
+
+    size_t counts[4] = {};
+    for (auto& status : getPlanStatus(plan, destinationRoot)) {
+        counts[static_cast<size_t>(status.state)]++;
+        if (status.state == FileState::InSync && !verbose) continue;
+        LOG(std::left << std::setw(14) << getFileStateName(status.state) << (destinationRoot / status.operation->destination).c_str() << " (" << status.operation->owner << ")");
+    }
+
+    // The files of a failed module are unknown and a conflict means one module's file is never applied, neither is in sync
+    for (auto& moduleName : plan.getFailedModules()) {
+        LOG(std::left << std::setw(14) << "failed" << "(" << moduleName << ")");
+    }
+    for (auto& conflict : plan.getConflicts()) {
+        LOG(std::left << std::setw(14) << "conflict" << (destinationRoot / conflict.destination).c_str() << " (" << conflict.owners.front() << ")");
+    }
+    size_t problems = plan.getFailedModules().size() + plan.getConflicts().size();
+
+    size_t drifted = counts[static_cast<size_t>(FileState::Missing)] + counts[static_cast<size_t>(FileState::Modified)] + counts[static_cast<size_t>(FileState::ModeChanged)];
+    if (drifted == 0 && problems == 0) {
+        LOG_INFO("All " << plan.getOperations().size() << " files are in sync");
+        return EXIT_SUCCESS;
+    }
+
+    LOG_INFO(drifted << " of " << plan.getOperations().size() << " files out of sync: "
+        << counts[static_cast<size_t>(FileState::Missing)] << " missing, "
+        << counts[static_cast<size_t>(FileState::Modified)] << " modified, "
+        << counts[static_cast<size_t>(FileState::ModeChanged)] << " with a different mode");
+    if (problems > 0) LOG_INFO(plan.getFailedModules().size() << " modules failed to plan their files and " << plan.getConflicts().size() << " destinations are claimed by several modules");
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,82 @@
+#include "context.hpp"
+#include <utility>
+#include "logger.hpp"
+
+namespace rdm {
+    // The active bundle is per thread, it is only set while the context is doing something
+    class ActiveBundleScope {
+        public:
+        explicit ActiveBundleScope(Bundle* bundle) : m_previous(Bundle::getActive()) { Bundle::setActive(bundle); }
+        ActiveBundleScope(const ActiveBundleScope&) = delete;
+        ActiveBundleScope& operator=(const ActiveBundleScope&) = delete;
+        ~ActiveBundleScope() { Bundle::setActive(m_previous); }
+
+        private:
+        Bundle* m_previous;
+    };
+
+    Context::Context(ContextOptions options)
+    : m_options(std::move(options)) {}
+
+    bool Context::load() {
+        if (m_moduleManager != nullptr) return true;
+
+        std::string bundlePath = getOptionValue(m_options.modulesAndFlags, Option::BUNDLE);
+        if (!bundlePath.empty()) {
+            m_bundle = std::make_unique<Bundle>(bundlePath, m_options.root);
+            if (!m_bundle->isOpen()) {
+                LOG_ERR(m_bundle->getErrorString());
+                m_bundle.reset();
+                return false;
+            }
+        } else if (!fs::is_directory(m_options.root)) {
+            LOG_ERR("The module directory " << m_options.root << " doesn't exist");
+            return false;
+        }
+
+        ActiveBundleScope scope(m_bundle.get());
+        m_moduleManager = std::make_unique<ModuleManager>(m_options.root, m_options.destinationRoot, m_options.modulesAndFlags);
+        for (auto& moduleName : m_options.modulesAndFlags.modules) {
+            if (!m_moduleManager->getModules().contains(moduleName)) {
+                LOG_ERR("Couldn't find the module '" << moduleName << "', skipping...");
+            }
+        }
+        m_moduleManager->runInits();
+        return true;
+    }
+
+    const ApplyPlan* Context::plan() {
+        if (m_plan == nullptr) {
+            if (!load()) return nullptr;
+            ActiveBundleScope scope(m_bundle.get());
+            m_plan = std::make_unique<ApplyPlan>(*m_moduleManager, m_options.destinationRoot, getDestinationFilter(m_options.modulesAndFlags));
+        }
+        return m_plan.get();
+    }
+
+    std::optional<ExecutionReport> Context::apply(const fs::path &destinationRoot, const ExecutorOptions &options) {
+        const ApplyPlan* applyPlan = plan();
+        if (applyPlan == nullptr) return std::optional<ExecutionReport>();
+
+        ActiveBundleScope scope(m_bundle.get());
+        ExecutionReport report = executePlan(*applyPlan, destinationRoot, options);
+        m_moduleManager->runDelayeds();
+        return std::optional<ExecutionReport>(std::move(report));
+    }
+
+    std::optional<std::vector<FileStatus>> Context::status(const fs::path &destinationRoot) {
+        const ApplyPlan* applyPlan = plan();
+        if (applyPlan == nullptr) return std::optional<std::vector<FileStatus>>();
+
+        ActiveBundleScope scope(m_bundle.get());
+        return std::optional<std::vector<FileStatus>>(getPlanStatus(*applyPlan, destinationRoot));
+    }
+
+    const ContextOptions& Context::getOptions() const {
+        return m_options;
+    }
+
+    ModuleManager* Context::getModuleManager() {
+        return m_moduleManager.get();
+    }
+}
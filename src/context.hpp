@@ -0,0 +1,52 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <vector>
+#include "bundle.hpp"
+#include "executor.hpp"
+#include "modules.hpp"
+#include "plan.hpp"
+#include "status.hpp"
+#include "utils.hpp"
+
+namespace fs = std::filesystem;
+
+namespace rdm {
+    struct ContextOptions {
+        // Directory with the modules, also the root of the bundle when --bundle is given
+        fs::path root;
+        // The home the modules are evaluated for, plans are relative to it
+        fs::path destinationRoot;
+        // Same as the command line: modules, flags and options like --bundle or --lua-budget
+        ModulesAndFlags modulesAndFlags;
+    };
+
+    // One profile evaluated in process, the embedding API of librdm
+    // Contexts don't share any state so they can run on different threads, a single context is used by one thread at a time
+    class Context {
+        public:
+        explicit Context(ContextOptions options);
+        Context(const Context&) = delete;
+        Context& operator=(const Context&) = delete;
+
+        // Loads the requested modules (and the ones they add) and runs RDM_Init
+        bool load();
+        // Runs RDM_GetFiles once, loading the modules first if needed
+        const ApplyPlan* plan();
+        // Writes the plan to destinationRoot and then runs RDM_Delayed
+        std::optional<ExecutionReport> apply(const fs::path &destinationRoot, const ExecutorOptions &options);
+        std::optional<std::vector<FileStatus>> status(const fs::path &destinationRoot);
+
+        const ContextOptions& getOptions() const;
+        ModuleManager* getModuleManager();
+
+        private:
+        ContextOptions m_options;
+        // Declared first, the modules and the plan are destroyed before it
+        std::unique_ptr<Bundle> m_bundle;
+        std::unique_ptr<ModuleManager> m_moduleManager;
+        std::unique_ptr<ApplyPlan> m_plan;
+    };
+}
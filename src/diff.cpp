@@ -0,0 +1,234 @@
+#include "diff.hpp"
+#include <algorithm>
+#include <climits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace rdm {
+    static constexpr size_t BINARY_SNIFF_SIZE = 8000;
+
+    // Linear space variant of Myers' O(ND) algorithm, finds the middle snake of each range and recurses on both halves
+    class MyersDiff {
+        public:
+        MyersDiff(const std::vector<int> &a, const std::vector<int> &b)
+        : m_a(a), m_b(b), m_offset(b.size() + 1), m_forward(a.size() + b.size() + 3), m_backward(a.size() + b.size() + 3)
+        , m_deleted(a.size(), false), m_added(b.size(), false) {
+            compare(0, a.size(), 0, b.size());
+        }
+
+        const std::vector<bool>& getDeleted() const { return m_deleted; }
+        const std::vector<bool>& getAdded() const { return m_added; }
+
+        private:
+        void compare(int aLow, int aHigh, int bLow, int bHigh) {
+            // Common prefixes and suffixes never need the expensive search
+            while (aLow < aHigh && bLow < bHigh && m_a[aLow] == m_b[bLow]) {
+                aLow++;
+                bLow++;
+            }
+            while (aLow < aHigh && bLow < bHigh && m_a[aHigh - 1] == m_b[bHigh - 1]) {
+                aHigh--;
+                bHigh--;
+            }
+
+            if (aLow == aHigh) {
+                for (int i = bLow; i < bHigh; ++i) m_added[i] = true;
+            } else if (bLow == bHigh) {
+                for (int i = aLow; i < aHigh; ++i) m_deleted[i] = true;
+            } else {
+                auto [x, y] = findMiddleSnake(aLow, aHigh, bLow, bHigh);
+                compare(aLow, x, bLow, y);
+                compare(x, aHigh, y, bHigh);
+            }
+        }
+
+        int& forward(int diagonal) { return m_forward[diagonal + m_offset]; }
+        int& backward(int diagonal) { return m_backward[diagonal + m_offset]; }
+
+        std::pair<int, int> findMiddleSnake(int aLow, int aHigh, int bLow, int bHigh) {
+            const int minDiagonal = aLow - bHigh;
+            const int maxDiagonal = aHigh - bLow;
+            const int forwardMid = aLow - bLow;
+            const int backwardMid = aHigh - bHigh;
+            const bool odd = (forwardMid - backwardMid) & 1;
+
+            int forwardMin = forwardMid, forwardMax = forwardMid;
+            int backwardMin = backwardMid, backwardMax = backwardMid;
+            forward(forwardMid) = aLow;
+            backward(backwardMid) = aHigh;
+
+            while (true) {
+                if (forwardMin > minDiagonal) {
+                    forward(--forwardMin - 1) = -1;
+                } else {
+                    ++forwardMin;
+                }
+                if (forwardMax < maxDiagonal) {
+                    forward(++forwardMax + 1) = -1;
+                } else {
+                    --forwardMax;
+                }
+
+                for (int diagonal = forwardMax; diagonal >= forwardMin; diagonal -= 2) {
+                    int low = forward(diagonal - 1);
+                    int high = forward(diagonal + 1);
+                    int x = low >= high ? low + 1 : high;
+                    int y = x - diagonal;
+                    while (x < aHigh && y < bHigh && m_a[x] == m_b[y]) {
+                        x++;
+                        y++;
+                    }
+                    forward(diagonal) = x;
+                    if (odd && backwardMin <= diagonal && diagonal <= backwardMax && backward(diagonal) <= x) return { x, y };
+                }
+
+                if (backwardMin > minDiagonal) {
+                    backward(--backwardMin - 1) = INT_MAX;
+                } else {
+                    ++backwardMin;
+                }
+                if (backwardMax < maxDiagonal) {
+                    backward(++backwardMax + 1) = INT_MAX;
+                } else {
+                    --backwardMax;
+                }
+
+                for (int diagonal = backwardMax; diagonal >= backwardMin; diagonal -= 2) {
+                    int low = backward(diagonal - 1);
+                    int high = backward(diagonal + 1);
+                    int x = low < high ? low : high - 1;
+                    int y = x - diagonal;
+                    while (x > aLow && y > bLow && m_a[x - 1] == m_b[y - 1]) {
+                        x--;
+                        y--;
+                    }
+                    backward(diagonal) = x;
+                    if (!odd && forwardMin <= diagonal && diagonal <= forwardMax && x <= forward(diagonal)) return { x, y };
+                }
+            }
+        }
+
+        const std::vector<int>& m_a;
+        const std::vector<int>& m_b;
+        const int m_offset;
+        std::vector<int> m_forward;
+        std::vector<int> m_backward;
+        std::vector<bool> m_deleted;
+        std::vector<bool> m_added;
+    };
+
+    // Lines keep their '\n' so a missing newline at the end of the file counts as a change
+    static std::vector<std::string_view> splitLines(std::string_view text) {
+        std::vector<std::string_view> lines;
+        size_t start = 0;
+        while (start < text.size()) {
+            size_t end = text.find('\n', start);
+            end = end == std::string_view::npos ? text.size() : end + 1;
+            lines.push_back(text.substr(start, end - start));
+            start = end;
+        }
+        return lines;
+    }
+
+    struct Edit {
+        char type;
+        int oldLine;
+        int newLine;
+    };
+
+    static void appendLine(std::string &out, char prefix, std::string_view line, bool color) {
+        const char* start = "";
+        if (color && prefix == '-') start = "\033[31m";
+        if (color && prefix == '+') start = "\033[32m";
+        out.append(start).push_back(prefix);
+        if (line.ends_with('\n')) {
+            out.append(line.substr(0, line.size() - 1));
+            if (*start != '\0') out.append("\033[m");
+            out.push_back('\n');
+        } else {
+            out.append(line);
+            if (*start != '\0') out.append("\033[m");
+            out.append("\n\\ No newline at end of file\n");
+        }
+    }
+
+    // A range of a single line omits its length, like diff and git do
+    static std::string formatRange(int start, int length) {
+        if (length == 1) return std::to_string(start);
+        return std::to_string(start) + "," + std::to_string(length);
+    }
+
+    std::string getUnifiedDiff(std::string_view oldText, std::string_view newText, const std::string &oldLabel, const std::string &newLabel, bool color, size_t context) {
+        if (oldText == newText) return std::string();
+
+        std::vector<std::string_view> oldLines = splitLines(oldText);
+        std::vector<std::string_view> newLines = splitLines(newText);
+
+        // Lines are compared as integers during the search
+        std::unordered_map<std::string_view, int> lineIds;
+        std::vector<int> oldIds, newIds;
+        oldIds.reserve(oldLines.size());
+        newIds.reserve(newLines.size());
+        for (auto line : oldLines) oldIds.push_back(lineIds.emplace(line, lineIds.size()).first->second);
+        for (auto line : newLines) newIds.push_back(lineIds.emplace(line, lineIds.size()).first->second);
+
+        MyersDiff diff(oldIds, newIds);
+        const std::vector<bool>& deleted = diff.getDeleted();
+        const std::vector<bool>& added = diff.getAdded();
+
+        std::vector<Edit> script;
+        script.reserve(std::max(oldLines.size(), newLines.size()));
+        std::vector<size_t> changes;
+        int i = 0, j = 0;
+        const int oldCount = oldLines.size(), newCount = newLines.size();
+        while (i < oldCount || j < newCount) {
+            if (i < oldCount && deleted[i]) {
+                changes.push_back(script.size());
+                script.push_back({ '-', i++, j });
+            } else if (j < newCount && added[j]) {
+                changes.push_back(script.size());
+                script.push_back({ '+', i, j++ });
+            } else {
+                script.push_back({ ' ', i++, j++ });
+            }
+        }
+
+        std::string out;
+        out.append(color ? "\033[1m--- " : "--- ").append(oldLabel).append("\n+++ ").append(newLabel).append(color ? "\033[m\n" : "\n");
+
+        for (size_t change = 0; change < changes.size();) {
+            size_t first = changes[change];
+            size_t last = first;
+            // Changes closer than two contexts share a hunk
+            while (change + 1 < changes.size() && changes[change + 1] - last <= 2 * context + 1) last = changes[++change];
+            change++;
+
+            size_t start = first > context ? first - context : 0;
+            size_t end = std::min(script.size(), last + context + 1);
+
+            int hunkOld = 0, hunkNew = 0;
+            for (size_t k = start; k < end; ++k) {
+                if (script[k].type != '+') hunkOld++;
+                if (script[k].type != '-') hunkNew++;
+            }
+            int oldStart = script[start].oldLine + (hunkOld > 0 ? 1 : 0);
+            int newStart = script[start].newLine + (hunkNew > 0 ? 1 : 0);
+
+            if (color) out.append("\033[36m");
+            out.append("@@ -").append(formatRange(oldStart, hunkOld)).append(" +").append(formatRange(newStart, hunkNew)).append(" @@");
+            out.append(color ? "\033[m\n" : "\n");
+
+            for (size_t k = start; k < end; ++k) {
+                const Edit& edit = script[k];
+                appendLine(out, edit.type, edit.type == '+' ? newLines[edit.newLine] : oldLines[edit.oldLine], color);
+            }
+        }
+
+        return out;
+    }
+
+    bool isBinary(std::string_view data) {
+        return data.substr(0, BINARY_SNIFF_SIZE).find('\0') != std::string_view::npos;
+    }
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace rdm {
+    // Unified diff (as in diff -u) between two texts, empty if they are equal
+    std::string getUnifiedDiff(std::string_view oldText, std::string_view newText, const std::string &oldLabel, const std::string &newLabel, bool color, size_t context = 3);
+    // Same heuristic as git, a NUL byte near the start means the content isn't text
+    bool isBinary(std::string_view data);
+}
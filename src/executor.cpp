@@ -0,0 +1,426 @@
+#include "executor.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include "bundle.hpp"
+#include "logger.hpp"
+#include "utils.hpp"
+
+#define LOG_CUSTOM_INFO_VERBOSE(name, x) if (options.verbose) LOG_CUSTOM_INFO(name, x);
+#define LOG_CUSTOM_WARN_VERBOSE(name, x) if (options.verbose) LOG_CUSTOM_WARN(name, x);
+
+namespace rdm {
+    // Large copies are synced and checkpointed after each chunk, a chunk is the most an interrupted apply has to copy again
+    static constexpr off_t LARGE_COPY_CHUNK = 64 << 20;
+    static constexpr auto PROGRESS_INTERVAL = std::chrono::seconds(1);
+    static constexpr int CHECKPOINT_VERSION = 1;
+
+    // The umask applies to the exec bits too, like for a file created with them
+    static bool addExecPermissions(int fd) {
+        struct stat info;
+        if (fstat(fd, &info) != 0) return false;
+        return fchmod(fd, (info.st_mode & 07777) | ((S_IXUSR | S_IXGRP | S_IXOTH) & ~getUmask())) == 0;
+    }
+
+    static bool copyData(int in, int out) {
+        // copy_file_range keeps the data in the kernel, fall back to read/write when it isn't supported
+        while (true) {
+            ssize_t copied = copy_file_range(in, nullptr, out, nullptr, 1 << 30, 0);
+            if (copied == 0) return true;
+            if (copied > 0) continue;
+            if (errno == EINTR) continue;
+            if (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP) break;
+            return false;
+        }
+
+        char buffer[64 * 1024];
+        while (true) {
+            ssize_t bytesRead = read(in, buffer, sizeof(buffer));
+            if (bytesRead == 0) return true;
+            if (bytesRead < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            if (!writeAll(out, buffer, bytesRead)) return false;
+        }
+    }
+
+    // An explicit mode is set on the new descriptor, the umask can't change it and the file is never more open than asked
+    static bool setCreatedMode(int fd, const PlanOperation &operation) {
+        if (operation.mode.has_value()) return fchmod(fd, *operation.mode) == 0;
+        return !operation.executable || addExecPermissions(fd);
+    }
+
+    // Copies [offset, offset + length) to the same offset of out
+    static bool copyRange(int in, int out, off_t offset, off_t length) {
+        while (length > 0) {
+            off_t inOffset = offset, outOffset = offset;
+            ssize_t copied = copy_file_range(in, &inOffset, out, &outOffset, length, 0);
+            if (copied > 0) {
+                offset += copied;
+                length -= copied;
+                continue;
+            }
+            if (copied < 0 && errno == EINTR) continue;
+            if (copied == 0 || (errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP)) return false;
+            break;
+        }
+
+        char buffer[64 * 1024];
+        while (length > 0) {
+            ssize_t bytesRead = pread(in, buffer, std::min<off_t>(length, sizeof(buffer)), offset);
+            if (bytesRead < 0 && errno == EINTR) continue;
+            if (bytesRead <= 0) return false;
+            for (ssize_t written = 0; written < bytesRead;) {
+                ssize_t result = pwrite(out, buffer + written, bytesRead - written, offset + written);
+                if (result < 0 && errno == EINTR) continue;
+                if (result < 0) return false;
+                written += result;
+            }
+            offset += bytesRead;
+            length -= bytesRead;
+        }
+        return true;
+    }
+
+    // A checkpoint is only valid for the same version of the source, its offset is where the copy resumes
+    static std::string formatCheckpoint(const struct stat &source, off_t offset) {
+        char checkpoint[128];
+        snprintf(checkpoint, sizeof(checkpoint), "rdm-checkpoint %d %" PRIdMAX " %" PRIdMAX " %ld %" PRIdMAX "\n", CHECKPOINT_VERSION,
+            static_cast<intmax_t>(source.st_size), static_cast<intmax_t>(source.st_mtim.tv_sec), source.st_mtim.tv_nsec, static_cast<intmax_t>(offset));
+        return checkpoint;
+    }
+
+    static off_t readCheckpoint(int dirfd, const std::string &checkpointName, const std::string &partialName, const struct stat &source) {
+        struct stat partial;
+        if (fstatat(dirfd, partialName.c_str(), &partial, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(partial.st_mode) || partial.st_size != source.st_size) return 0;
+
+        int fd = openat(dirfd, checkpointName.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return 0;
+        char checkpoint[128] = {};
+        ssize_t size = read(fd, checkpoint, sizeof(checkpoint) - 1);
+        close(fd);
+
+        intmax_t offset;
+        const char* offsetText = size > 0 ? std::strrchr(checkpoint, ' ') : nullptr;
+        if (offsetText == nullptr || std::sscanf(offsetText, " %" SCNdMAX, &offset) != 1) return 0;
+        if (formatCheckpoint(source, offset) != checkpoint || offset < 0 || offset > source.st_size) return 0;
+        return offset;
+    }
+
+    static bool writeCheckpoint(int dirfd, const std::string &checkpointName, const struct stat &source, off_t offset) {
+        std::string checkpoint = formatCheckpoint(source, offset);
+        int fd = openat(dirfd, checkpointName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (fd < 0) return false;
+        bool success = writeAll(fd, checkpoint.data(), checkpoint.size());
+        close(fd);
+        return success;
+    }
+
+    static uint64_t getBytesPerSecond(uint64_t bytes, std::chrono::steady_clock::duration elapsed) {
+        auto microseconds = std::max<int64_t>(1, std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+        return bytes * 1000000 / microseconds;
+    }
+
+    // Written to '.<name>.rdm-partial' and renamed once complete, only the data ranges of the source are copied so holes stay holes
+    static bool copyLargeFile(int in, const struct stat &source, int dirfd, const std::string &name, const PlanOperation &operation, const ExecutorOptions &options) {
+        const std::string& owner = operation.owner;
+        const std::string partialName = "." + name + ".rdm-partial";
+        const std::string checkpointName = "." + name + ".rdm-checkpoint";
+        off_t offset = readCheckpoint(dirfd, checkpointName, partialName, source);
+
+        // The partial file stays owner-writable so it can always be reopened, the final mode is only set before the rename
+        int out = openat(dirfd, partialName.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (offset == 0 ? O_TRUNC : 0), 0600);
+        if (out < 0) return false;
+        if (offset > 0) LOG_CUSTOM_INFO(owner, "Resuming the copy of " << name << " at " << (offset >> 20) << " MiB");
+
+        // Sizing the file first leaves every range that is never written as a hole
+        bool success = offset > 0 || ftruncate(out, source.st_size) == 0;
+        uint64_t copiedBytes = 0;
+        const auto start = std::chrono::steady_clock::now();
+        auto lastProgress = start;
+        while (success && offset < source.st_size) {
+            off_t dataStart = lseek(in, offset, SEEK_DATA);
+            if (dataStart < 0 && errno == ENXIO) break; // Only a hole is left
+            if (dataStart < 0) dataStart = offset; // No SEEK_DATA on this filesystem, copy everything
+            off_t dataEnd = lseek(in, dataStart, SEEK_HOLE);
+            if (dataEnd < 0) dataEnd = source.st_size;
+
+            off_t chunkEnd = std::min(dataEnd, dataStart + LARGE_COPY_CHUNK);
+            success = copyRange(in, out, dataStart, chunkEnd - dataStart) && fdatasync(out) == 0;
+            if (!success) break;
+            copiedBytes += chunkEnd - dataStart;
+            offset = chunkEnd;
+            // A failed checkpoint only costs the progress since the last one
+            writeCheckpoint(dirfd, checkpointName, source, offset);
+
+            auto now = std::chrono::steady_clock::now();
+            if (options.verbose && now - lastProgress >= PROGRESS_INTERVAL) {
+                lastProgress = now;
+                LOG_CUSTOM_INFO(owner, "Copying " << name << ": " << (offset >> 20) << "/" << (source.st_size >> 20) << " MiB, "
+                    << (getBytesPerSecond(copiedBytes, now - start) >> 20) << " MiB/s");
+            }
+        }
+
+        if (success && !operation.mode.has_value()) success = fchmod(out, source.st_mode & 07777 & ~getUmask()) == 0;
+        if (success) success = setCreatedMode(out, operation);
+        int error = errno;
+        close(out);
+        if (success) success = renameat(dirfd, partialName.c_str(), dirfd, name.c_str()) == 0;
+        if (success) {
+            unlinkat(dirfd, checkpointName.c_str(), 0);
+            LOG_CUSTOM_INFO_VERBOSE(owner, "Copied " << (copiedBytes >> 20) << " MiB of data into " << name << " at "
+                << (getBytesPerSecond(copiedBytes, std::chrono::steady_clock::now() - start) >> 20) << " MiB/s");
+        } else {
+            errno = error;
+        }
+        return success;
+    }
+
+    static bool writeText(const PlanOperation &operation, int dirfd, const std::string &name) {
+        const std::string& content = operation.data->getContent();
+        int fd = openat(dirfd, name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, operation.mode.value_or(0666));
+        if (fd < 0) return false;
+        bool success = setCreatedMode(fd, operation) && writeAll(fd, content.data(), content.size());
+        close(fd);
+        return success;
+    }
+
+    static bool copyFromBundle(const Bundle &bundle, const PlanOperation &operation, int dirfd, const std::string &name) {
+        const BundleEntry* entry = bundle.find(operation.source);
+        if (entry == nullptr) return false;
+
+        std::string_view data = bundle.getData(*entry);
+        if (entry->type == BundleEntryType::Symlink) {
+            return symlinkat(std::string(data).c_str(), dirfd, name.c_str()) == 0;
+        }
+
+        int fd = openat(dirfd, name.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, operation.mode.value_or(entry->mode & 07777));
+        if (fd < 0) return false;
+        bool success = setCreatedMode(fd, operation) && writeAll(fd, data.data(), data.size());
+        close(fd);
+        return success;
+    }
+
+    static bool copyFile(const PlanOperation &operation, int dirfd, const std::string &name, const ExecutorOptions &options) {
+        const fs::path& source = operation.source;
+        Bundle* bundle = Bundle::getActive();
+        if (bundle != nullptr && bundle->contains(source)) return copyFromBundle(*bundle, operation, dirfd, name);
+
+        struct stat info;
+        if (lstat(source.c_str(), &info) != 0) return false;
+
+        if (S_ISLNK(info.st_mode)) {
+            std::error_code error;
+            fs::path target = fs::read_symlink(source, error);
+            return !error && symlinkat(target.c_str(), dirfd, name.c_str()) == 0;
+        }
+
+        int in = open(source.c_str(), O_RDONLY | O_CLOEXEC);
+        if (in < 0) return false;
+        if (S_ISREG(info.st_mode) && static_cast<uint64_t>(info.st_size) >= options.largeFileSize) {
+            bool success = copyLargeFile(in, info, dirfd, name, operation, options);
+            int error = errno;
+            close(in);
+            errno = error;
+            return success;
+        }
+
+        int out = openat(dirfd, name.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, operation.mode.value_or(info.st_mode & 07777));
+        if (out < 0) {
+            close(in);
+            return false;
+        }
+
+        bool success = setCreatedMode(out, operation) && copyData(in, out);
+        close(in);
+        close(out);
+        return success;
+    }
+
+    static bool isLargeCopy(const PlanOperation &operation, const ExecutorOptions &options) {
+        if (operation.type != OperationType::CopyFile) return false;
+        Bundle* bundle = Bundle::getActive();
+        if (bundle != nullptr && bundle->contains(operation.source)) return false;
+        struct stat info;
+        return lstat(operation.source.c_str(), &info) == 0 && S_ISREG(info.st_mode) && static_cast<uint64_t>(info.st_size) >= options.largeFileSize;
+    }
+
+    void executeOperation(const PlanOperation &operation, int dirfd, const fs::path &destinationRoot, const ExecutorOptions &options, ExecutionStats &stats) {
+        const std::string& moduleName = operation.owner;
+        const fs::path file = destinationRoot / operation.destination;
+        const std::string name = operation.destination.filename();
+
+        struct stat info;
+        if (fstatat(dirfd, name.c_str(), &info, AT_SYMLINK_NOFOLLOW) == 0) {
+            if (options.replaceMode == ReplaceMode::Skip) {
+                stats.skippedFiles++;
+                LOG_CUSTOM_INFO_VERBOSE(moduleName, "Skipping " << file);
+                return;
+            }
+
+            if (S_ISDIR(info.st_mode)) {
+                stats.skippedFiles++;
+                LOG_CUSTOM_ERR(moduleName, "Tried to replace a directory with a file at " << file << ", skipping to prevent data loss!");
+                return;
+            }
+
+            if (options.replaceMode == ReplaceMode::Backup) {
+                LOG_CUSTOM_INFO_VERBOSE(moduleName, "Creating backup of " << file);
+                backupEntry(options.backupGroup, destinationRoot, file);
+                stats.savedFiles++;
+            }
+
+            LOG_CUSTOM_WARN_VERBOSE(moduleName, "Replacing " << file);
+            // Large copies rename over the old file once complete, an interrupted copy leaves it in place
+            if (!isLargeCopy(operation, options)) unlinkat(dirfd, name.c_str(), 0);
+        } else {
+            LOG_CUSTOM_INFO_VERBOSE(moduleName, "Creating " << file);
+        }
+
+        bool success = operation.type == OperationType::WriteText
+            ? writeText(operation, dirfd, name)
+            : copyFile(operation, dirfd, name, options);
+
+        if (!success) {
+            LOG_CUSTOM_ERR(moduleName, "Couldn't create " << file << ": " << std::strerror(errno));
+            return;
+        }
+
+        if (operation.executable) LOG_CUSTOM_INFO_VERBOSE(moduleName, "Made " << file << " executable");
+        stats.modifiedFiles++;
+        stats.writtenFiles.push_back(operation.destination);
+    }
+
+    int openDestinationDirectory(const fs::path &directory) {
+        std::error_code error;
+        fs::create_directories(directory, error);
+        return open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    }
+
+    // Existing directories are opened right away, the missing ones are only looked for when something has to be created
+    static int openDestinationDirectory(const fs::path &destinationRoot, const fs::path &directory, std::vector<fs::path>* createdDirectories) {
+        int fd = open((destinationRoot / directory).c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd >= 0 || createdDirectories == nullptr) return fd >= 0 ? fd : openDestinationDirectory(destinationRoot / directory);
+
+        std::vector<fs::path> missing;
+        fs::path current;
+        for (auto& component : directory) {
+            current /= component;
+            struct stat info;
+            if (!missing.empty() || lstat((destinationRoot / current).c_str(), &info) != 0) missing.push_back(current);
+        }
+        fd = openDestinationDirectory(destinationRoot / directory);
+        if (fd >= 0) createdDirectories->insert(createdDirectories->end(), missing.begin(), missing.end());
+        return fd;
+    }
+
+    // Directories at or under the root of a Directory() with a :mode() get that mode before anything is written into them
+    int openDestinationDirectory(const fs::path &destinationRoot, const PlanOperation &operation, std::vector<fs::path>* createdDirectories) {
+        const fs::path directory = operation.destination.parent_path();
+        if (!operation.directoryMode.has_value()) return openDestinationDirectory(destinationRoot, directory, createdDirectories);
+
+        const fs::path base = operation.directoryModeRoot.parent_path();
+        int fd = openDestinationDirectory(destinationRoot, base, createdDirectories);
+        fs::path current = base;
+        for (auto& component : directory.lexically_relative(base)) {
+            if (fd < 0) break;
+            if (component == ".") continue;
+            current /= component;
+            // Created closed and opened up with fchmod, so the umask doesn't apply either
+            bool created = mkdirat(fd, component.c_str(), 0700) == 0;
+            if (created && createdDirectories != nullptr) createdDirectories->push_back(current);
+            int next = openat(fd, component.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            close(fd);
+            fd = next;
+            if (created && fd >= 0 && fchmod(fd, *operation.directoryMode) != 0) {
+                close(fd);
+                fd = -1;
+            }
+        }
+        return fd;
+    }
+
+    ExecutionReport executePlanSync(const std::vector<const PlanOperation*> &operations, const fs::path &destinationRoot, const ExecutorOptions &options) {
+        ExecutionReport report;
+        int dirfd = -1;
+        fs::path currentDirectory;
+
+        for (const PlanOperation* operation : operations) {
+            ExecutionStats& stats = report[operation->owner];
+            stats.processedFiles++;
+            LOG_CUSTOM_DEBUG(operation->owner, "Processing: " << destinationRoot / operation->destination);
+
+            // Operations are sorted by directory, so each one is created and opened once
+            const fs::path directory = operation->destination.parent_path();
+            if (dirfd < 0 || directory != currentDirectory) {
+                if (dirfd >= 0) close(dirfd);
+                currentDirectory = directory;
+                dirfd = openDestinationDirectory(destinationRoot, *operation, &stats.createdDirectories);
+            }
+
+            if (dirfd < 0) {
+                stats.skippedFiles++;
+                LOG_CUSTOM_ERR(operation->owner, "Couldn't create the parent directory of " << destinationRoot / operation->destination << ", skipping...");
+                continue;
+            }
+
+            executeOperation(*operation, dirfd, destinationRoot, options, stats);
+        }
+
+        if (dirfd >= 0) close(dirfd);
+        return report;
+    }
+
+    static ExecutionReport executeSmallOperations(const std::vector<const PlanOperation*> &operations, const fs::path &destinationRoot, const ExecutorOptions &options) {
+        #ifdef RDM_IO_URING
+        // Backups need to copy the old file before it's replaced, which the batched path can't order
+        if (options.backend != IOBackend::Sync && options.replaceMode != ReplaceMode::Backup) {
+            ExecutionReport report;
+            if (executePlanUring(operations, destinationRoot, options, report)) return report;
+            if (options.backend == IOBackend::Uring) LOG_WARN("io_uring is not available on this system, falling back to synchronous I/O");
+        }
+        #else
+        if (options.backend == IOBackend::Uring) LOG_WARN("rdm was built without io_uring support, falling back to synchronous I/O");
+        #endif
+        return executePlanSync(operations, destinationRoot, options);
+    }
+
+    // Large copies start first on their own thread, so the longest copy runs alongside the small files instead of after them
+    ExecutionReport executePlan(const ApplyPlan &plan, const fs::path &destinationRoot, const ExecutorOptions &options) {
+        std::vector<const PlanOperation*> operations, largeCopies;
+        operations.reserve(plan.getOperations().size());
+        for (auto& operation : plan.getOperations()) {
+            (isLargeCopy(operation, options) ? largeCopies : operations).push_back(&operation);
+        }
+        if (largeCopies.empty()) return executeSmallOperations(operations, destinationRoot, options);
+
+        LOG_DEBUG("Copying " << largeCopies.size() << " large files ahead of the other " << operations.size() << " operations");
+        ExecutionReport largeReport;
+        Bundle* bundle = Bundle::getActive();
+        std::thread largeThread([&, bundle]() {
+            Bundle::setActive(bundle);
+            largeReport = executePlanSync(largeCopies, destinationRoot, options);
+        });
+        ExecutionReport report = executeSmallOperations(operations, destinationRoot, options);
+        largeThread.join();
+
+        for (auto& [module, largeStats] : largeReport) {
+            ExecutionStats& stats = report[module];
+            stats.processedFiles += largeStats.processedFiles;
+            stats.modifiedFiles += largeStats.modifiedFiles;
+            stats.skippedFiles += largeStats.skippedFiles;
+            stats.savedFiles += largeStats.savedFiles;
+            stats.writtenFiles.insert(stats.writtenFiles.end(), largeStats.writtenFiles.begin(), largeStats.writtenFiles.end());
+            stats.createdDirectories.insert(stats.createdDirectories.end(), largeStats.createdDirectories.begin(), largeStats.createdDirectories.end());
+        }
+        return report;
+    }
+}
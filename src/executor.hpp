@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "plan.hpp"
+
+namespace fs = std::filesystem;
+
+namespace rdm {
+    enum class ReplaceMode {
+        Replace,
+        Skip,
+        Backup
+    };
+
+    enum class IOBackend {
+        Auto,
+        Sync,
+        Uring
+    };
+
+    struct ExecutorOptions {
+        ReplaceMode replaceMode = ReplaceMode::Replace;
+        IOBackend backend = IOBackend::Auto;
+        std::string backupGroup = "home";
+        // Copies of at least this many bytes keep their holes, can resume after an interrupted apply and start ahead of the other files
+        uint64_t largeFileSize = 64ull << 20;
+        bool verbose = false;
+    };
+
+    struct ExecutionStats {
+        int processedFiles = 0;
+        int modifiedFiles = 0;
+        int skippedFiles = 0;
+        int savedFiles = 0;
+        int prunedFiles = 0;
+        // Destinations created or replaced, relative to the root
+        std::vector<fs::path> writtenFiles;
+        // Parent directories that didn't exist before, relative to the root
+        std::vector<fs::path> createdDirectories;
+    };
+
+    using ExecutionReport = std::unordered_map<std::string, ExecutionStats>;
+
+    ExecutionReport executePlan(const ApplyPlan &plan, const fs::path &destinationRoot, const ExecutorOptions &options);
+    ExecutionReport executePlanSync(const std::vector<const PlanOperation*> &operations, const fs::path &destinationRoot, const ExecutorOptions &options);
+    #ifdef RDM_IO_URING
+    bool executePlanUring(const std::vector<const PlanOperation*> &operations, const fs::path &destinationRoot, const ExecutorOptions &options, ExecutionReport &report);
+    #endif
+
+    // Shared by the executors
+    void executeOperation(const PlanOperation &operation, int dirfd, const fs::path &destinationRoot, const ExecutorOptions &options, ExecutionStats &stats);
+    int openDestinationDirectory(const fs::path &directory);
+    // The directories it had to create are added to createdDirectories when it isn't null
+    int openDestinationDirectory(const fs::path &destinationRoot, const PlanOperation &operation, std::vector<fs::path>* createdDirectories = nullptr);
+}
@@ -0,0 +1,235 @@
+#include "fscache.hpp"
+#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <iterator>
+#include <optional>
+#include <sys/stat.h>
+#include <unordered_map>
+#include "bundle.hpp"
+#include "glob.hpp"
+#include "utils.hpp"
+
+namespace rdm {
+    // Failed lookups are cached too, modules often probe for optional files
+    // Per thread, a module only runs on the thread of its context
+    static thread_local std::unordered_map<std::string, std::optional<std::vector<DirectoryEntry>>> s_directoryEntries;
+    static thread_local std::unordered_map<std::string, std::optional<EntryStat>> s_stats;
+    static thread_local std::unordered_map<std::string, bool> s_allowedPaths;
+
+    static EntryType getEntryType(mode_t mode) {
+        if (S_ISREG(mode)) return EntryType::File;
+        if (S_ISDIR(mode)) return EntryType::Directory;
+        if (S_ISLNK(mode)) return EntryType::Symlink;
+        return EntryType::Other;
+    }
+
+    static void sortEntries(std::vector<DirectoryEntry> &entries) {
+        std::sort(entries.begin(), entries.end(), [](const DirectoryEntry &a, const DirectoryEntry &b) {
+            return a.name < b.name;
+        });
+    }
+
+    static std::optional<std::vector<DirectoryEntry>> readBundleDirectory(const Bundle &bundle, const fs::path &dir) {
+        if (!bundle.exists(dir) || bundle.find(dir) != nullptr) return std::nullopt;
+
+        std::vector<DirectoryEntry> entries;
+        for (auto& file : bundle.getDirectoryFiles(dir)) {
+            fs::path relative = file.lexically_relative(dir);
+            std::string name = relative.begin()->string();
+            if (!entries.empty() && entries.back().name == name) continue;
+
+            // Files are sorted by path, so the children of a subdirectory come right after each other
+            if (std::next(relative.begin()) != relative.end()) {
+                entries.push_back({ name, EntryType::Directory });
+            } else {
+                const BundleEntry* entry = bundle.find(file);
+                entries.push_back({ name, entry != nullptr && entry->type == BundleEntryType::Symlink ? EntryType::Symlink : EntryType::File });
+            }
+        }
+        sortEntries(entries);
+        return entries;
+    }
+
+    static std::optional<std::vector<DirectoryEntry>> readDirectory(const fs::path &dir) {
+        DIR* stream = opendir(dir.c_str());
+        if (stream == nullptr) return std::nullopt;
+
+        std::vector<DirectoryEntry> entries;
+        while (dirent* entry = readdir(stream)) {
+            std::string_view name = entry->d_name;
+            if (name == "." || name == "..") continue;
+
+            EntryType type = EntryType::Other;
+            switch (entry->d_type) {
+                case DT_REG: type = EntryType::File; break;
+                case DT_DIR: type = EntryType::Directory; break;
+                case DT_LNK: type = EntryType::Symlink; break;
+                case DT_UNKNOWN: {
+                    // Some filesystems don't fill d_type
+                    struct stat info;
+                    if (fstatat(dirfd(stream), entry->d_name, &info, AT_SYMLINK_NOFOLLOW) == 0) type = getEntryType(info.st_mode);
+                    break;
+                }
+            }
+            entries.push_back({ std::string(name), type });
+        }
+        closedir(stream);
+        sortEntries(entries);
+        return entries;
+    }
+
+    const std::vector<DirectoryEntry>* getCachedDirectoryEntries(const fs::path &dir) {
+        std::string key = dir.lexically_normal().string();
+        auto cached = s_directoryEntries.find(key);
+        if (cached == s_directoryEntries.end()) {
+            Bundle* bundle = Bundle::getActive();
+            auto entries = bundle != nullptr && bundle->contains(key) ? readBundleDirectory(*bundle, key) : readDirectory(key);
+            cached = s_directoryEntries.emplace(key, std::move(entries)).first;
+        }
+        return cached->second.has_value() ? &cached->second.value() : nullptr;
+    }
+
+    const EntryStat* getCachedStat(const fs::path &path) {
+        std::string key = path.lexically_normal().string();
+        auto cached = s_stats.find(key);
+        if (cached == s_stats.end()) {
+            std::optional<EntryStat> result;
+            Bundle* bundle = Bundle::getActive();
+            if (bundle != nullptr && bundle->contains(key)) {
+                // Bundles don't store times, directories only exist as prefixes of their files
+                if (const BundleEntry* entry = bundle->find(key)) {
+                    EntryType type = entry->type == BundleEntryType::Symlink ? EntryType::Symlink : EntryType::File;
+                    result = EntryStat{ type, entry->size, static_cast<mode_t>(entry->mode & 07777), 0 };
+                } else if (bundle->exists(key)) {
+                    result = EntryStat{ EntryType::Directory, 0, 0755, 0 };
+                }
+            } else {
+                struct stat info;
+                if (lstat(key.c_str(), &info) == 0) {
+                    result = EntryStat{ getEntryType(info.st_mode), static_cast<uint64_t>(info.st_size), info.st_mode & 07777, info.st_mtime };
+                }
+            }
+            cached = s_stats.emplace(key, result).first;
+        }
+        return cached->second.has_value() ? &cached->second.value() : nullptr;
+    }
+
+    void clearDirectoryCache() {
+        s_directoryEntries.clear();
+        s_stats.clear();
+        s_allowedPaths.clear();
+    }
+
+    bool isCachedAllowedPath(const fs::path &base, const fs::path &path) {
+        std::string key = base.string() + '\0' + path.lexically_normal().string();
+        auto allowed = s_allowedPaths.find(key);
+        if (allowed == s_allowedPaths.end()) allowed = s_allowedPaths.emplace(key, isAllowedPath(base, path, false)).first;
+        return allowed->second;
+    }
+
+    static bool hasGlobCharacters(const std::string &component) {
+        return component.find_first_of("*?[\\") != std::string::npos;
+    }
+
+    static std::string joinRelative(const std::string &relative, const std::string &name) {
+        return relative.empty() ? name : relative + "/" + name;
+    }
+
+    class GlobWalker {
+        public:
+        GlobWalker(const fs::path &base, const std::vector<std::string> &components) : m_base(base), m_components(components) {
+            m_patterns.reserve(components.size());
+            for (auto& component : components) {
+                m_patterns.emplace_back(hasGlobCharacters(component) ? std::optional<GlobPattern>(GlobPattern(component)) : std::nullopt);
+            }
+        }
+
+        void walk(size_t index, const fs::path &dir, const std::string &relative) {
+            if (index == m_components.size()) {
+                if (!relative.empty()) m_matches.push_back(relative);
+                return;
+            }
+
+            const std::string& component = m_components[index];
+            const bool last = index + 1 == m_components.size();
+            if (component == "**") {
+                walk(index + 1, dir, relative);
+                // Symlinks are never followed here, so a link to a parent can't cause an endless walk
+                for (auto& entry : listDirectory(dir)) {
+                    if (entry.type == EntryType::Directory) {
+                        walk(index, dir / entry.name, joinRelative(relative, entry.name));
+                    } else if (last) {
+                        // A trailing '**' matches files too
+                        m_matches.push_back(joinRelative(relative, entry.name));
+                    }
+                }
+            } else if (!m_patterns[index].has_value()) {
+                if (!isCachedAllowedPath(m_base, dir)) return;
+                const EntryStat* info = getCachedStat(dir / component);
+                if (info != nullptr && (last || info->type == EntryType::Directory || info->type == EntryType::Symlink)) {
+                    walk(index + 1, dir / component, joinRelative(relative, component));
+                }
+            } else {
+                for (auto& entry : listDirectory(dir)) {
+                    if (!last && entry.type != EntryType::Directory && entry.type != EntryType::Symlink) continue;
+                    if (m_patterns[index]->matches(entry.name)) walk(index + 1, dir / entry.name, joinRelative(relative, entry.name));
+                }
+            }
+        }
+
+        std::vector<std::string>& getMatches() { return m_matches; }
+
+        private:
+        const std::vector<DirectoryEntry>& listDirectory(const fs::path &dir) {
+            static const std::vector<DirectoryEntry> empty;
+            // Directories reached through symlinks must still resolve inside the base
+            if (!isCachedAllowedPath(m_base, dir)) return empty;
+            const std::vector<DirectoryEntry>* entries = getCachedDirectoryEntries(dir);
+            return entries != nullptr ? *entries : empty;
+        }
+
+        const fs::path& m_base;
+        const std::vector<std::string>& m_components;
+        std::vector<std::optional<GlobPattern>> m_patterns;
+        std::vector<std::string> m_matches;
+    };
+
+    std::vector<std::string> globFiles(const fs::path &base, const std::string &pattern) {
+        std::vector<std::string> components;
+        size_t start = 0;
+        while (start <= pattern.size()) {
+            size_t end = std::min(pattern.find('/', start), pattern.size());
+            std::string component = pattern.substr(start, end - start);
+            // Globbing outside of the module is never allowed, '..' can't be part of a pattern
+            if (component == "..") return std::vector<std::string>();
+            if (!component.empty() && component != ".") components.push_back(std::move(component));
+            start = end + 1;
+        }
+        if (components.empty()) return std::vector<std::string>();
+
+        GlobWalker walker(base, components);
+        walker.walk(0, base, std::string());
+
+        std::vector<std::string>& matches = walker.getMatches();
+        // A trailing '/' only matches directories, like in a shell
+        if (pattern.ends_with('/')) {
+            std::erase_if(matches, [&](const std::string &match) {
+                const EntryStat* info = getCachedStat(base / match);
+                return info == nullptr || info->type != EntryType::Directory;
+            });
+        }
+        std::sort(matches.begin(), matches.end());
+        matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+        return std::move(matches);
+    }
+
+    const char* getEntryTypeName(EntryType type) {
+        switch (type) {
+            case EntryType::File: return "file";
+            case EntryType::Directory: return "directory";
+            case EntryType::Symlink: return "symlink";
+            default: return "other";
+        }
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace rdm {
+    enum class EntryType {
+        File,
+        Directory,
+        Symlink,
+        Other
+    };
+
+    struct DirectoryEntry {
+        std::string name;
+        EntryType type;
+    };
+
+    struct EntryStat {
+        EntryType type;
+        uint64_t size;
+        mode_t mode;
+        time_t mtime;
+    };
+
+    // Listings and stats of module sources are kept for the whole run (per thread), sources only change when a module spawns something
+    // Both return nullptr when the path doesn't exist (or isn't a directory), bundles are supported
+    const std::vector<DirectoryEntry>* getCachedDirectoryEntries(const fs::path &dir);
+    const EntryStat* getCachedStat(const fs::path &path);
+    void clearDirectoryCache();
+    // isAllowedPath without requiring the path to exist, remembered for the rest of the run
+    bool isCachedAllowedPath(const fs::path &base, const fs::path &path);
+
+    // Paths relative to base that match a '/' separated pattern, '**' matches any number of directories
+    // Only directories accepted by isCachedAllowedPath(base, ...) are listed
+    std::vector<std::string> globFiles(const fs::path &base, const std::string &pattern);
+
+    const char* getEntryTypeName(EntryType type);
+}
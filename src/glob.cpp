@@ -0,0 +1,318 @@
+#include "glob.hpp"
+#include <cctype>
+#include <fnmatch.h>
+
+namespace rdm {
+    static bool matchesNamedClass(const std::string &name, int c) {
+        if (name == "alpha") return std::isalpha(c);
+        if (name == "digit") return std::isdigit(c);
+        if (name == "alnum") return std::isalnum(c);
+        if (name == "upper") return std::isupper(c);
+        if (name == "lower") return std::islower(c);
+        if (name == "space") return std::isspace(c);
+        if (name == "blank") return std::isblank(c);
+        if (name == "punct") return std::ispunct(c);
+        if (name == "xdigit") return std::isxdigit(c);
+        if (name == "cntrl") return std::iscntrl(c);
+        if (name == "print") return std::isprint(c);
+        if (name == "graph") return std::isgraph(c);
+        return false;
+    }
+
+    GlobPattern::GlobPattern(const std::string &pattern) : m_pattern(pattern) {
+        if (!compile()) {
+            m_useFallback = true;
+            m_states.clear();
+            m_classes.clear();
+        }
+    }
+
+    const std::string& GlobPattern::getPattern() const {
+        return m_pattern;
+    }
+
+    bool GlobPattern::compile() {
+        if (m_pattern.find("!(") != std::string::npos) return false;
+
+        size_t pos = 0;
+        Fragment fragment;
+        if (!parseSequence(pos, false, fragment) || pos != m_pattern.size()) return false;
+
+        patch(fragment.outs, addState(StateType::Match));
+        m_start = fragment.start;
+        return true;
+    }
+
+    int GlobPattern::addState(StateType type, int out, int out1) {
+        m_states.push_back({ type, 0, -1, out, out1 });
+        return m_states.size() - 1;
+    }
+
+    void GlobPattern::patch(const std::vector<std::pair<int, int>> &outs, int target) {
+        for (auto& [state, slot] : outs) {
+            if (slot == 0) {
+                m_states.at(state).out = target;
+            } else {
+                m_states.at(state).out1 = target;
+            }
+        }
+    }
+
+    bool GlobPattern::parseAlternatives(size_t &pos, bool nested, Fragment &result) {
+        std::vector<Fragment> branches(1);
+        if (!parseSequence(pos, nested, branches.back())) return false;
+        while (pos < m_pattern.size() && m_pattern.at(pos) == '|') {
+            pos++;
+            branches.emplace_back();
+            if (!parseSequence(pos, nested, branches.back())) return false;
+        }
+
+        result = std::move(branches.back());
+        for (size_t i = branches.size() - 1; i-- > 0;) {
+            result.start = addState(StateType::Split, branches.at(i).start, result.start);
+            result.outs.insert(result.outs.end(), branches.at(i).outs.begin(), branches.at(i).outs.end());
+        }
+        return true;
+    }
+
+    bool GlobPattern::parseSequence(size_t &pos, bool nested, Fragment &result) {
+        const size_t size = m_pattern.size();
+        int start = addState(StateType::Epsilon);
+        result = { start, { { start, 0 } } };
+
+        while (pos < size) {
+            char c = m_pattern.at(pos);
+            if (nested && (c == '|' || c == ')')) break;
+
+            Fragment item;
+            if ((c == '?' || c == '*' || c == '+' || c == '@') && pos + 1 < size && m_pattern.at(pos + 1) == '(') {
+                pos += 2;
+                Fragment group;
+                if (!parseAlternatives(pos, true, group)) return false;
+                if (pos >= size || m_pattern.at(pos) != ')') return false;
+                pos++;
+
+                int split;
+                switch (c) {
+                    case '?':
+                        split = addState(StateType::Split, group.start);
+                        item = { split, group.outs };
+                        item.outs.push_back({ split, 1 });
+                        break;
+                    case '*':
+                        split = addState(StateType::Split, group.start);
+                        patch(group.outs, split);
+                        item = { split, { { split, 1 } } };
+                        break;
+                    case '+':
+                        split = addState(StateType::Split, group.start);
+                        patch(group.outs, split);
+                        item = { group.start, { { split, 1 } } };
+                        break;
+                    default:
+                        item = std::move(group);
+                }
+            } else if (c == '*') {
+                pos++;
+                int any = addState(StateType::Any);
+                int split = addState(StateType::Split, any);
+                m_states.at(any).out = split;
+                item = { split, { { split, 1 } } };
+            } else if (c == '?') {
+                pos++;
+                int any = addState(StateType::Any);
+                item = { any, { { any, 0 } } };
+            } else if (c == '[' && parseClass(pos, item)) {
+                // Consumed by parseClass, an unterminated class is a literal '['
+            } else {
+                if (c == '\\' && pos + 1 < size) pos++;
+                int literal = addState(StateType::Char);
+                m_states.at(literal).c = m_pattern.at(pos++);
+                item = { literal, { { literal, 0 } } };
+            }
+
+            patch(result.outs, item.start);
+            result.outs = std::move(item.outs);
+        }
+
+        return true;
+    }
+
+    bool GlobPattern::parseClass(size_t &pos, Fragment &result) {
+        const size_t size = m_pattern.size();
+        size_t i = pos + 1;
+        bool negate = false;
+        if (i < size && (m_pattern.at(i) == '!' || m_pattern.at(i) == '^')) {
+            negate = true;
+            i++;
+        }
+
+        std::bitset<256> set;
+        bool first = true;
+        while (i < size && (first || m_pattern.at(i) != ']')) {
+            first = false;
+            if (m_pattern.at(i) == '[' && i + 1 < size && m_pattern.at(i + 1) == ':') {
+                size_t end = m_pattern.find(":]", i + 2);
+                if (end != std::string::npos) {
+                    std::string name = m_pattern.substr(i + 2, end - i - 2);
+                    for (int ch = 0; ch < 256; ++ch) {
+                        if (matchesNamedClass(name, ch)) set.set(ch);
+                    }
+                    i = end + 2;
+                    continue;
+                }
+            }
+
+            if (m_pattern.at(i) == '\\' && i + 1 < size) i++;
+            unsigned char low = m_pattern.at(i);
+            if (i + 2 < size && m_pattern.at(i + 1) == '-' && m_pattern.at(i + 2) != ']') {
+                unsigned char high = m_pattern.at(i + 2);
+                for (int ch = low; ch <= high; ++ch) set.set(ch);
+                i += 3;
+            } else {
+                set.set(low);
+                i++;
+            }
+        }
+
+        if (i >= size) return false;
+        if (negate) set.flip();
+
+        m_classes.push_back(set);
+        int state = addState(StateType::Class);
+        m_states.at(state).charClass = m_classes.size() - 1;
+        result = { state, { { state, 0 } } };
+        pos = i + 1;
+        return true;
+    }
+
+    void GlobPattern::addToSet(std::vector<int> &set, std::vector<unsigned> &marks, unsigned generation, int state) const {
+        if (state < 0 || marks[state] == generation) return;
+        marks[state] = generation;
+
+        const State& current = m_states[state];
+        if (current.type == StateType::Split) {
+            addToSet(set, marks, generation, current.out);
+            addToSet(set, marks, generation, current.out1);
+        } else if (current.type == StateType::Epsilon) {
+            addToSet(set, marks, generation, current.out);
+        } else {
+            set.push_back(state);
+        }
+    }
+
+    bool GlobPattern::matches(std::string_view text) const {
+        if (m_useFallback) return fnmatch(m_pattern.c_str(), std::string(text).c_str(), FNM_EXTMATCH) != FNM_NOMATCH;
+
+        std::vector<int> current;
+        std::vector<int> next;
+        std::vector<unsigned> marks(m_states.size(), 0);
+        unsigned generation = 1;
+        addToSet(current, marks, generation, m_start);
+
+        for (char ch : text) {
+            const unsigned char c = ch;
+            generation++;
+            next.clear();
+            for (int state : current) {
+                const State& s = m_states[state];
+                bool accepted = s.type == StateType::Any
+                    || (s.type == StateType::Char && s.c == c)
+                    || (s.type == StateType::Class && m_classes[s.charClass].test(c));
+                if (accepted) addToSet(next, marks, generation, s.out);
+            }
+            std::swap(current, next);
+            if (current.empty()) return false;
+        }
+
+        for (int state : current) {
+            if (m_states[state].type == StateType::Match) return true;
+        }
+        return false;
+    }
+
+    PathFilter::PathFilter(const std::vector<std::string> &patterns) {
+        m_rules.reserve(patterns.size());
+        for (auto pattern : patterns) {
+            bool directoryOnly = pattern.ends_with('/');
+            while (pattern.ends_with('/')) pattern.pop_back();
+            if (pattern.starts_with('/')) pattern.erase(0, 1);
+            if (pattern.empty()) continue;
+            bool matchPath = pattern.find('/') != std::string::npos;
+            m_rules.push_back({ GlobPattern(pattern), directoryOnly, matchPath });
+        }
+    }
+
+    bool PathFilter::isIgnored(const fs::path &relativePath, bool isDirectory) const {
+        for (auto& rule : m_rules) {
+            if (rule.directoryOnly && !isDirectory) continue;
+            if (rule.pattern.matches(rule.matchPath ? relativePath.string() : relativePath.filename().string())) return true;
+        }
+        return false;
+    }
+
+    bool PathFilter::isIgnoredRecursive(const fs::path &relativePath) const {
+        if (isIgnored(relativePath, false)) return true;
+        for (fs::path parent = relativePath.parent_path(); !parent.empty(); parent = parent.parent_path()) {
+            if (isIgnored(parent, true)) return true;
+        }
+        return false;
+    }
+
+    bool PathFilter::empty() const {
+        return m_rules.empty();
+    }
+
+    DestinationFilter::DestinationFilter(const std::vector<std::string> &only, const std::vector<std::string> &exclude)
+    : m_only(only)
+    , m_exclude(exclude) {
+        for (auto pattern : only) {
+            while (pattern.ends_with('/')) pattern.pop_back();
+            if (pattern.starts_with('/')) pattern.erase(0, 1);
+            if (pattern.empty()) continue;
+            if (pattern.find('/') == std::string::npos) {
+                m_hasUnanchoredOnly = true;
+                continue;
+            }
+
+            std::vector<std::string>& prefix = m_onlyPrefixes.emplace_back();
+            for (auto& component : fs::path(pattern)) {
+                if (component.string().find_first_of("*?[+@!(") != std::string::npos) break;
+                prefix.push_back(component.string());
+            }
+        }
+    }
+
+    bool DestinationFilter::matchesDirectory(const PathFilter &filter, const fs::path &directory) {
+        for (fs::path parent = directory; !parent.empty(); parent = parent.parent_path()) {
+            if (filter.isIgnored(parent, true)) return true;
+        }
+        return false;
+    }
+
+    bool DestinationFilter::isSelected(const fs::path &destination) const {
+        if (!m_exclude.empty() && m_exclude.isIgnoredRecursive(destination)) return false;
+        return m_only.empty() || m_only.isIgnoredRecursive(destination);
+    }
+
+    bool DestinationFilter::mayContainSelected(const fs::path &directory) const {
+        if (!m_exclude.empty() && matchesDirectory(m_exclude, directory)) return false;
+        if (m_only.empty() || m_hasUnanchoredOnly || matchesDirectory(m_only, directory)) return true;
+
+        // Either the directory leads to the rule or the literal part of the rule is one of its parents
+        for (auto& prefix : m_onlyPrefixes) {
+            auto component = directory.begin();
+            size_t i = 0;
+            while (component != directory.end() && i < prefix.size() && component->string() == prefix[i]) {
+                ++component;
+                ++i;
+            }
+            if (component == directory.end() || i == prefix.size()) return true;
+        }
+        return false;
+    }
+
+    bool DestinationFilter::empty() const {
+        return m_only.empty() && m_exclude.empty();
+    }
+}
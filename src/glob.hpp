@@ -0,0 +1,99 @@
+#pragma once
+
+#include <bitset>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace rdm {
+    // A glob compiled once into an NFA, supports the fnmatch(3) syntax with FNM_EXTMATCH
+    // except for !(...), which falls back to fnmatch
+    class GlobPattern {
+        public:
+        GlobPattern(const std::string &pattern);
+        bool matches(std::string_view text) const;
+        const std::string& getPattern() const;
+
+        private:
+        enum class StateType {
+            Char,
+            Any,
+            Class,
+            Split,
+            Epsilon,
+            Match
+        };
+
+        struct State {
+            StateType type;
+            unsigned char c = 0;
+            int charClass = -1;
+            int out = -1;
+            int out1 = -1;
+        };
+
+        struct Fragment {
+            int start;
+            std::vector<std::pair<int, int>> outs;
+        };
+
+        bool compile();
+        bool parseAlternatives(size_t &pos, bool nested, Fragment &result);
+        bool parseSequence(size_t &pos, bool nested, Fragment &result);
+        bool parseClass(size_t &pos, Fragment &result);
+        int addState(StateType type, int out = -1, int out1 = -1);
+        void patch(const std::vector<std::pair<int, int>> &outs, int target);
+        void addToSet(std::vector<int> &set, std::vector<unsigned> &marks, unsigned generation, int state) const;
+
+        const std::string m_pattern;
+        std::vector<State> m_states;
+        std::vector<std::bitset<256>> m_classes;
+        int m_start = -1;
+        bool m_useFallback = false;
+    };
+
+    // Gitignore-like rules: 'name' matches any path component, 'dir/name' matches the relative path
+    // and a trailing '/' only matches directories
+    class PathFilter {
+        public:
+        PathFilter() = default;
+        PathFilter(const std::vector<std::string> &patterns);
+        bool isIgnored(const fs::path &relativePath, bool isDirectory) const;
+        bool isIgnoredRecursive(const fs::path &relativePath) const;
+        bool empty() const;
+
+        private:
+        struct Rule {
+            GlobPattern pattern;
+            bool directoryOnly;
+            bool matchPath;
+        };
+
+        std::vector<Rule> m_rules;
+    };
+
+    // --only and --exclude, PathFilter rules matched against paths relative to the destination root
+    // A file is selected when it or a parent matches an --only rule (if there are any) and none matches an --exclude one
+    class DestinationFilter {
+        public:
+        DestinationFilter() = default;
+        DestinationFilter(const std::vector<std::string> &only, const std::vector<std::string> &exclude);
+        bool isSelected(const fs::path &destination) const;
+        // False when nothing under the directory can be selected, so walks can skip it
+        bool mayContainSelected(const fs::path &directory) const;
+        bool empty() const;
+
+        private:
+        static bool matchesDirectory(const PathFilter &filter, const fs::path &directory);
+
+        PathFilter m_only;
+        PathFilter m_exclude;
+        // Components of each --only rule up to its first glob, a directory outside all of them can't contain a match
+        std::vector<std::vector<std::string>> m_onlyPrefixes;
+        // A rule without '/' matches a name at any depth, nothing can be pruned
+        bool m_hasUnanchoredOnly = false;
+    };
+}
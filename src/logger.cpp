@@ -0,0 +1,217 @@
+#include "logger.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "utils.hpp"
+
+namespace logger {
+    static constexpr size_t BUFFER_SIZE = 1 << 16;
+    static constexpr size_t MAX_PENDING_RECORDS = 1 << 14;
+    static constexpr const char* SEPARATOR = "+------------------------------------------------+";
+
+    #ifdef _DEBUG
+    static std::atomic<Level> s_level = Level::Debug;
+    #else
+    static std::atomic<Level> s_level = Level::Info;
+    #endif
+    static std::atomic<Format> s_format = Format::Text;
+
+    struct Record {
+        int fd;
+        std::string line;
+    };
+
+    class AsyncWriter {
+        public:
+        void push(int fd, std::string &&line) {
+            std::unique_lock lock(m_mutex);
+            if (m_stopped) {
+                // Records logged during shutdown are written directly
+                rdm::writeAll(fd, line.data(), line.size());
+                return;
+            }
+            if (!m_thread.joinable()) m_thread = std::thread(&AsyncWriter::run, this);
+
+            m_drained.wait(lock, [this]() { return m_pending.size() < MAX_PENDING_RECORDS; });
+            m_pending.push_back({ fd, std::move(line) });
+            if (m_pending.size() == 1) m_ready.notify_one();
+        }
+
+        void flush() {
+            std::unique_lock lock(m_mutex);
+            m_drained.wait(lock, [this]() { return m_stopped || (m_pending.empty() && !m_writing); });
+        }
+
+        void stop() {
+            {
+                std::lock_guard lock(m_mutex);
+                if (m_stopped) return;
+                m_stopped = true;
+            }
+            m_ready.notify_one();
+            if (m_thread.joinable()) m_thread.join();
+        }
+
+        private:
+        void run() {
+            std::vector<Record> batch;
+            std::string buffer;
+            buffer.reserve(BUFFER_SIZE);
+
+            std::unique_lock lock(m_mutex);
+            while (true) {
+                m_ready.wait(lock, [this]() { return !m_pending.empty() || m_stopped; });
+                if (m_pending.empty()) break;
+
+                batch.swap(m_pending);
+                m_writing = true;
+                lock.unlock();
+                m_drained.notify_all();
+
+                // Consecutive records for the same stream become a single write
+                int fd = -1;
+                for (auto& record : batch) {
+                    if (record.fd != fd || buffer.size() + record.line.size() > BUFFER_SIZE) {
+                        rdm::writeAll(fd, buffer.data(), buffer.size());
+                        buffer.clear();
+                        fd = record.fd;
+                    }
+                    buffer.append(record.line);
+                }
+                rdm::writeAll(fd, buffer.data(), buffer.size());
+                buffer.clear();
+                batch.clear();
+
+                lock.lock();
+                m_writing = false;
+                m_drained.notify_all();
+            }
+        }
+
+        std::mutex m_mutex;
+        std::condition_variable m_ready;
+        std::condition_variable m_drained;
+        std::vector<Record> m_pending;
+        std::thread m_thread;
+        bool m_writing = false;
+        bool m_stopped = false;
+    };
+
+    // Never destroyed so that records from static destructors are still written, the queue is drained at exit
+    static AsyncWriter& getWriter() {
+        static AsyncWriter* writer = []() {
+            AsyncWriter* instance = new AsyncWriter();
+            std::atexit([]() { getWriter().stop(); });
+            return instance;
+        }();
+        return *writer;
+    }
+
+    static const char* getLevelName(Level level) {
+        switch (level) {
+            case Level::Error: return "error";
+            case Level::Warning: return "warning";
+            case Level::Info: return "info";
+            case Level::Debug: return "debug";
+            default: return "output";
+        }
+    }
+
+    static void appendJsonString(std::string &out, const std::string &value) {
+        out.push_back('"');
+        for (unsigned char c : value) {
+            switch (c) {
+                case '"': out.append("\\\""); break;
+                case '\\': out.append("\\\\"); break;
+                case '\n': out.append("\\n"); break;
+                case '\r': out.append("\\r"); break;
+                case '\t': out.append("\\t"); break;
+                default:
+                    if (c < 0x20) {
+                        char escaped[7];
+                        std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                        out.append(escaped);
+                    } else {
+                        out.push_back(c);
+                    }
+            }
+        }
+        out.push_back('"');
+    }
+
+    static void appendTimestamp(std::string &out) {
+        auto now = std::chrono::system_clock::now();
+        std::time_t seconds = std::chrono::system_clock::to_time_t(now);
+        long milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000;
+        std::tm utc;
+        gmtime_r(&seconds, &utc);
+        char timestamp[32];
+        size_t length = std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", &utc);
+        std::snprintf(timestamp + length, sizeof(timestamp) - length, ".%03ldZ", milliseconds);
+        out.append(timestamp);
+    }
+
+    void setLevel(Level level) {
+        s_level = level;
+    }
+
+    Level getLevel() {
+        return s_level;
+    }
+
+    void setFormat(Format format) {
+        s_format = format;
+    }
+
+    Format getFormat() {
+        return s_format;
+    }
+
+    void flush() {
+        getWriter().flush();
+    }
+
+    void write(Level level, const char* tag, std::string &&name, std::string &&message) {
+        const int fd = level == Level::Output || level == Level::Info ? STDOUT_FILENO : STDERR_FILENO;
+        std::string line;
+
+        if (s_format == Format::Json) {
+            line.reserve(message.size() + name.size() + 64);
+            line.append("{\"time\":\"");
+            appendTimestamp(line);
+            line.append("\",\"level\":\"").append(getLevelName(level)).append("\"");
+            if (!name.empty()) {
+                line.append(",\"module\":");
+                appendJsonString(line, name);
+            }
+            line.append(",\"message\":");
+            appendJsonString(line, message);
+            line.append("}\n");
+        } else {
+            line.reserve(message.size() + name.size() + 32);
+            if (!name.empty()) {
+                #ifndef _NCOLOR
+                line.append("\033[94m[").append(name).append(tag == nullptr ? "]\033[m " : "]");
+                #else
+                line.append("[").append(name).append(tag == nullptr ? "] " : "]");
+                #endif
+            }
+            if (tag != nullptr) line.append(tag);
+            line.append(message).push_back('\n');
+        }
+
+        getWriter().push(fd, std::move(line));
+    }
+
+    void writeSeparator() {
+        if (s_format == Format::Json) return;
+        getWriter().push(STDOUT_FILENO, std::string(SEPARATOR) + "\n");
+    }
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <lua.hpp>
+
+// Sources are written against Lua 5.4, with -Dlua_impl=luajit (RDM_LUAJIT) the 5.2+ API they use is
+// implemented here on top of the 5.1 one of LuaJIT. Each shim is defined before the macro that replaces the name.
+#ifdef RDM_LUAJIT
+#include <cmath>
+#include <cstddef>
+
+#ifndef LUA_OK
+#define LUA_OK 0
+#endif
+
+namespace rdm::luacompat {
+    inline int absindex(lua_State* L, int index) {
+        return index > 0 || index <= LUA_REGISTRYINDEX ? index : lua_gettop(L) + index + 1;
+    }
+
+    // 5.3+ returns the type of the pushed value
+    inline int getfield(lua_State* L, int index, const char* key) {
+        lua_getfield(L, index, key);
+        return lua_type(L, -1);
+    }
+
+    inline int rawgeti(lua_State* L, int index, int n) {
+        lua_rawgeti(L, index, n);
+        return lua_type(L, -1);
+    }
+
+    inline int rawgetp(lua_State* L, int index, const void* key) {
+        index = absindex(L, index);
+        lua_pushlightuserdata(L, const_cast<void*>(key));
+        lua_rawget(L, index);
+        return lua_type(L, -1);
+    }
+
+    inline void rawsetp(lua_State* L, int index, const void* key) {
+        index = absindex(L, index);
+        lua_pushlightuserdata(L, const_cast<void*>(key));
+        lua_insert(L, -2);
+        lua_rawset(L, index);
+    }
+
+    inline void rotate(lua_State* L, int index, int n) {
+        index = absindex(L, index);
+        for (; n > 0; --n) lua_insert(L, index);
+        for (; n < 0; ++n) {
+            lua_pushvalue(L, index);
+            lua_remove(L, index);
+        }
+    }
+
+    // LuaJIT userdata have a single environment table instead of user values, none of ours use them
+    inline void* newuserdatauv(lua_State* L, size_t size, int) {
+        return lua_newuserdata(L, size);
+    }
+
+    // Every number is a double, integral ones that fit in one are integers like they would be in 5.4
+    inline int isinteger(lua_State* L, int index) {
+        if (lua_type(L, index) != LUA_TNUMBER) return 0;
+        lua_Number number = lua_tonumber(L, index);
+        return std::floor(number) == number && std::fabs(number) <= 9007199254740992.0;
+    }
+
+    // Doesn't call __len, no rdm type defines it
+    inline lua_Integer len(lua_State* L, int index) {
+        return static_cast<lua_Integer>(lua_objlen(L, index));
+    }
+
+    inline const char* tolstring(lua_State* L, int index, size_t* length) {
+        if (!luaL_callmeta(L, index, "__tostring")) {
+            switch (lua_type(L, index)) {
+                case LUA_TNUMBER:
+                case LUA_TSTRING:
+                    lua_pushvalue(L, index);
+                    break;
+                case LUA_TBOOLEAN:
+                    lua_pushstring(L, lua_toboolean(L, index) ? "true" : "false");
+                    break;
+                case LUA_TNIL:
+                    lua_pushstring(L, "nil");
+                    break;
+                default:
+                    lua_pushfstring(L, "%s: %p", luaL_typename(L, index), lua_topointer(L, index));
+            }
+        }
+        return lua_tolstring(L, -1, length);
+    }
+
+    inline void* testudata(lua_State* L, int index, const char* name) {
+        void* data = lua_touserdata(L, index);
+        if (data == nullptr || !lua_getmetatable(L, index)) return nullptr;
+        luaL_getmetatable(L, name);
+        bool matches = lua_rawequal(L, -1, -2);
+        lua_pop(L, 2);
+        return matches ? data : nullptr;
+    }
+
+    // Bytecode always keeps its debug info
+    inline int dump(lua_State* L, lua_Writer writer, void* data, int) {
+        return lua_dump(L, writer, data);
+    }
+
+    // Modules written for 5.4 expect table.unpack, LuaJIT only has it when built with 5.2 compatibility
+    inline void openlibs(lua_State* L) {
+        luaL_openlibs(L);
+        lua_getglobal(L, "table");
+        lua_getfield(L, -1, "unpack");
+        if (lua_isnil(L, -1)) {
+            lua_getglobal(L, "unpack");
+            lua_setfield(L, -3, "unpack");
+        }
+        lua_pop(L, 2);
+    }
+}
+
+// lua_getglobal is a macro over lua_getfield in 5.1, so it returns the type too
+#define lua_getfield rdm::luacompat::getfield
+#define lua_rawgeti rdm::luacompat::rawgeti
+#define lua_rawgetp rdm::luacompat::rawgetp
+#define lua_rawsetp rdm::luacompat::rawsetp
+#define lua_rotate rdm::luacompat::rotate
+#define lua_absindex rdm::luacompat::absindex
+#define lua_newuserdatauv rdm::luacompat::newuserdatauv
+#define lua_isinteger rdm::luacompat::isinteger
+#define luaL_len rdm::luacompat::len
+#define luaL_tolstring rdm::luacompat::tolstring
+#define luaL_testudata rdm::luacompat::testudata
+#define lua_dump rdm::luacompat::dump
+#define luaL_openlibs rdm::luacompat::openlibs
+#endif
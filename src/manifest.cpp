@@ -0,0 +1,100 @@
+#include "manifest.hpp"
+#include <fstream>
+#include <string_view>
+#include "bundle.hpp"
+#include "logger.hpp"
+#include "modules.hpp"
+
+namespace rdm {
+    static constexpr std::string_view HEADER_PREFIX = "--@rdm";
+
+    static std::string_view trim(std::string_view value) {
+        size_t start = value.find_first_not_of(" \t\r");
+        if (start == std::string_view::npos) return std::string_view();
+        size_t end = value.find_last_not_of(" \t\r");
+        return value.substr(start, end - start + 1);
+    }
+
+    static void parseEntry(std::string_view entry, const fs::path &modulePath, ModuleManifest &manifest) {
+        size_t separator = entry.find(':');
+        if (separator == std::string_view::npos) {
+            LOG_CUSTOM_DEBUG(Module::getNameFromPath(modulePath), "Ignoring the manifest line '" << entry << "', it isn't 'key: value'");
+            return;
+        }
+
+        std::string_view key = trim(entry.substr(0, separator));
+        std::string_view value = trim(entry.substr(separator + 1));
+        if (key == "requires") {
+            manifest.declaresRequires = true;
+            while (!value.empty()) {
+                size_t comma = value.find(',');
+                std::string_view name = trim(value.substr(0, comma));
+                if (!name.empty()) manifest.requiredModules.emplace_back(name);
+                value = comma == std::string_view::npos ? std::string_view() : value.substr(comma + 1);
+            }
+        } else if (key == "description") {
+            manifest.description = value;
+        } else {
+            LOG_CUSTOM_DEBUG(Module::getNameFromPath(modulePath), "Ignoring the unknown manifest key '" << key << "'");
+        }
+    }
+
+    // False once the header is over
+    static bool parseHeaderLine(std::string_view line, bool firstLine, const fs::path &modulePath, ModuleManifest &manifest) {
+        line = trim(line);
+        if (line.empty() || (firstLine && line.starts_with('#'))) return true;
+        if (!line.starts_with("--")) return false;
+        if (line.starts_with(HEADER_PREFIX)) parseEntry(line.substr(HEADER_PREFIX.size()), modulePath, manifest);
+        return true;
+    }
+
+    static void parseSidecarLine(std::string_view line, const fs::path &modulePath, ModuleManifest &manifest) {
+        line = trim(line);
+        if (!line.empty() && !line.starts_with('#')) parseEntry(line, modulePath, manifest);
+    }
+
+    fs::path getManifestPath(const fs::path &modulePath) {
+        fs::path path = modulePath;
+        path.replace_extension(".manifest");
+        return path;
+    }
+
+    ModuleManifest readModuleManifest(const fs::path &modulePath) {
+        ModuleManifest manifest;
+        fs::path manifestPath = getManifestPath(modulePath);
+
+        // Bundles keep the source of each module next to its bytecode
+        Bundle* bundle = Bundle::getActive();
+        if (bundle != nullptr && bundle->contains(modulePath)) {
+            if (const BundleEntry* entry = bundle->find(modulePath)) {
+                std::string_view source = bundle->getData(*entry);
+                bool firstLine = true;
+                while (!source.empty()) {
+                    size_t end = source.find('\n');
+                    if (!parseHeaderLine(source.substr(0, end), firstLine, modulePath, manifest)) break;
+                    source = end == std::string_view::npos ? std::string_view() : source.substr(end + 1);
+                    firstLine = false;
+                }
+            }
+            if (const BundleEntry* entry = bundle->find(manifestPath)) {
+                std::string_view sidecar = bundle->getData(*entry);
+                while (!sidecar.empty()) {
+                    size_t end = sidecar.find('\n');
+                    parseSidecarLine(sidecar.substr(0, end), modulePath, manifest);
+                    sidecar = end == std::string_view::npos ? std::string_view() : sidecar.substr(end + 1);
+                }
+            }
+            return manifest;
+        }
+
+        std::string line;
+        std::ifstream source(modulePath);
+        for (bool firstLine = true; std::getline(source, line); firstLine = false) {
+            if (!parseHeaderLine(line, firstLine, modulePath, manifest)) break;
+        }
+
+        std::ifstream sidecar(manifestPath);
+        while (std::getline(sidecar, line)) parseSidecarLine(line, modulePath, manifest);
+        return manifest;
+    }
+}
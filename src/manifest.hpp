@@ -0,0 +1,23 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace rdm {
+    // What a module declares about itself without running it, from its leading '--@rdm key: value' comments
+    // and from the optional rdm-<name>.manifest next to it (plain 'key: value' lines)
+    struct ModuleManifest {
+        // Set by any 'requires' line (even an empty one), the module's RDM_AddModules is then never called
+        bool declaresRequires = false;
+        std::vector<std::string> requiredModules;
+        std::string description;
+    };
+
+    // A cheap text scan, the header ends at the first line that isn't a comment, a shebang or empty
+    // Sources and sidecars packed in the active bundle are read from it
+    ModuleManifest readModuleManifest(const fs::path &modulePath);
+    fs::path getManifestPath(const fs::path &modulePath);
+}
@@ -7,25 +7,60 @@ namespace rdm::menus {
         LOG(" apply-safe        Runs the scripts and backups files they replace");
         LOG(" apply-soft        Runs the scripts but doesn't replace existing files");
         LOG(" clone             Populates the rdm data directory with a git repository");
+        LOG(" complete          Shell completion for modules, flags and commands, 'rdm complete --shell <bash|zsh|fish>' prints the script to load");
+        LOG(" diff              Shows the changes an apply would make to the files in the home directory");
         LOG(" dir               Print RDM_DATA_DIR to stdout, useful to quickly cd with 'cd $(rdm dir)'");
+        LOG(" export            Streams the files of the modules as a tar archive, without writing them to the home directory");
         LOG(" help              Prints the help menu of a command");
         LOG(" init              Initializes the rdm data directory");
         LOG(" list              Prints all the available rdm modules");
+        LOG(" pack              Packs the home directory and precompiled modules into a single bundle file");
         LOG(" preview           Preview an apply command, displays files returned by modules and sets the 'preview' flag");
+        LOG(" remove            Deletes the files rdm wrote for the given modules, without running them");
         LOG(" restore           Restores files from the backup directory (created when using apply-safe)");
+        LOG(" status            Checks if the files of the modules are in sync with the home directory");
+        LOG("Global options:");
+        LOG(" -v,--verbose      Print more information about what RDM is doing, use -vv to include debug messages");
+        LOG(" -q,--quiet        Only print errors and command output");
+        LOG(" --log-format <f>  Format of the log messages: text (default) or json (one object per line, for other tools)");
+        LOG(" --lua-budget <n>  Abort a module that runs more than n Lua instructions in one call (e.g. 50M), or only one with <module>=<n>");
+        LOG(" --lua-timeout <t> Abort a module that runs for more than t seconds in one call (e.g. 10, 500ms), or only one with <module>=<t>");
+        LOG(" --startup-trace   Print to stderr how long each phase of startup took, once the command is done");
     }
     
     void printApplyHelp() {
         LOG("Usage: rdm apply|apply-soft|apply-safe [modules...] [options...]");
         LOG(" module            The name of the module to apply (e.g. rdm-hyprland.lua -> hyprland), leave empty for all modules");
         LOG("Options:");
-        LOG(" -v,--verbose      Print more information about what RDM is doing");
+        LOG(" -v,--verbose      Print more information about what RDM is doing, use -vv to include debug messages");
+        LOG(" -q,--quiet        Only print errors");
+        LOG(" --log-format <f>  Format of the log messages: text (default) or json");
+        LOG(" --bundle <file>   Apply the modules from a bundle created with 'rdm pack' instead of the data directory");
+        LOG(" --only <glob>     Only apply the destinations matching glob (relative to the home, gitignore-like), can be repeated");
+        LOG(" --exclude <glob>  Never apply the destinations matching glob, can be repeated");
+        LOG(" --io-backend <b>  How files are written: auto (default), sync or uring (batched io_uring, if rdm was built with it)");
+        LOG(" --large-file-size <n> Files of at least n bytes (e.g. 512M, default 64M) are copied first, keep their holes and resume if interrupted");
+        LOG(" --root <dir>      Write the files into dir instead of the home, can be repeated to write the same files into many roots at once");
+        LOG(" --prune           Delete the files an applied module wrote in an earlier apply but no longer produces");
+        LOG(" --lua-budget <n>  Instruction budget of each call into a module, <module>=<n> sets it for one module");
+        LOG(" --lua-timeout <t> Time limit of each call into a module in seconds, <module>=<t> sets it for one module");
         LOG(" -f,--flags        A space separated list of flags that should be passed to the modules");
         LOG("Examples:");
         LOG(" rdm apply                                            -> Applies all modules without any flags set");
         LOG(" rdm apply -f es setup                                -> Applies all modules with the flags 'es' and 'setup' set");
         LOG(" rdm apply-safe hyprland wallpapers -v -f laptop arch -> Applies the hyprland and wallpapers modules with the flags 'laptop' and 'arch' set, enables verbose mode and backups replaced files");
         LOG(" rdm apply-soft wallpapers                            -> Applies the wallpapers module without replacing any existing files");
+        LOG(" rdm apply --bundle dotfiles.rdmb -f laptop           -> Applies all modules stored in the bundle with the flag 'laptop' set");
+        LOG(" rdm apply --root /srv/a/home --root /srv/b/home      -> Evaluates all modules once and writes their files into both directories");
+        LOG(" rdm apply hyprland --only .config/hypr/hyprland.conf -> Only writes hyprland.conf, none of the other files of the module are copied or walked");
+        LOG(" rdm apply --lua-timeout 10 --lua-timeout wallpapers=60 -> Aborts any module that takes more than 10s (60s for wallpapers) in a single call");
+        LOG(" rdm apply hyprland --prune                           -> Applies hyprland and deletes the files it wrote before but dropped since");
+        LOG("Notes:");
+        LOG(" Modules are always evaluated for the home directory, apply-safe backups of other roots are stored in the backup directory under roots/<dir with / escaped as %2F> (filesystem for /)");
+        LOG(" A module aborted by --lua-budget or --lua-timeout is skipped with its traceback, the other modules are still applied");
+        LOG(" The timeout includes the time spent in Spawn and ForceSpawn, but is only checked once the command returns");
+        LOG(" Large files are copied into .<name>.rdm-partial next to the destination, applying again after an interruption resumes from the last 64 MiB chunk");
+        LOG(" Every written file is recorded with its module in $XDG_STATE_HOME/rdm/owners, --prune never deletes a file that changed since rdm wrote it");
     }
 
     void printDirHelp() {
@@ -33,9 +68,27 @@ namespace rdm::menus {
         LOG(" Print RDM_DATA_DIR to stdout, useful to quickly cd with 'cd $(rdm dir)'");
     }
 
+    void printExportHelp() {
+        LOG("Usage: rdm export [modules...] [--tar] [-o <file>|-] [options...]");
+        LOG(" module            The name of the module to export (e.g. rdm-hyprland.lua -> hyprland), leave empty for all modules");
+        LOG("Options:");
+        LOG(" --tar             Export as a POSIX tar archive, currently the only format");
+        LOG(" -o,--output       The file to write, defaults to '-' (stdout)");
+        LOG(" --bundle <file>   Export the modules from a bundle created with 'rdm pack' instead of the data directory");
+        LOG(" --only <glob>     Only export the destinations matching glob (relative to the home, gitignore-like), can be repeated");
+        LOG(" --exclude <glob>  Never export the destinations matching glob, can be repeated");
+        LOG(" -f,--flags        A space separated list of flags that should be passed to the modules");
+        LOG("Notes:");
+        LOG(" Sets the 'preview' flag, paths in the archive are relative to the home directory");
+        LOG(" Set SOURCE_DATE_EPOCH to get the same archive for the same files");
+        LOG(" Nothing is exported and the exit code is 1 if a module fails to return its files");
+        LOG("Examples:");
+        LOG(" rdm export --tar -f server | docker cp - container:/root -> Copies the files of all modules with the flag 'server' set into a container");
+    }
+
     void printHelpHelp() {
         LOG("Usage: rdm help <command>");
-        LOG("Valid commands: apply, apply-safe, apply-soft, clone, dir, help, init, list, preview, restore");
+        LOG("Valid commands: apply, apply-safe, apply-soft, clone, complete, diff, dir, export, help, init, list, pack, preview, remove, restore, status");
     }
 
     void printInitHelp() {
@@ -48,6 +101,13 @@ namespace rdm::menus {
         LOG("Prints all the available rdm modules");
     }
 
+    void printPackHelp() {
+        LOG("Usage: rdm pack [-o <file>]");
+        LOG("Packs the home directory, including precompiled modules, into a single bundle that can be applied with 'rdm apply --bundle <file>'");
+        LOG("Options:");
+        LOG(" -o,--output       The bundle file to create, defaults to 'rdm.rdmb' in the current directory");
+    }
+
     void printCloneHelp() {
         LOG("Usage: rdm clone <repo> [--replace]");
         LOG(" repo              A git repository to clone as the rdm data directory");
@@ -55,17 +115,72 @@ namespace rdm::menus {
         LOG(" --replace         Deletes the data directory if it exists before attempting to clone");
     }
 
+    void printCompleteHelp() {
+        LOG("Usage: rdm complete <words...> | rdm complete --shell <bash|zsh|fish>");
+        LOG(" words             The words after 'rdm' up to the cursor, the last one is completed (it can be empty)");
+        LOG("Options:");
+        LOG(" --shell <shell>   Print the completion script of a shell instead");
+        LOG("Examples:");
+        LOG(" eval \"$(rdm complete --shell bash)\"              -> Enables completion in bash, add it to ~/.bashrc (same for zsh)");
+        LOG(" rdm complete --shell fish | source               -> Enables completion in fish, add it to ~/.config/fish/config.fish");
+        LOG(" rdm complete apply hypr                          -> Prints the modules starting with 'hypr'");
+        LOG("Notes:");
+        LOG(" Modules and flags come from an index in the cache directory, flags are the literal arguments of FlagIsSet and IsSet calls");
+        LOG(" The index is refreshed when a known module changes, modules added to new subdirectories only show up after 'rdm list'");
+    }
+
+    void printDiffHelp() {
+        LOG("Usage: rdm diff [modules...] [options...]");
+        LOG(" module            The name of the module to diff (e.g. rdm-hyprland.lua -> hyprland), leave empty for all modules");
+        LOG("Options:");
+        LOG(" --bundle <file>   Diff the modules from a bundle created with 'rdm pack' instead of the data directory");
+        LOG(" --only <glob>     Only diff the destinations matching glob (relative to the home, gitignore-like), can be repeated");
+        LOG(" --exclude <glob>  Never diff the destinations matching glob, can be repeated");
+        LOG(" -f,--flags        A space separated list of flags that should be passed to the modules");
+        LOG("Notes:");
+        LOG(" Sets the 'preview' flag and prints a unified diff for every file that would be created or modified, binary files are only reported");
+    }
+
     void printPreviewHelp() {
         LOG("Usage: rdm preview [modules...] [options...]");
         LOG(" module            The name of the module to apply (e.g. rdm-hyprland.lua -> hyprland), leave empty for all modules");
         LOG("Options:");
+        LOG(" --bundle <file>   Preview the modules from a bundle created with 'rdm pack' instead of the data directory");
+        LOG(" --only <glob>     Only preview the destinations matching glob (relative to the home, gitignore-like), can be repeated");
+        LOG(" --exclude <glob>  Never preview the destinations matching glob, can be repeated");
         LOG(" -f,--flags        A space separated list of flags that should be passed to the modules");
         LOG("Notes:");
         LOG(" Works exactly like apply, except it sets the 'preview' flag and will display the files instead of creating or replacing them");
     }
 
+    void printRemoveHelp() {
+        LOG("Usage: rdm remove <modules...> [options...]");
+        LOG(" module            The name of the module whose files should be deleted (e.g. rdm-hyprland.lua -> hyprland)");
+        LOG("Options:");
+        LOG(" -v,--verbose      Print every deleted file");
+        LOG(" --root <dir>      Remove the files from dir instead of the home, can be repeated");
+        LOG("Notes:");
+        LOG(" Only the files rdm recorded when applying the modules are deleted, the modules aren't run so removed modules still work");
+        LOG(" Files changed since rdm wrote them are kept with a warning, directories rdm created and left empty are deleted too");
+        LOG(" Exits with 1 when any file of the modules was left behind");
+    }
+
     void printRestoreHelp() {
         LOG("Usage: rdm restore");
         LOG("Restores files from the backup directory (created when using apply-safe)");
     }
+
+    void printStatusHelp() {
+        LOG("Usage: rdm status [modules...] [options...]");
+        LOG(" module            The name of the module to check (e.g. rdm-hyprland.lua -> hyprland), leave empty for all modules");
+        LOG("Options:");
+        LOG(" -v,--verbose      Also print the files that are in sync");
+        LOG(" --bundle <file>   Check the modules from a bundle created with 'rdm pack' instead of the data directory");
+        LOG(" --only <glob>     Only check the destinations matching glob (relative to the home, gitignore-like), can be repeated");
+        LOG(" --exclude <glob>  Never check the destinations matching glob, can be repeated");
+        LOG(" -f,--flags        A space separated list of flags that should be passed to the modules");
+        LOG("Notes:");
+        LOG(" Sets the 'preview' flag, prints every file that is missing, modified or has a different mode and exits with 1 if there are any");
+        LOG(" A module that fails to return its files or a destination claimed by several modules also exits with 1, nothing is reported as in sync then");
+    }
 }
\ No newline at end of file
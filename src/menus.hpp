@@ -3,11 +3,17 @@
 namespace rdm::menus {
     void printApplyHelp();
     void printCloneHelp();
+    void printCompleteHelp();
+    void printDiffHelp();
     void printDirHelp();
+    void printExportHelp();
     void printHelpHelp();
     void printInitHelp();
     void printListHelp();
     void printMainHelp();
+    void printPackHelp();
     void printPreviewHelp();
+    void printRemoveHelp();
     void printRestoreHelp();
+    void printStatusHelp();
 }
\ No newline at end of file
@@ -0,0 +1,278 @@
+#include "moduleindex.hpp"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <string_view>
+#include <sys/stat.h>
+#include "logger.hpp"
+#include "manifest.hpp"
+#include "utils.hpp"
+
+namespace rdm {
+    static constexpr std::string_view INDEX_HEADER = "rdm-module-index\t3";
+    // Stored for a missing .rdmignore
+    static constexpr int64_t MISSING_MTIME = -1;
+
+    // A directory seen by the last walk, a module added anywhere under root changes the mtime of one of them
+    struct IndexedDirectory {
+        fs::path path;
+        int64_t mtime = 0;
+    };
+
+    struct ModuleIndex {
+        int64_t ignoreMtime = MISSING_MTIME;
+        std::vector<IndexedDirectory> directories;
+        std::vector<ModuleIndexEntry> entries;
+    };
+
+    static fs::path getIndexPath() {
+        return getCacheDir() / "module-index";
+    }
+
+    static bool getModificationTime(const fs::path &path, int64_t &mtime, uint64_t* size) {
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0) return false;
+        mtime = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+        if (size != nullptr) *size = info.st_size;
+        return true;
+    }
+
+    static bool isIdentifierCharacter(char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+    }
+
+    // Escapes are not supported, names and flags don't need them
+    static bool readStringLiteral(std::string_view source, size_t &position, std::string &value) {
+        if (position >= source.size() || (source[position] != '"' && source[position] != '\'')) return false;
+        const char quote = source[position];
+        size_t end = source.find_first_of(std::string_view("\n\\\t\"'"), position + 1);
+        if (end == std::string_view::npos || source[end] != quote) return false;
+        value = source.substr(position + 1, end - position - 1);
+        position = end + 1;
+        return !value.empty();
+    }
+
+    static void skipSpaces(std::string_view source, size_t &position) {
+        while (position < source.size() && (source[position] == ' ' || source[position] == '\t')) position++;
+    }
+
+    // FlagIsSet("x"), IsSet 'x' and so on, ModuleIsSet names modules so it is skipped
+    static void findFlags(std::string_view source, std::vector<std::string> &flags) {
+        constexpr std::string_view CALL = "IsSet";
+        std::string flag;
+        for (size_t position = source.find(CALL); position != std::string_view::npos; position = source.find(CALL, position + 1)) {
+            size_t start = position >= 4 && source.substr(position - 4, 4) == "Flag" ? position - 4 : position;
+            if (start > 0 && (isIdentifierCharacter(source[start - 1]) || source[start - 1] == '.' || source[start - 1] == ':')) continue;
+
+            size_t argument = position + CALL.size();
+            if (argument < source.size() && isIdentifierCharacter(source[argument])) continue;
+            skipSpaces(source, argument);
+            if (argument < source.size() && source[argument] == '(') {
+                argument++;
+                skipSpaces(source, argument);
+            }
+            if (readStringLiteral(source, argument, flag)) flags.push_back(flag);
+        }
+    }
+
+    // Every string literal from RDM_AddModules to the 'end' that closes it (the first one at the start of a line)
+    static void findAddedModules(std::string_view source, std::vector<std::string> &modules) {
+        size_t position = source.find("RDM_AddModules");
+        if (position == std::string_view::npos) return;
+
+        std::string name;
+        while (position < source.size()) {
+            char c = source[position];
+            if (c == '\n' && source.substr(position + 1, 3) == "end" && (position + 4 >= source.size() || !isIdentifierCharacter(source[position + 4]))) break;
+            if (c == '-' && source.substr(position, 2) == "--") {
+                position = source.find('\n', position);
+                continue;
+            }
+            if ((c == '"' || c == '\'') && readStringLiteral(source, position, name)) {
+                modules.push_back(name);
+                continue;
+            }
+            position++;
+        }
+    }
+
+    static void sortUnique(std::vector<std::string> &values) {
+        std::sort(values.begin(), values.end());
+        values.erase(std::unique(values.begin(), values.end()), values.end());
+    }
+
+    ModuleIndexEntry scanModuleSource(const std::string &name, const fs::path &path) {
+        ModuleIndexEntry entry;
+        entry.name = name;
+        entry.path = path;
+        getModificationTime(path, entry.mtime, &entry.size);
+
+        std::string source(entry.size, '\0');
+        std::ifstream file(path, std::ios::binary);
+        if (!file.read(source.data(), source.size())) return entry;
+
+        findFlags(source, entry.flags);
+        ModuleManifest manifest = readModuleManifest(path);
+        entry.description = manifest.description;
+        if (manifest.declaresRequires) {
+            entry.addedModules = std::move(manifest.requiredModules);
+        } else {
+            findAddedModules(source, entry.addedModules);
+        }
+        sortUnique(entry.flags);
+        sortUnique(entry.addedModules);
+        return entry;
+    }
+
+    static void saveModuleIndex(const fs::path &root, const ModuleIndex &index) {
+        fs::path indexPath = getIndexPath();
+        std::error_code error;
+        fs::create_directories(indexPath.parent_path(), error);
+
+        fs::path tempPath = indexPath;
+        tempPath += ".tmp";
+        {
+            std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+            file << INDEX_HEADER << "\nroot\t" << root.string() << "\nignore\t" << index.ignoreMtime << '\n';
+            for (auto& directory : index.directories) file << "dir\t" << directory.mtime << '\t' << directory.path.string() << '\n';
+            for (auto& entry : index.entries) {
+                file << "module\t" << entry.mtime << '\t' << entry.size << '\t' << entry.name << '\t' << entry.path.string() << '\n';
+                for (auto& module : entry.addedModules) file << "add\t" << module << '\n';
+                for (auto& flag : entry.flags) file << "flag\t" << flag << '\n';
+                if (!entry.description.empty()) file << "description\t" << entry.description << '\n';
+            }
+            if (!file) {
+                LOG_DEBUG("Couldn't write the module index to " << tempPath);
+                return;
+            }
+        }
+        fs::rename(tempPath, indexPath, error);
+        if (error) LOG_DEBUG("Couldn't write the module index to " << indexPath << ": " << error.message());
+    }
+
+    // Splits at most count - 1 tabs, the last field keeps the rest of the line
+    static std::vector<std::string_view> splitFields(std::string_view line, size_t count) {
+        std::vector<std::string_view> fields;
+        while (fields.size() + 1 < count) {
+            size_t tab = line.find('\t');
+            if (tab == std::string_view::npos) break;
+            fields.push_back(line.substr(0, tab));
+            line.remove_prefix(tab + 1);
+        }
+        fields.push_back(line);
+        return fields;
+    }
+
+    static bool loadModuleIndex(const fs::path &root, ModuleIndex &index) {
+        std::ifstream file(getIndexPath(), std::ios::binary);
+        std::string line;
+        if (!std::getline(file, line) || line != INDEX_HEADER) return false;
+        if (!std::getline(file, line) || line != "root\t" + root.string()) return false;
+        if (!std::getline(file, line) || !line.starts_with("ignore\t")) return false;
+        index.ignoreMtime = std::stoll(line.substr(7));
+
+        std::vector<ModuleIndexEntry>& entries = index.entries;
+        while (std::getline(file, line)) {
+            auto fields = splitFields(line, 5);
+            if (fields[0] == "dir" && fields.size() >= 3 && entries.empty()) {
+                auto directoryFields = splitFields(line, 3);
+                index.directories.push_back({ std::string(directoryFields[2]), std::stoll(std::string(directoryFields[1])) });
+            } else if (fields[0] == "module" && fields.size() == 5) {
+                ModuleIndexEntry& entry = entries.emplace_back();
+                entry.mtime = std::stoll(std::string(fields[1]));
+                entry.size = std::stoull(std::string(fields[2]));
+                entry.name = fields[3];
+                entry.path = std::string(fields[4]);
+            } else if (fields.size() >= 2 && !entries.empty() && (fields[0] == "add" || fields[0] == "flag")) {
+                auto keyValue = splitFields(line, 2);
+                (fields[0] == "add" ? entries.back().addedModules : entries.back().flags).emplace_back(keyValue[1]);
+            } else if (fields.size() >= 2 && !entries.empty() && fields[0] == "description") {
+                entries.back().description = splitFields(line, 2)[1];
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static int64_t getIgnoreMtime(const fs::path &root) {
+        int64_t mtime = MISSING_MTIME;
+        getModificationTime(ModuleManager::getIgnoreFilePath(root), mtime, nullptr);
+        return mtime;
+    }
+
+    std::vector<ModuleIndexEntry> updateModuleIndex(const fs::path &root, const ModulePaths &modules, const std::vector<fs::path> &directories) {
+        ModuleIndex index;
+        index.ignoreMtime = getIgnoreMtime(root);
+        index.directories.reserve(directories.size());
+        for (auto& directory : directories) {
+            IndexedDirectory& indexed = index.directories.emplace_back();
+            indexed.path = directory;
+            getModificationTime(directory, indexed.mtime, nullptr);
+        }
+
+        std::vector<ModuleIndexEntry>& entries = index.entries;
+        entries.reserve(modules.size());
+        for (auto& [name, path] : modules) entries.push_back(scanModuleSource(name, path));
+        std::sort(entries.begin(), entries.end(), [](const ModuleIndexEntry &a, const ModuleIndexEntry &b) {
+            return a.name < b.name;
+        });
+
+        // Literals that aren't module names are dropped, RDM_AddModules often builds its list with other strings
+        for (auto& entry : entries) {
+            std::erase_if(entry.addedModules, [&modules](const std::string &module) {
+                return !modules.contains(module);
+            });
+        }
+
+        saveModuleIndex(root, index);
+        return entries;
+    }
+
+    std::vector<ModuleIndexEntry> getModuleIndex(const fs::path &root) {
+        int64_t rootMtime = 0;
+        if (!getModificationTime(root, rootMtime, nullptr)) return std::vector<ModuleIndexEntry>();
+
+        ModuleIndex index;
+        bool loaded = false;
+        try {
+            loaded = loadModuleIndex(root, index);
+        } catch (const std::exception&) {
+            // A corrupted number, the index is rebuilt
+        }
+
+        // Only stats, a new file or subdirectory anywhere in the walked tree changes the mtime of its parent
+        bool stale = !loaded || index.directories.empty() || index.ignoreMtime != getIgnoreMtime(root);
+        for (size_t i = 0; i < index.directories.size() && !stale; ++i) {
+            int64_t mtime = 0;
+            stale = !getModificationTime(index.directories[i].path, mtime, nullptr) || mtime != index.directories[i].mtime;
+        }
+
+        std::vector<ModuleIndexEntry>& entries = index.entries;
+        bool changed = false;
+        for (size_t i = 0; i < entries.size() && !stale; ++i) {
+            ModuleIndexEntry& entry = entries[i];
+            int64_t mtime = 0;
+            uint64_t size = 0;
+            if (!getModificationTime(entry.path, mtime, &size)) {
+                stale = true;
+            } else if (mtime != entry.mtime || size != entry.size) {
+                // Only this module was edited, rescanning it is enough
+                entry = scanModuleSource(entry.name, entry.path);
+                std::erase_if(entry.addedModules, [&entries](const std::string &module) {
+                    return std::none_of(entries.begin(), entries.end(), [&module](const ModuleIndexEntry &other) { return other.name == module; });
+                });
+                changed = true;
+            }
+        }
+
+        if (stale) {
+            LOG_DEBUG("Rebuilding the module index of " << root);
+            std::vector<fs::path> directories;
+            ModulePaths modules = ModuleManager::getAvailableModules(root, &directories);
+            return updateModuleIndex(root, modules, directories);
+        }
+        if (changed) saveModuleIndex(root, index);
+        return entries;
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "modules.hpp"
+
+namespace fs = std::filesystem;
+
+namespace rdm {
+    // What completion knows about a module, found by reading its source without running it
+    struct ModuleIndexEntry {
+        std::string name;
+        fs::path path;
+        int64_t mtime = 0;
+        uint64_t size = 0;
+        // Its 'requires' manifest, or the string literals of RDM_AddModules that name other modules
+        std::vector<std::string> addedModules;
+        std::string description;
+        // Literal arguments of FlagIsSet and IsSet calls
+        std::vector<std::string> flags;
+    };
+
+    // Sorted by name, loaded from the cache dir and only rebuilt (by walking root) when it is missing or stale
+    // The index is stale when any walked directory, a known module or the .rdmignore changed, 'rdm list' always rebuilds it
+    std::vector<ModuleIndexEntry> getModuleIndex(const fs::path &root);
+    // directories are the ones the walk that found modules went through
+    std::vector<ModuleIndexEntry> updateModuleIndex(const fs::path &root, const ModulePaths &modules, const std::vector<fs::path> &directories);
+    ModuleIndexEntry scanModuleSource(const std::string &name, const fs::path &path);
+}
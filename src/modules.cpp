@@ -1,26 +1,81 @@
 #include "modules.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
 #include "logger.hpp"
 #include "api.hpp"
+#include "bundle.hpp"
+#include "fscache.hpp"
+#include "manifest.hpp"
 
 namespace rdm {
     const std::string ModuleManager::MODULE_PREFIX = "rdm-";
     const char* Module::LUA_FILE_DIR = "MODULE_ROOT";
 
-    ModulePaths ModuleManager::s_availableModules;
-    std::unordered_set<std::string> ModuleManager::s_userModules;
-    std::unordered_set<std::string> ModuleManager::s_queuedModules;
-    std::unordered_set<std::string> ModuleManager::s_userFlags;
-    fs::path Module::s_currentlyExecutingFile;
+    using LimitUnits = NameTable<double, 4>;
+    static constexpr LimitUnits INSTRUCTION_UNITS = {{ { "", 1 }, { "k", 1e3 }, { "M", 1e6 }, { "G", 1e9 } }};
+    static constexpr LimitUnits TIMEOUT_UNITS = {{ { "", 1000 }, { "s", 1000 }, { "ms", 1 }, { "m", 60000 } }};
+
+    // The budget is checked every few instructions, checking it on every one would slow down all modules
+    static constexpr int BUDGET_HOOK_INTERVAL = 1000;
+    // Only its address is used, as the registry key of the budget of a lua_State
+    static const char BUDGET_REGISTRY_KEY = 0;
+    static const char MODULE_REGISTRY_KEY = 0;
+
+    static void budgetHook(lua_State* L, lua_Debug*) {
+        lua_rawgetp(L, LUA_REGISTRYINDEX, &BUDGET_REGISTRY_KEY);
+        LuaBudget* budget = static_cast<LuaBudget*>(lua_touserdata(L, -1));
+        lua_pop(L, 1);
+        if (budget == nullptr) return;
+
+        const LuaLimits& limits = budget->limits;
+        if (limits.instructions != 0) {
+            if (budget->instructionsLeft <= BUDGET_HOOK_INTERVAL) {
+                budget->exceeded = true;
+                luaL_error(L, "Ran over the budget of %llu instructions", static_cast<unsigned long long>(limits.instructions));
+            }
+            budget->instructionsLeft -= BUDGET_HOOK_INTERVAL;
+        }
+        if (limits.timeout.count() != 0 && std::chrono::steady_clock::now() >= budget->deadline) {
+            budget->exceeded = true;
+            luaL_error(L, "Ran over the timeout of %.3fs", limits.timeout.count() / 1000.0);
+        }
+    }
+
+    // Message handler of every call into a module, so errors tell where they happened
+    static int addTraceback(lua_State* L) {
+        const char* message = lua_tostring(L, 1);
+        luaL_traceback(L, L, message != nullptr ? message : luaL_tolstring(L, 1, nullptr), 1);
+        return 1;
+    }
+
+    // Accepts a number with one of the units, e.g. '500k' instructions or '1.5' seconds
+    // The result must be below max (a power of two, exact as a double), so it always fits the integer it is converted to
+    static bool parseLimit(const std::string &value, const LimitUnits &units, double max, double &result) {
+        char* end = nullptr;
+        double number = std::strtod(value.c_str(), &end);
+        // The unit is looked up with the whole rest of the string, '10sx' has no unit
+        std::optional<double> unit = findByName(units, end);
+        if (end == value.c_str() || !std::isfinite(number) || !(number >= 0) || !unit.has_value()) return false;
+        result = number * *unit;
+        return result < max;
+    }
 
     FileData::FileData(const std::string &content) {
         m_dataType = FileDataType::Text;
-        m_content = content;
+        m_content = std::make_shared<const std::string>(content);
     }
 
+    FileData::FileData(std::shared_ptr<const std::string> content) : m_content(std::move(content)), m_dataType(FileDataType::Text) {}
+
     FileData::FileData(const fs::path &path, FileDataType dataType) : m_dataType(dataType) {
         if (dataType == FileDataType::Text) {
-            m_content = std::string(path);
+            m_content = std::make_shared<const std::string>(path.string());
         } else {
             m_filePath = path;
         }
@@ -31,18 +86,21 @@ namespace rdm {
         m_isExecutable = other.m_isExecutable;
         m_execPattern = other.m_execPattern;
         other.m_execPattern = std::string();
+        m_ignorePatterns = std::move(other.m_ignorePatterns);
+        m_modeRules = std::move(other.m_modeRules);
+        m_mode = other.m_mode;
         
         if (other.m_dataType == FileDataType::Text) {
-            m_content = other.m_content;
-            other.m_content = std::string();
+            m_content = std::move(other.m_content);
         } else {
             m_filePath = other.m_filePath;
             other.m_filePath = fs::path();
         }
     }
 
-    std::string FileData::getContent() const {
-    return m_dataType == FileDataType::Text ? std::get<std::string>(m_content) : std::string();
+    const std::string& FileData::getContent() const {
+        static const std::string empty;
+        return m_dataType == FileDataType::Text && m_content != nullptr ? *m_content : empty;
     }
 
     fs::path FileData::getPath() const {
@@ -67,10 +125,68 @@ namespace rdm {
         return m_execPattern;
     }
 
-    Module::Module(const fs::path &modulePath, const fs::path &destinationRoot)
+    const std::vector<std::string>& FileData::getIgnorePatterns() const {
+        return m_ignorePatterns;
+    }
+
+    void FileData::addIgnorePattern(const std::string &pattern) {
+        m_ignorePatterns.push_back(pattern);
+    }
+
+    std::optional<unsigned> FileData::getMode() const {
+        return m_mode;
+    }
+
+    void FileData::setMode(unsigned mode) {
+        m_mode = mode;
+    }
+
+    const std::vector<ModeRule>& FileData::getModeRules() const {
+        return m_modeRules;
+    }
+
+    void FileData::addModeRule(const std::string &pattern, unsigned mode) {
+        m_modeRules.push_back({ pattern, mode });
+    }
+
+    // Descriptors get exec, ignore and mode from their metatable, only the values set by calling them are wanted
+    static int getDescriptorField(lua_State* L, int index, const char* key) {
+        index = lua_absindex(L, index);
+        lua_pushstring(L, key);
+        lua_rawget(L, index);
+        return lua_type(L, -1);
+    }
+
+    // The 'mode' and 'modes' fields set by :mode(), already validated by it
+    static void readDescriptorModes(lua_State* L, int descriptor, const std::string &moduleName, const std::string &key, FileData &data) {
+        if (getDescriptorField(L, descriptor, "mode") == LUA_TNUMBER) data.setMode(static_cast<unsigned>(lua_tointeger(L, -1)));
+        lua_pop(L, 1);
+
+        int modesFieldType = getDescriptorField(L, descriptor, "modes");
+        if (modesFieldType == LUA_TTABLE && data.getDataType() == FileDataType::Directory) {
+            lua_Integer length = luaL_len(L, -1);
+            for (lua_Integer i = 1; i <= length; ++i) {
+                if (lua_rawgeti(L, -1, i) == LUA_TTABLE) {
+                    lua_getfield(L, -1, "pattern");
+                    lua_getfield(L, -2, "mode");
+                    if (lua_isstring(L, -2) && lua_isnumber(L, -1)) data.addModeRule(lua_tostring(L, -2), static_cast<unsigned>(lua_tointeger(L, -1)));
+                    lua_pop(L, 2);
+                }
+                lua_pop(L, 1);
+            }
+        } else if (modesFieldType != LUA_TNIL) {
+            LOG_CUSTOM_ERR(moduleName, "Invalid mode rules for file " << key << ": Only directories can set modes by pattern");
+        }
+        lua_pop(L, 1);
+    }
+
+    Module::Module(const fs::path &modulePath, const fs::path &destinationRoot, const ModuleManager &manager)
     : m_modulePath(modulePath)
     , m_destinationRoot(destinationRoot)
-    , m_name(Module::getNameFromPath(modulePath)) {
+    , m_name(Module::getNameFromPath(modulePath))
+    , m_manager(&manager)
+    , m_budget(std::make_unique<LuaBudget>()) {
+        m_budget->limits = manager.getLuaLimits(m_name);
         this->setupLuaState();
     }
 
@@ -78,10 +194,16 @@ namespace rdm {
     : m_modulePath(std::move(other.m_modulePath))
     , m_destinationRoot(std::move(other.m_destinationRoot))
     , m_name(std::move(other.m_name))
+    , m_manager(other.m_manager)
     , m_state(other.m_state)
     , m_luaExitCode(other.m_luaExitCode)
-    , m_luaErrorString(std::move(other.m_luaErrorString)) {
+    , m_luaErrorString(std::move(other.m_luaErrorString))
+    , m_budget(std::move(other.m_budget)) {
         other.m_state = nullptr;
+        if (m_state != nullptr) {
+            lua_pushlightuserdata(m_state, this);
+            lua_rawsetp(m_state, LUA_REGISTRYINDEX, &MODULE_REGISTRY_KEY);
+        }
     }
     
     Module::~Module() { if (m_state != nullptr) lua_close(m_state); }
@@ -94,9 +216,12 @@ namespace rdm {
         return m_luaErrorString;
     }
 
+    bool Module::wasAborted() const {
+        return m_budget->exceeded;
+    }
+
     std::optional<FileContentMap> Module::getGeneratedFiles() {
         if (m_luaExitCode != LUA_OK) return std::optional<FileContentMap>();
-        s_currentlyExecutingFile = m_modulePath;
         LOG_CUSTOM_DEBUG(m_name, "Started generating files");
         lua_State* L = m_state;
         if (lua_getglobal(L, "RDM_GetFiles") != LUA_TFUNCTION) {
@@ -104,11 +229,8 @@ namespace rdm {
             return std::optional<FileContentMap>();
         }
 
-        m_luaExitCode = lua_pcall(L, 0, 1, 0);
-        if (m_luaExitCode != LUA_OK) {
-            m_luaErrorString = lua_tostring(m_state, -1);
-            return std::optional<FileContentMap>();
-        }
+        m_luaExitCode = protectedCall("RDM_GetFiles", 0, 1);
+        if (m_luaExitCode != LUA_OK) return std::optional<FileContentMap>();
 
         if (!lua_istable(L, -1)) return std::optional<FileContentMap>();
 
@@ -118,7 +240,7 @@ namespace rdm {
         while (lua_next(L, -2)) {
             if (lua_isstring(L, -2)) {
                 std::string key = lua_tostring(L, -2);
-                fs::path userPath = m_destinationRoot / key;
+                fs::path userPath = (m_destinationRoot / key).lexically_normal();
                 if (!isAllowedPath(m_destinationRoot, userPath, false)) {
                     LOG_CUSTOM_ERR(m_name, "Tried to add a file to an invalid location: " << key);
                     lua_pop(L, 1);
@@ -127,9 +249,13 @@ namespace rdm {
 
                 if (lua_isstring(L, -1)) {
                     FileData value(lua_tostring(L, -1));
-                    files.emplace(userPath, std::move(value)); // FIXME: What if the same file is specified twice? (relative paths)
+                    addGeneratedFile(files, userPath, std::move(value));
                     LOG_CUSTOM_DEBUG(m_name, "Added text file");
                 }
+                else if (std::shared_ptr<const std::string> buffer = getBufferContent(L, -1)) {
+                    addGeneratedFile(files, userPath, FileData(std::move(buffer)));
+                    LOG_CUSTOM_DEBUG(m_name, "Added text file from a buffer");
+                }
                 else if (lua_istable(L, -1)) {
                     LOG_CUSTOM_DEBUG(m_name, "Found FileDescriptor");
                     if (lua_getfield(L, -1, "type") == LUA_TSTRING) {
@@ -142,39 +268,56 @@ namespace rdm {
                                 FileData data(fs::path(lua_tostring(L, -1)), fileDataType);
                                 LOG_CUSTOM_DEBUG(m_name, "Added file with type " << dataType);
 
-                                int execFieldType = lua_getfield(L, -3, "exec");
-                                if (execFieldType != LUA_TNIL) {
-                                    if (execFieldType == LUA_TSTRING || execFieldType == LUA_TBOOLEAN) {
-                                        data.setExecutable(true);
-                                    }
+                                int execFieldType = getDescriptorField(L, -3, "exec");
+                                if (execFieldType == LUA_TSTRING || execFieldType == LUA_TBOOLEAN) {
+                                    data.setExecutable(execFieldType == LUA_TSTRING || lua_toboolean(L, -1));
                                     if (execFieldType == LUA_TSTRING) {
                                         data.setExecutableRules(lua_tostring(L, -1));
                                     }
-                                } else {
+                                } else if (execFieldType != LUA_TNIL) {
                                     LOG_CUSTOM_ERR(m_name, "Invalid exec value for file " << key << ": Not a pattern");
                                 }
+                                lua_pop(L, 1);
+
+                                int ignoreFieldType = getDescriptorField(L, -3, "ignore");
+                                if (ignoreFieldType == LUA_TTABLE && fileDataType == FileDataType::Directory) {
+                                    lua_Integer length = luaL_len(L, -1);
+                                    for (lua_Integer i = 1; i <= length; ++i) {
+                                        if (lua_rawgeti(L, -1, i) == LUA_TSTRING) data.addIgnorePattern(lua_tostring(L, -1));
+                                        lua_pop(L, 1);
+                                    }
+                                } else if (ignoreFieldType != LUA_TNIL) {
+                                    LOG_CUSTOM_ERR(m_name, "Invalid ignore value for file " << key << ": Only directories can ignore files");
+                                }
+                                lua_pop(L, 1);
+                                readDescriptorModes(L, lua_absindex(L, -3), m_name, key, data);
 
-                                files.emplace(userPath, std::move(data)); // FIXME: What if the same file is specified twice? (relative paths)
+                                addGeneratedFile(files, userPath, std::move(data));
                             } else {
                                 LOG_CUSTOM_ERR(m_name, "Invalid value for file " << key << ": Invalid or non-present path");
                             }
-                            lua_pop(L, 2);
+                            lua_pop(L, 1);
                         } else if (dataType == "string") {
-                            if (lua_getfield(L, -2, "content") == LUA_TSTRING) {
-                                FileData data(lua_tostring(L, -1));
+                            int contentType = lua_getfield(L, -2, "content");
+                            std::shared_ptr<const std::string> buffer = contentType == LUA_TUSERDATA ? getBufferContent(L, -1) : nullptr;
+                            if (contentType == LUA_TSTRING || buffer != nullptr) {
+                                FileData data = buffer != nullptr ? FileData(std::move(buffer)) : FileData(lua_tostring(L, -1));
 
-                                if (lua_getfield(L, -3, "exec") == LUA_TBOOLEAN) {
+                                int execFieldType = getDescriptorField(L, -3, "exec");
+                                if (execFieldType == LUA_TBOOLEAN) {
                                     if (lua_toboolean(L, -1)) data.setExecutable(true);
-                                } else {
+                                } else if (execFieldType != LUA_TNIL) {
                                     LOG_CUSTOM_ERR(m_name, "Invalid exec value for file " << key << ": Not a boolean");
                                 }
+                                lua_pop(L, 1);
+                                readDescriptorModes(L, lua_absindex(L, -3), m_name, key, data);
 
-                                files.emplace(userPath, std::move(data)); // FIXME: What if the same file is specified twice? (relative paths)
+                                addGeneratedFile(files, userPath, std::move(data));
                                 LOG_CUSTOM_DEBUG(m_name, "Added text file");
                             } else {
                                 LOG_CUSTOM_ERR(m_name, "Invalid value for file " << key << ": Invalid content");
                             }
-                            lua_pop(L, 2);
+                            lua_pop(L, 1);
                         } else {
                             LOG_CUSTOM_ERR(m_name, "Invalid value for file " << key << ": Unknown type");
                         }
@@ -183,7 +326,7 @@ namespace rdm {
                     }
                     lua_pop(L, 1);
                 } else {
-                    LOG_CUSTOM_ERR(m_name, "Invalid value for file " << key << ": Not a FileDescriptor or a string");
+                    LOG_CUSTOM_ERR(m_name, "Invalid value for file " << key << ": Not a FileDescriptor, a string or a Buffer");
                 }
             }
             lua_pop(L, 1);
@@ -193,23 +336,37 @@ namespace rdm {
         return std::optional<FileContentMap>(std::move(files));
     }
 
+    void Module::addGeneratedFile(FileContentMap &files, const fs::path &path, FileData &&data) {
+        // Keys are normalized, so 'a/../b' and 'b' end up being the same file
+        if (!files.emplace(path, std::move(data)).second) {
+            LOG_CUSTOM_ERR(m_name, "The file " << path << " was specified more than once, ignoring the duplicate");
+        }
+    }
+
     std::string Module::getPath() const { return m_modulePath; }
 
     std::string Module::getName() const { return m_name; }
 
+    fs::path Module::getDirectory() const { return m_modulePath.parent_path(); }
+
+    const ModuleManager& Module::getManager() const { return *m_manager; }
+
+    lua_State* Module::getState() const { return m_state; }
+
     int Module::setupLuaState() {
-        s_currentlyExecutingFile = m_modulePath;
         m_state = luaL_newstate();
 
         // Still questioning if I should leave this or not
         luaL_openlibs(m_state); // FIXME: Change to only load safe libs (?) maybe allow an --allow-unsafe flag?
 
-        // Modify string metatable to allow execs
+        // Modify string metatable to allow execs and modes
         lua_pushstring(m_state, "string");
         lua_getmetatable(m_state, -1);
         lua_getfield(m_state, -1, "__index");
         lua_pushcfunction(m_state, lapi_stringExec);
         lua_setfield(m_state, -2, "exec");
+        lua_pushcfunction(m_state, lapi_stringMode);
+        lua_setfield(m_state, -2, "mode");
         lua_pop(m_state, 1);
         lua_setmetatable(m_state, -2);
         lua_pop(m_state, 1);
@@ -217,7 +374,11 @@ namespace rdm {
         // Globals
         lua_pushstring(m_state, m_modulePath.parent_path().c_str());
         lua_setglobal(m_state, LUA_FILE_DIR);
+        lua_register(m_state, "print", lapi_Print);
         lua_register(m_state, "Read", lapi_Read);
+        lua_register(m_state, "ReadLines", lapi_ReadLines);
+        lua_register(m_state, "ReadChunks", lapi_ReadChunks);
+        lua_register(m_state, "Buffer", lapi_Buffer);
         lua_register(m_state, "FlagIsSet", lapi_FlagIsSet);
         lua_register(m_state, "ModuleIsSet", lapi_ModuleIsSet);
         lua_register(m_state, "IsSet", lapi_IsSet);
@@ -226,9 +387,38 @@ namespace rdm {
         lua_register(m_state, "Spawn", lapi_Spawn);
         lua_register(m_state, "File", lapi_File);
         lua_register(m_state, "Directory", lapi_Directory);
-
-        m_luaExitCode = luaL_dofile(m_state, m_modulePath.c_str());
-        if (m_luaExitCode != LUA_OK) {
+        lua_register(m_state, "Glob", lapi_Glob);
+        lua_register(m_state, "ListDir", lapi_ListDir);
+        lua_register(m_state, "Stat", lapi_Stat);
+        registerConfigLibraries(m_state);
+
+        lua_pushlightuserdata(m_state, m_budget.get());
+        lua_rawsetp(m_state, LUA_REGISTRYINDEX, &BUDGET_REGISTRY_KEY);
+        #ifdef RDM_LUAJIT
+        // Compiled traces never call the hook, modules with limits are interpreted so the limits still hold
+        const LuaLimits& limits = m_budget->limits;
+        if (limits.instructions != 0 || limits.timeout.count() != 0) luaJIT_setmode(m_state, 0, LUAJIT_MODE_ENGINE | LUAJIT_MODE_OFF);
+        #endif
+        lua_pushlightuserdata(m_state, this);
+        lua_rawsetp(m_state, LUA_REGISTRYINDEX, &MODULE_REGISTRY_KEY);
+
+        Bundle* bundle = Bundle::getActive();
+        if (bundle != nullptr && bundle->contains(m_modulePath)) {
+            const BundleEntry* entry = bundle->findModule(m_modulePath);
+            if (entry == nullptr) {
+                lua_pushstring(m_state, "Module bytecode not found in bundle");
+                m_luaExitCode = LUA_ERRFILE;
+            } else {
+                std::string_view bytecode = bundle->getData(*entry);
+                std::string chunkName = "@" + m_modulePath.string();
+                m_luaExitCode = luaL_loadbufferx(m_state, bytecode.data(), bytecode.size(), chunkName.c_str(), "b");
+            }
+        } else {
+            m_luaExitCode = luaL_loadfile(m_state, m_modulePath.c_str());
+        }
+        if (m_luaExitCode == LUA_OK) {
+            m_luaExitCode = protectedCall("the module", 0, LUA_MULTRET);
+        } else {
             m_luaErrorString = lua_tostring(m_state, -1);
         }
         return m_luaExitCode;
@@ -238,14 +428,16 @@ namespace rdm {
         return path.stem().string().substr(ModuleManager::MODULE_PREFIX.length());
     }
 
-    fs::path Module::getCurrentlyExecutingFile() {
-        return s_currentlyExecutingFile;
+    Module* Module::fromState(lua_State* L) {
+        lua_rawgetp(L, LUA_REGISTRYINDEX, &MODULE_REGISTRY_KEY);
+        Module* module = static_cast<Module*>(lua_touserdata(L, -1));
+        lua_pop(L, 1);
+        return module;
     }
 
     std::unordered_set<std::string> Module::getExtraModules() {
         std::unordered_set<std::string> extraModules;
          if (m_luaExitCode != LUA_OK) return extraModules;
-        s_currentlyExecutingFile = m_modulePath;
         lua_State* L = m_state;
 
         LOG_CUSTOM_DEBUG(m_name, "Fetching extra modules");
@@ -256,9 +448,8 @@ namespace rdm {
             return extraModules;
         }
 
-        m_luaExitCode = lua_pcall(L, 0, 1, 0);
+        m_luaExitCode = protectedCall("RDM_AddModules", 0, 1);
         if (m_luaExitCode != LUA_OK) {
-            m_luaErrorString = lua_tostring(m_state, -1);
             LOG_CUSTOM_INFO(m_name, "No extra modules requested");
             return extraModules;
         }
@@ -283,30 +474,48 @@ namespace rdm {
     }
 
     bool Module::runInit() {
-        s_currentlyExecutingFile = m_modulePath;
         return callLuaMethod("RDM_Init");
     }
 
     bool Module::runDelayed() {
-        s_currentlyExecutingFile = m_modulePath;
         return callLuaMethod("RDM_Delayed");
     }
 
     bool Module::callLuaMethod(const std::string &name) {
         if (m_luaExitCode != LUA_OK) return false;
         if (lua_getglobal(m_state, name.c_str()) == LUA_TFUNCTION) {
-            m_luaExitCode = lua_pcall(m_state, 0, 0, 0);
-            if (m_luaExitCode != LUA_OK) {
-                m_luaErrorString = lua_tostring(m_state, -1);
-                return false;
-            }
-            return true;
+            m_luaExitCode = protectedCall(name.c_str(), 0, 0);
+            return m_luaExitCode == LUA_OK;
         } else {
             lua_pop(m_state, 1);
             return false;
         }
     }
 
+    // lua_pcall within the budget of the module, the function and its arguments must already be on the stack
+    int Module::protectedCall(const char* name, int argumentCount, int resultCount) {
+        const int handlerIndex = lua_gettop(m_state) - argumentCount;
+        lua_pushcfunction(m_state, addTraceback);
+        lua_insert(m_state, handlerIndex);
+
+        const LuaLimits& limits = m_budget->limits;
+        m_budget->exceeded = false;
+        if (limits.instructions != 0 || limits.timeout.count() != 0) {
+            m_budget->instructionsLeft = limits.instructions;
+            m_budget->deadline = std::chrono::steady_clock::now() + limits.timeout;
+            // Setting the hook again also restarts its instruction count
+            lua_sethook(m_state, budgetHook, LUA_MASKCOUNT, BUDGET_HOOK_INTERVAL);
+        }
+
+        int status = lua_pcall(m_state, argumentCount, resultCount, handlerIndex);
+        lua_remove(m_state, handlerIndex);
+        if (status != LUA_OK) {
+            m_luaErrorString = lua_tostring(m_state, -1);
+            if (m_budget->exceeded) LOG_CUSTOM_ERR(m_name, "Aborted while running " << name << ", the rest of the module is skipped: " << m_luaErrorString);
+        }
+        return status;
+    }
+
 
     ModuleManager::ModuleManager(const fs::path &root, const fs::path &destinationRoot)
     : m_root(root)
@@ -319,25 +528,55 @@ namespace rdm {
     : m_root(root)
     , m_destinationRoot(destinationRoot)
     {
-        ModuleManager::s_queuedModules = std::unordered_set<std::string>();
-        ModuleManager::s_userFlags = std::unordered_set<std::string>();
-
-        s_userFlags.reserve(maf.flags.size());
+        m_userFlags.reserve(maf.flags.size());
         for (auto& flag : maf.flags) {
-            s_userFlags.insert(flag);
+            m_userFlags.insert(flag);
         }
 
-        s_userModules.reserve(maf.modules.size());
-        s_queuedModules.reserve(maf.modules.size());
+        m_userModules.reserve(maf.modules.size());
+        m_queuedModules.reserve(maf.modules.size());
         for (auto& module : maf.modules) {
-            s_queuedModules.insert(module);
+            m_queuedModules.insert(module);
+        }
+
+        // Values are either global ('10') or for a single module ('wallpapers=60')
+        auto parseLimits = [this, &maf](Option option, bool perModule, const LimitUnits &units, double max, auto setLimit) {
+            if (!maf.programOptions.contains(option)) return;
+            for (auto& value : maf.programOptions.at(option)) {
+                size_t separator = value.find('=');
+                if ((separator != std::string::npos) != perModule) continue;
+                double limit;
+                if (!parseLimit(value.substr(perModule ? separator + 1 : 0), units, max, limit)) {
+                    LOG_WARN("Ignoring the invalid Lua limit '" << value << "'");
+                    continue;
+                }
+                if (perModule) {
+                    setLimit(m_moduleLuaLimits.try_emplace(value.substr(0, separator), m_defaultLuaLimits).first->second, limit);
+                } else {
+                    setLimit(m_defaultLuaLimits, limit);
+                }
+            }
+        };
+        // Global limits go first, a module only overrides the limits it names
+        for (bool perModule : { false, true }) {
+            parseLimits(Option::LUA_BUDGET, perModule, INSTRUCTION_UNITS, std::ldexp(1.0, 64), [](LuaLimits &limits, double limit) {
+                limits.instructions = static_cast<uint64_t>(limit);
+            });
+            // 2^42 ms is over a century and still fits in nanoseconds once added to steady_clock::now()
+            parseLimits(Option::LUA_TIMEOUT, perModule, TIMEOUT_UNITS, std::ldexp(1.0, 42), [](LuaLimits &limits, double limit) {
+                limits.timeout = std::chrono::milliseconds(static_cast<int64_t>(limit));
+            });
         }
         this->refreshModules();
     }
 
     void ModuleManager::refreshModules() {
-        s_availableModules = ModuleManager::getAvailableModules(m_root);
-        m_modules = ModuleManager::getModules(m_root, m_destinationRoot);
+        // Sources may have changed since the last run on this thread
+        clearDirectoryCache();
+        m_availableModules = ModuleManager::getAvailableModules(m_root);
+        m_modules = ModuleList();
+        m_modules.reserve(m_queuedModules.size());
+        resolveModules();
     }
 
     ModuleList& ModuleManager::getModules() {
@@ -345,80 +584,107 @@ namespace rdm {
     }
 
     ModulePaths& ModuleManager::getAvailableModules() {
-        return s_availableModules;
+        return m_availableModules;
     }
 
-    ModulePaths ModuleManager::getAvailableModules(const fs::path &root) {
+    // Nothing under them can be a module, they are never walked
+    static const std::vector<std::string> DEFAULT_DISCOVERY_IGNORES = { ".git/", ".hg/", ".svn/", "node_modules/", "__pycache__/", ".venv/" };
+
+    // The defaults plus the gitignore-like lines of the .rdmignore next to root, '#' starts a comment
+    static PathFilter getDiscoveryFilter(const fs::path &root) {
+        std::vector<std::string> patterns = DEFAULT_DISCOVERY_IGNORES;
+        std::ifstream ignoreFile(ModuleManager::getIgnoreFilePath(root));
+        std::string line;
+        while (std::getline(ignoreFile, line)) {
+            trim(line);
+            if (!line.empty() && !line.starts_with('#')) patterns.push_back(line);
+        }
+        return PathFilter(patterns);
+    }
+
+    fs::path ModuleManager::getIgnoreFilePath(const fs::path &root) {
+        return root.parent_path() / ".rdmignore";
+    }
+
+    ModulePaths ModuleManager::getAvailableModules(const fs::path &root, std::vector<fs::path>* directories) {
         ModulePaths modules;
         modules.reserve(32);
 
-        for (auto& file : fs::directory_iterator(root)) {
-            auto filePath = file.path();
-            if (file.is_directory()) {
-                ModulePaths nestedModules = ModuleManager::getAvailableModules(filePath);
-                modules.reserve(nestedModules.size());
-                modules.merge(nestedModules);
-            } else {
-                std::string fileName = filePath.filename();
-                if (fileName.starts_with(MODULE_PREFIX) && fileName.ends_with(".lua")) {
-                    modules.emplace(Module::getNameFromPath(filePath), filePath);
-                }
+        Bundle* bundle = Bundle::getActive();
+        if (bundle != nullptr && bundle->contains(root)) {
+            for (auto& modulePath : bundle->getModulePaths()) {
+                modules.emplace(Module::getNameFromPath(modulePath), modulePath);
             }
+            return modules;
         }
 
-        return modules;
-    }
-
-    ModuleList ModuleManager::getModules(const fs::path &root, const fs::path &destinationRoot) {
-        ModuleList modules;
-        modules.reserve(s_queuedModules.size());
+        auto modulePaths = findFilesParallel(root, getDiscoveryFilter(root), [](const fs::path &path) {
+            std::string fileName = path.filename();
+            return fileName.starts_with(MODULE_PREFIX) && fileName.ends_with(".lua");
+        }, directories);
 
-        updateModuleList(root, destinationRoot, modules);
+        // The walk order changes from run to run, the first path in sorted order always wins a duplicated name
+        std::sort(modulePaths.begin(), modulePaths.end());
+        for (auto& modulePath : modulePaths) {
+            auto [module, inserted] = modules.emplace(Module::getNameFromPath(modulePath), modulePath);
+            if (!inserted) LOG_WARN("The module '" << module->first << "' is defined twice, using " << module->second << " over " << modulePath);
+        }
 
         return modules;
     }
 
-    bool ModuleManager::updateModuleList(const fs::path &root, const fs::path &destinationRoot, ModuleList &moduleList) {
-        std::unordered_set<std::string> newQueueItems;
-        for (auto& moduleName : s_queuedModules) {
-            if (s_availableModules.contains(moduleName) && !moduleList.contains(moduleName)) {
-                LOG_DEBUG("Started processing " << moduleName);
-                Module module = Module(s_availableModules.at(moduleName), destinationRoot);
-                auto extraModules = module.getExtraModules();
-                moduleList.emplace(moduleName, std::move(module));
-
-                if (!extraModules.empty()) {
-                    for (auto& extraName : extraModules) {
-                        if (!s_queuedModules.contains(extraName) && !moduleList.contains(extraName)) {
-                            LOG_DEBUG("Queued " << extraName << " for processing");
-                            newQueueItems.insert(extraName);
-                        }
-                    }
-                } else {
-                    LOG_DEBUG("No extra modules queued");
-                }
+    // The closure is built before any module runs, only modules without a 'requires' manifest have to be loaded to know what they add
+    void ModuleManager::resolveModules() {
+        std::vector<std::string> pending(m_queuedModules.begin(), m_queuedModules.end());
+        std::unordered_set<std::string> visited;
+        std::vector<std::string> declaredModules;
+        while (!pending.empty()) {
+            std::string moduleName = std::move(pending.back());
+            pending.pop_back();
+            if (!visited.insert(moduleName).second || !m_availableModules.contains(moduleName)) continue;
+
+            LOG_DEBUG("Started processing " << moduleName);
+            const fs::path& modulePath = m_availableModules.at(moduleName);
+            ModuleManifest manifest = readModuleManifest(modulePath);
+            std::vector<std::string> extraModules;
+            if (manifest.declaresRequires) {
+                extraModules = std::move(manifest.requiredModules);
+                declaredModules.push_back(moduleName);
+            } else {
+                Module module = Module(modulePath, m_destinationRoot, *this);
+                auto addedModules = module.getExtraModules();
+                extraModules.assign(addedModules.begin(), addedModules.end());
+                m_modules.emplace(moduleName, std::move(module));
+            }
 
-                s_userModules.insert(moduleName);
-                LOG_DEBUG("Finished processing " << moduleName);
+            for (auto& extraName : extraModules) {
+                if (visited.contains(extraName)) continue;
+                LOG_DEBUG("Queued " << extraName << " for processing");
+                pending.push_back(extraName);
             }
+            if (extraModules.empty()) LOG_DEBUG("No extra modules queued");
+
+            m_userModules.insert(moduleName);
+            LOG_DEBUG("Finished processing " << moduleName);
         }
+        m_queuedModules.clear();
 
-        s_queuedModules = newQueueItems;
-        if (!s_queuedModules.empty()) {
-            updateModuleList(root, destinationRoot, moduleList);
-            return true;
+        // Loaded once the closure is known, so their ModuleIsSet calls already see every module of the run
+        for (auto& moduleName : declaredModules) {
+            m_modules.emplace(std::piecewise_construct, std::forward_as_tuple(moduleName), std::forward_as_tuple(m_availableModules.at(moduleName), m_destinationRoot, *this));
         }
-        return false;
     }
 
     FileContentMap ModuleManager::getGeneratedFiles() {
         FileContentMap files;
 
-        for (auto& pair : m_modules) {
-            auto files = pair.second.getGeneratedFiles();
-            if (!files.has_value()) continue;
-            for (auto& fileKV : files.value()) {
-                files.value().emplace(fileKV.first, std::move(fileKV.second)); // FIXME: What if the same file is specified twice?
+        for (auto& [name, module] : m_modules) {
+            auto moduleFiles = module.getGeneratedFiles();
+            if (!moduleFiles.has_value()) continue;
+            for (auto& fileKV : moduleFiles.value()) {
+                if (!files.emplace(fileKV.first, std::move(fileKV.second)).second) {
+                    LOG_CUSTOM_ERR(name, "The file " << fileKV.first << " was already specified by another module, ignoring it");
+                }
             }
         }
         
@@ -437,15 +703,20 @@ namespace rdm {
         }
     }
 
-    bool ModuleManager::isFlagSet(const std::string &flag) {
-        return s_userFlags.contains(flag);
+    bool ModuleManager::isFlagSet(const std::string &flag) const {
+        return m_userFlags.contains(flag);
+    }
+
+    LuaLimits ModuleManager::getLuaLimits(const std::string &module) const {
+        auto limits = m_moduleLuaLimits.find(module);
+        return limits != m_moduleLuaLimits.end() ? limits->second : m_defaultLuaLimits;
     }
 
-    bool ModuleManager::shouldProcessAllModules() {
-        return s_userModules.empty() && s_queuedModules.empty();
+    bool ModuleManager::shouldProcessAllModules() const {
+        return m_userModules.empty() && m_queuedModules.empty();
     }
 
-    bool ModuleManager::shouldProcessModule(const std::string &module) {
-        return shouldProcessAllModules() || s_userModules.contains(module);
+    bool ModuleManager::shouldProcessModule(const std::string &module) const {
+        return shouldProcessAllModules() || m_userModules.contains(module);
     }
 }
\ No newline at end of file
@@ -1,12 +1,15 @@
 #pragma once
 
+#include <chrono>
+#include <cstdint>
 #include <unordered_set>
 #include <unordered_map>
 #include <filesystem>
-#include <lua.hpp>
+#include "luacompat.hpp"
 #include <vector>
 #include <variant>
 #include <optional>
+#include <memory>
 #include "utils.hpp"
 
 namespace fs = std::filesystem;
@@ -19,36 +22,69 @@ namespace rdm {
         Directory
     };
 
+    // A :mode(mode, pattern) of a Directory, matched like the ignore patterns
+    struct ModeRule {
+        std::string pattern;
+        unsigned mode;
+    };
+
     struct FileData {
         FileData(const std::string &content);
+        // Shares the content of a Buffer instead of copying it
+        FileData(std::shared_ptr<const std::string> content);
         FileData(const fs::path &path, FileDataType dataType);
         FileData(FileData&& other);
         FileData(FileData& other) = delete;
-        std::string getContent() const;
+        const std::string& getContent() const;
         fs::path getPath() const;
         FileDataType getDataType() const;
         bool isExecutable() const;
         std::string getExecutablePattern() const;
         void setExecutable(bool executable);
         void setExecutableRules(const std::string &pattern);
+        const std::vector<std::string>& getIgnorePatterns() const;
+        void addIgnorePattern(const std::string &pattern);
+        // Exact permissions given with :mode(), empty to keep the default ones
+        std::optional<unsigned> getMode() const;
+        void setMode(unsigned mode);
+        const std::vector<ModeRule>& getModeRules() const;
+        void addModeRule(const std::string &pattern, unsigned mode);
 
         private:
-        std::variant<std::string, fs::path> m_content, m_filePath;
+        std::shared_ptr<const std::string> m_content;
+        std::variant<std::string, fs::path> m_filePath;
         FileDataType m_dataType;
         std::string m_execPattern;
+        std::vector<std::string> m_ignorePatterns;
+        std::vector<ModeRule> m_modeRules;
+        std::optional<unsigned> m_mode;
         bool m_isExecutable = false;
     };
 
+    // Limits for a single call into a module (loading it, RDM_Init, RDM_GetFiles...), zero means unlimited
+    struct LuaLimits {
+        uint64_t instructions = 0;
+        std::chrono::milliseconds timeout{0};
+    };
+
+    struct LuaBudget {
+        LuaLimits limits;
+        uint64_t instructionsLeft = 0;
+        std::chrono::steady_clock::time_point deadline;
+        bool exceeded = false;
+    };
+
     using FileContentMap = std::unordered_map<std::string, FileData>;
     using FileList = std::vector<fs::path>;
 
     class Module;
+    class ModuleManager;
     using ModuleList = std::unordered_map<std::string, Module>;
     using ModulePaths = std::unordered_map<std::string, fs::path>;
     
     class Module {
         public:
-        Module(const fs::path &path, const fs::path &destinationRoot);
+        Module(const fs::path &path, const fs::path &destinationRoot, const ModuleManager &manager);
         Module(Module&& other);
         Module(Module& other) = delete;
         Module& operator=(const Module&) = delete;
@@ -60,33 +96,46 @@ namespace rdm {
         int getExitCode() const;
         std::string getErrorString() const;
         std::string getName() const;
+        // The directory of the module, where Read, Glob and the descriptors resolve their paths
+        fs::path getDirectory() const;
+        const ModuleManager& getManager() const;
+        // For embedders registering functions of their own, the state is closed with the module
+        lua_State* getState() const;
+        bool wasAborted() const;
         ~Module();
 
         static std::string getNameFromPath(const fs::path &path);
-        static fs::path getCurrentlyExecutingFile();
+        // The module owning L, for the API functions it calls
+        static Module* fromState(lua_State* L);
 
-        
         private:
         int setupLuaState();
         bool callLuaMethod(const std::string &name);
-        
-        static fs::path s_currentlyExecutingFile;
-        
+        int protectedCall(const char* name, int argumentCount, int resultCount);
+        void addGeneratedFile(FileContentMap &files, const fs::path &path, FileData &&data);
+
         const fs::path m_modulePath;
         const fs::path m_destinationRoot;
         const std::string m_name;
+        const ModuleManager* m_manager;
 
         lua_State* m_state;
         int m_luaExitCode;
         std::string m_luaErrorString;
+        // Kept on the heap so the hook can still find it after the module is moved
+        std::unique_ptr<LuaBudget> m_budget;
 
         static const char* LUA_FILE_DIR;
     };
 
+    // The state of one run (the modules, flags and limits asked for), runs with different managers don't share anything
     class ModuleManager {
         public:
         ModuleManager(const fs::path &root, const fs::path &destinationRoot);
         ModuleManager(const fs::path &root, const fs::path &destinationRoot, const ModulesAndFlags &maf);
+        // Modules point back to their manager
+        ModuleManager(const ModuleManager&) = delete;
+        ModuleManager& operator=(const ModuleManager&) = delete;
         void refreshModules();
         ModuleList& getModules();
         ModulePaths& getAvailableModules();
@@ -95,21 +144,27 @@ namespace rdm {
         void runInits();
         void runDelayeds();
 
-        static bool shouldProcessAllModules();
-        static bool shouldProcessModule(const std::string &module);
-        static ModuleList getModules(const fs::path &root, const fs::path &destinationRoot);
-        static ModulePaths getAvailableModules(const fs::path &root);
-        static bool isFlagSet(const std::string &flag);
+        bool shouldProcessAllModules() const;
+        bool shouldProcessModule(const std::string &module) const;
+        bool isFlagSet(const std::string &flag) const;
+        LuaLimits getLuaLimits(const std::string &module) const;
+
+        // directories gets every directory the walk went through, to tell later if a module could have been added
+        static ModulePaths getAvailableModules(const fs::path &root, std::vector<fs::path>* directories = nullptr);
+        // The .rdmignore next to root, it prunes the walk
+        static fs::path getIgnoreFilePath(const fs::path &root);
 
         static const std::string MODULE_PREFIX;
         private:
-        static bool updateModuleList(const fs::path &root, const fs::path &destinationRoot, ModuleList &moduleList);
+        void resolveModules();
         const fs::path m_root;
         const fs::path m_destinationRoot;
         ModuleList m_modules;
-        static ModulePaths s_availableModules;
-        static std::unordered_set<std::string> s_userModules;
-        static std::unordered_set<std::string> s_queuedModules;
-        static std::unordered_set<std::string> s_userFlags;
+        ModulePaths m_availableModules;
+        std::unordered_set<std::string> m_userModules;
+        std::unordered_set<std::string> m_queuedModules;
+        std::unordered_set<std::string> m_userFlags;
+        LuaLimits m_defaultLuaLimits;
+        std::unordered_map<std::string, LuaLimits> m_moduleLuaLimits;
     };
 }
\ No newline at end of file
@@ -0,0 +1,202 @@
+#include "ownership.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <string_view>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+#include "logger.hpp"
+#include "utils.hpp"
+
+namespace rdm {
+    static constexpr std::string_view OWNERSHIP_HEADER = "rdm-owners\t1";
+
+    // One file per destination root, named like its backup group ('home', 'filesystem' for / or 'roots/<escaped path>')
+    static fs::path getOwnershipPath(const fs::path &destinationRoot) {
+        fs::path path = getStateDir() / "owners" / getBackupGroup(destinationRoot);
+        path += ".tsv";
+        return path;
+    }
+
+    static int64_t getModificationTime(const struct stat &info) {
+        return static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+    }
+
+    // Splits at most count - 1 tabs, the last field keeps the rest of the line
+    static std::vector<std::string_view> splitFields(std::string_view line, size_t count) {
+        std::vector<std::string_view> fields;
+        while (fields.size() + 1 < count) {
+            size_t tab = line.find('\t');
+            if (tab == std::string_view::npos) break;
+            fields.push_back(line.substr(0, tab));
+            line.remove_prefix(tab + 1);
+        }
+        fields.push_back(line);
+        return fields;
+    }
+
+    static bool readOwnership(const fs::path &destinationRoot, Ownership &ownership) {
+        std::ifstream file(getOwnershipPath(destinationRoot), std::ios::binary);
+        std::string line;
+        if (!std::getline(file, line) || line != OWNERSHIP_HEADER) return false;
+        if (!std::getline(file, line) || line != "root\t" + normalizeRoot(destinationRoot).string()) return false;
+
+        while (std::getline(file, line)) {
+            if (line.starts_with("dir\t")) {
+                ownership.directories.emplace_back(line.substr(4));
+                continue;
+            }
+            auto fields = splitFields(line, 5);
+            if (fields.size() != 5 || fields[0] != "file") return false;
+            OwnedFile& owned = ownership.files.emplace_back();
+            owned.mtime = std::stoll(std::string(fields[1]));
+            owned.size = std::stoull(std::string(fields[2]));
+            owned.module = fields[3];
+            owned.destination = std::string(fields[4]);
+        }
+        return true;
+    }
+
+    static void sortDirectories(std::vector<fs::path> &directories) {
+        std::sort(directories.begin(), directories.end());
+        directories.erase(std::unique(directories.begin(), directories.end()), directories.end());
+    }
+
+    Ownership loadOwnership(const fs::path &destinationRoot) {
+        Ownership ownership;
+        bool loaded = false;
+        try {
+            loaded = readOwnership(destinationRoot, ownership);
+        } catch (const std::exception&) {
+            // A corrupted number
+        }
+        if (!loaded) {
+            if (fs::exists(getOwnershipPath(destinationRoot))) LOG_WARN("Ignoring the unreadable ownership manifest " << getOwnershipPath(destinationRoot));
+            ownership = Ownership();
+        }
+        sortDirectories(ownership.directories);
+        return ownership;
+    }
+
+    bool saveOwnership(const fs::path &destinationRoot, const Ownership &ownership) {
+        fs::path path = getOwnershipPath(destinationRoot);
+        std::error_code error;
+        fs::create_directories(path.parent_path(), error);
+
+        // Written next to the old one and renamed over it, an interrupted apply never loses the manifest
+        fs::path tempPath = path;
+        tempPath += ".tmp";
+        {
+            std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+            file << OWNERSHIP_HEADER << "\nroot\t" << normalizeRoot(destinationRoot).string() << '\n';
+            for (auto& directory : ownership.directories) file << "dir\t" << directory.string() << '\n';
+            for (auto& owned : ownership.files) {
+                file << "file\t" << owned.mtime << '\t' << owned.size << '\t' << owned.module << '\t' << owned.destination.string() << '\n';
+            }
+            if (!file) {
+                LOG_ERR("Couldn't write the ownership manifest " << tempPath);
+                return false;
+            }
+        }
+        fs::rename(tempPath, path, error);
+        if (error) LOG_ERR("Couldn't write the ownership manifest " << path << ": " << error.message());
+        return !error;
+    }
+
+    RemoveResult removeOwnedFile(const fs::path &destinationRoot, const OwnedFile &file, std::vector<fs::path> &directories, const ExecutorOptions &options) {
+        const fs::path path = destinationRoot / file.destination;
+        struct stat info;
+        if (lstat(path.c_str(), &info) != 0) return errno == ENOENT || errno == ENOTDIR ? RemoveResult::Missing : RemoveResult::Failed;
+        if (S_ISDIR(info.st_mode) || getModificationTime(info) != file.mtime || static_cast<uint64_t>(info.st_size) != file.size) {
+            LOG_CUSTOM_WARN(file.module, "Keeping " << path << ", it was modified since rdm wrote it");
+            return RemoveResult::Modified;
+        }
+
+        if (options.replaceMode == ReplaceMode::Backup) {
+            LOG_CUSTOM_INFO(file.module, "Creating backup of " << path);
+            backupEntry(options.backupGroup, destinationRoot, path);
+        }
+        if (unlink(path.c_str()) != 0) {
+            LOG_CUSTOM_ERR(file.module, "Couldn't delete " << path << ": " << std::strerror(errno));
+            return RemoveResult::Failed;
+        }
+        LOG_CUSTOM_INFO(file.module, "Deleted " << path);
+
+        // Directories that existed before rdm wrote into them are the user's, even when empty
+        for (fs::path parent = file.destination.parent_path(); !parent.empty(); parent = parent.parent_path()) {
+            auto directory = std::lower_bound(directories.begin(), directories.end(), parent);
+            if (directory == directories.end() || *directory != parent || rmdir((destinationRoot / parent).c_str()) != 0) break;
+            directories.erase(directory);
+        }
+        return RemoveResult::Deleted;
+    }
+
+    bool updateOwnership(const ApplyPlan &plan, ExecutionReport &report, const fs::path &destinationRoot, const DestinationFilter &filter, bool prune, const ExecutorOptions &options) {
+        std::unordered_set<std::string> appliedModules(plan.getModules().begin(), plan.getModules().end());
+        for (auto& module : plan.getFailedModules()) appliedModules.erase(module);
+
+        std::unordered_map<std::string, const PlanOperation*> plannedFiles;
+        plannedFiles.reserve(plan.getOperations().size());
+        for (auto& operation : plan.getOperations()) plannedFiles.emplace(operation.destination.string(), &operation);
+
+        std::unordered_set<std::string> writtenFiles;
+        for (auto& [module, stats] : report) {
+            for (auto& destination : stats.writtenFiles) writtenFiles.insert(destination.string());
+        }
+
+        Ownership ownership = loadOwnership(destinationRoot);
+        for (auto& [module, stats] : report) {
+            ownership.directories.insert(ownership.directories.end(), stats.createdDirectories.begin(), stats.createdDirectories.end());
+        }
+        sortDirectories(ownership.directories);
+
+        std::vector<OwnedFile> files;
+        for (auto& owned : ownership.files) {
+            const std::string destination = owned.destination.string();
+            // Rewritten files get a new entry below
+            if (writtenFiles.contains(destination)) continue;
+            if (!appliedModules.contains(owned.module) || (!filter.empty() && !filter.isSelected(owned.destination))) {
+                files.push_back(std::move(owned));
+                continue;
+            }
+
+            auto planned = plannedFiles.find(destination);
+            if (planned != plannedFiles.end()) {
+                // Still produced but not written (apply-soft or an error), or now produced by another module that didn't write it yet
+                if (planned->second->owner == owned.module) files.push_back(std::move(owned));
+                continue;
+            }
+
+            // The module stopped producing it, without --prune it is kept so a later prune can still find it
+            if (!prune) {
+                files.push_back(std::move(owned));
+                continue;
+            }
+            RemoveResult result = removeOwnedFile(destinationRoot, owned, ownership.directories, options);
+            if (result == RemoveResult::Deleted) report[owned.module].prunedFiles++;
+            if (result == RemoveResult::Failed) files.push_back(std::move(owned));
+        }
+
+        for (auto& [module, stats] : report) {
+            for (auto& destination : stats.writtenFiles) {
+                struct stat info;
+                if (destination.string().find('\n') != std::string::npos || lstat((destinationRoot / destination).c_str(), &info) != 0) continue;
+                files.push_back({ module, destination, getModificationTime(info), static_cast<uint64_t>(info.st_size) });
+            }
+        }
+
+        std::sort(files.begin(), files.end(), [](const OwnedFile &a, const OwnedFile &b) {
+            return a.destination < b.destination;
+        });
+        ownership.files = std::move(files);
+        // Deleted by hand, a directory recreated later by the user isn't rdm's anymore
+        std::erase_if(ownership.directories, [&destinationRoot](const fs::path &directory) {
+            struct stat info;
+            return lstat((destinationRoot / directory).c_str(), &info) != 0;
+        });
+        return saveOwnership(destinationRoot, ownership);
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "executor.hpp"
+#include "glob.hpp"
+#include "plan.hpp"
+
+namespace fs = std::filesystem;
+
+namespace rdm {
+    // A file rdm wrote, with its size and mtime right after it was written, files changed since then are never deleted
+    struct OwnedFile {
+        std::string module;
+        fs::path destination; // Relative to the destination root
+        int64_t mtime = 0;
+        uint64_t size = 0;
+    };
+
+    struct Ownership {
+        std::vector<OwnedFile> files;
+        // Directories rdm created for those files (sorted), the only ones it deletes once they are empty
+        std::vector<fs::path> directories;
+    };
+
+    enum class RemoveResult {
+        Deleted,
+        Missing,
+        Modified,
+        Failed
+    };
+
+    // Which module wrote each file of a destination root, kept in the state dir so prune and remove never walk the root
+    Ownership loadOwnership(const fs::path &destinationRoot);
+    bool saveOwnership(const fs::path &destinationRoot, const Ownership &ownership);
+    // Records the files the executor wrote, the ones an applied module stopped producing are deleted with prune and kept otherwise
+    // Destinations outside filter weren't evaluated and keep their owner
+    bool updateOwnership(const ApplyPlan &plan, ExecutionReport &report, const fs::path &destinationRoot, const DestinationFilter &filter, bool prune, const ExecutorOptions &options);
+    // Empty parents rdm created are removed too (and dropped from directories), it stops at the first one that isn't
+    RemoveResult removeOwnedFile(const fs::path &destinationRoot, const OwnedFile &file, std::vector<fs::path> &directories, const ExecutorOptions &options);
+}
@@ -0,0 +1,1018 @@
+#include "patch.hpp"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <deque>
+#include <map>
+#include <unordered_map>
+
+namespace rdm {
+    static constexpr size_t MAX_DEPTH = 256;
+
+    struct TextEdit {
+        size_t start;
+        size_t end;
+        std::string replacement;
+    };
+
+    // Edits never overlap, applying them from the end keeps the offsets of the others valid
+    static std::string applyEdits(std::string_view text, std::vector<TextEdit> &edits) {
+        std::stable_sort(edits.begin(), edits.end(), [](const TextEdit &a, const TextEdit &b) {
+            return a.start < b.start;
+        });
+
+        std::string result;
+        result.reserve(text.size());
+        size_t position = 0;
+        for (auto& edit : edits) {
+            result.append(text.substr(position, edit.start - position));
+            result.append(edit.replacement);
+            position = edit.end;
+        }
+        result.append(text.substr(position));
+        return result;
+    }
+
+    static size_t getLineNumber(std::string_view text, size_t position) {
+        return std::count(text.begin(), text.begin() + std::min(position, text.size()), '\n') + 1;
+    }
+
+    static std::string_view getLineIndent(std::string_view text, size_t position) {
+        size_t lineStart = text.rfind('\n', position == 0 ? 0 : position - 1);
+        lineStart = lineStart == std::string_view::npos || position == 0 ? 0 : lineStart + 1;
+        size_t indentEnd = lineStart;
+        while (indentEnd < text.size() && (text[indentEnd] == ' ' || text[indentEnd] == '\t')) indentEnd++;
+        return text.substr(lineStart, indentEnd - lineStart);
+    }
+
+    // The first indented line tells how the file is indented
+    static std::string detectIndentUnit(std::string_view text) {
+        size_t position = 0;
+        while ((position = text.find('\n', position)) != std::string_view::npos) {
+            position++;
+            size_t end = position;
+            while (end < text.size() && (text[end] == ' ' || text[end] == '\t')) end++;
+            if (end > position && end < text.size() && text[end] != '\n' && text[end] != '\r') return std::string(text.substr(position, end - position));
+        }
+        return "    ";
+    }
+
+    static bool formatNumber(double number, std::string &out) {
+        if (!std::isfinite(number)) return false;
+        char buffer[32];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), number);
+        std::string_view formatted(buffer, result.ptr - buffer);
+        out.append(formatted);
+        // Keep it a float for readers that care
+        if (formatted.find_first_of(".eEn") == std::string_view::npos) out.append(".0");
+        return true;
+    }
+
+    static void appendQuoted(std::string &out, std::string_view value) {
+        static const char* HEX = "0123456789abcdef";
+        out.push_back('"');
+        for (unsigned char c : value) {
+            switch (c) {
+                case '"': out.append("\\\""); break;
+                case '\\': out.append("\\\\"); break;
+                case '\n': out.append("\\n"); break;
+                case '\r': out.append("\\r"); break;
+                case '\t': out.append("\\t"); break;
+                case '\b': out.append("\\b"); break;
+                case '\f': out.append("\\f"); break;
+                default:
+                    if (c < 0x20 || c == 0x7f) {
+                        out.append("\\u00").push_back(HEX[c >> 4]);
+                        out.push_back(HEX[c & 0xf]);
+                    } else {
+                        out.push_back(c);
+                    }
+            }
+        }
+        out.push_back('"');
+    }
+
+    static bool isScalar(const PatchValue &value) {
+        return value.type != PatchValue::Type::Array && value.type != PatchValue::Type::Object;
+    }
+
+    // JSON
+
+    struct JsonNode {
+        enum class Type {
+            Object,
+            Array,
+            Scalar
+        };
+
+        struct Member {
+            std::string key;
+            size_t keyStart;
+            JsonNode* value;
+        };
+
+        Type type = Type::Scalar;
+        size_t start = 0;
+        size_t end = 0;
+        std::vector<Member> members;
+    };
+
+    // Keeps the position of every value, comments and trailing commas (as in VS Code settings) are accepted
+    class JsonParser {
+        public:
+        JsonParser(std::string_view text) : m_text(text) {}
+
+        bool parse(JsonNode* &root) {
+            skipWhitespace();
+            root = newNode();
+            if (!parseValue(*root, 0)) return false;
+            skipWhitespace();
+            if (m_position < m_text.size()) return fail("Unexpected content after the document");
+            return true;
+        }
+
+        const std::string& getError() const { return m_error; }
+
+        private:
+        JsonNode* newNode() {
+            m_nodes.emplace_back();
+            return &m_nodes.back();
+        }
+
+        bool fail(const std::string &message) {
+            m_error = message + " at line " + std::to_string(getLineNumber(m_text, m_position));
+            return false;
+        }
+
+        void skipWhitespace() {
+            while (m_position < m_text.size()) {
+                char c = m_text[m_position];
+                if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+                    m_position++;
+                } else if (m_text.substr(m_position, 2) == "//") {
+                    size_t end = m_text.find('\n', m_position);
+                    m_position = end == std::string_view::npos ? m_text.size() : end;
+                } else if (m_text.substr(m_position, 2) == "/*") {
+                    size_t end = m_text.find("*/", m_position + 2);
+                    m_position = end == std::string_view::npos ? m_text.size() : end + 2;
+                } else {
+                    break;
+                }
+            }
+        }
+
+        static void appendUtf8(std::string &out, uint32_t codepoint) {
+            if (codepoint < 0x80) {
+                out.push_back(codepoint);
+            } else if (codepoint < 0x800) {
+                out.push_back(0xc0 | (codepoint >> 6));
+                out.push_back(0x80 | (codepoint & 0x3f));
+            } else if (codepoint < 0x10000) {
+                out.push_back(0xe0 | (codepoint >> 12));
+                out.push_back(0x80 | ((codepoint >> 6) & 0x3f));
+                out.push_back(0x80 | (codepoint & 0x3f));
+            } else {
+                out.push_back(0xf0 | (codepoint >> 18));
+                out.push_back(0x80 | ((codepoint >> 12) & 0x3f));
+                out.push_back(0x80 | ((codepoint >> 6) & 0x3f));
+                out.push_back(0x80 | (codepoint & 0x3f));
+            }
+        }
+
+        bool parseHex(uint32_t &value) {
+            if (m_position + 4 > m_text.size()) return fail("Truncated unicode escape");
+            auto result = std::from_chars(m_text.data() + m_position, m_text.data() + m_position + 4, value, 16);
+            if (result.ptr != m_text.data() + m_position + 4) return fail("Invalid unicode escape");
+            m_position += 4;
+            return true;
+        }
+
+        bool parseString(std::string &out) {
+            m_position++;
+            while (m_position < m_text.size()) {
+                char c = m_text[m_position++];
+                if (c == '"') return true;
+                if (c != '\\') {
+                    out.push_back(c);
+                    continue;
+                }
+                if (m_position >= m_text.size()) break;
+                char escaped = m_text[m_position++];
+                switch (escaped) {
+                    case 'n': out.push_back('\n'); break;
+                    case 't': out.push_back('\t'); break;
+                    case 'r': out.push_back('\r'); break;
+                    case 'b': out.push_back('\b'); break;
+                    case 'f': out.push_back('\f'); break;
+                    case 'u': {
+                        uint32_t codepoint;
+                        if (!parseHex(codepoint)) return false;
+                        // Characters outside of the BMP are written as a surrogate pair, a lone half can't be written as UTF-8
+                        if (codepoint >= 0xdc00 && codepoint < 0xe000) return fail("Unpaired surrogate in unicode escape");
+                        if (codepoint >= 0xd800 && codepoint < 0xdc00) {
+                            if (m_text.substr(m_position, 2) != "\\u") return fail("Unpaired surrogate in unicode escape");
+                            m_position += 2;
+                            uint32_t low;
+                            if (!parseHex(low)) return false;
+                            if (low < 0xdc00 || low >= 0xe000) return fail("Invalid low surrogate in unicode escape");
+                            codepoint = 0x10000 + ((codepoint - 0xd800) << 10) + (low - 0xdc00);
+                        }
+                        appendUtf8(out, codepoint);
+                        break;
+                    }
+                    default: out.push_back(escaped);
+                }
+            }
+            return fail("Unterminated string");
+        }
+
+        bool parseValue(JsonNode &node, size_t depth) {
+            if (depth > MAX_DEPTH) return fail("The document is nested too deeply");
+            if (m_position >= m_text.size()) return fail("Expected a value");
+
+            node.start = m_position;
+            char c = m_text[m_position];
+            if (c == '{') {
+                node.type = JsonNode::Type::Object;
+                m_position++;
+                while (true) {
+                    skipWhitespace();
+                    if (m_position >= m_text.size()) return fail("Unterminated object");
+                    if (m_text[m_position] == '}') break;
+                    if (m_text[m_position] != '"') return fail("Expected a key");
+
+                    JsonNode::Member member;
+                    member.keyStart = m_position;
+                    if (!parseString(member.key)) return false;
+                    skipWhitespace();
+                    if (m_position >= m_text.size() || m_text[m_position] != ':') return fail("Expected ':'");
+                    m_position++;
+                    skipWhitespace();
+                    member.value = newNode();
+                    if (!parseValue(*member.value, depth + 1)) return false;
+                    node.members.push_back(std::move(member));
+
+                    skipWhitespace();
+                    if (m_position < m_text.size() && m_text[m_position] == ',') {
+                        m_position++;
+                    } else if (m_position < m_text.size() && m_text[m_position] != '}') {
+                        return fail("Expected ',' or '}'");
+                    }
+                }
+                m_position++;
+            } else if (c == '[') {
+                node.type = JsonNode::Type::Array;
+                m_position++;
+                while (true) {
+                    skipWhitespace();
+                    if (m_position >= m_text.size()) return fail("Unterminated array");
+                    if (m_text[m_position] == ']') break;
+                    // Arrays are always replaced as a whole, their items are only checked
+                    JsonNode item;
+                    if (!parseValue(item, depth + 1)) return false;
+                    skipWhitespace();
+                    if (m_position < m_text.size() && m_text[m_position] == ',') {
+                        m_position++;
+                    } else if (m_position < m_text.size() && m_text[m_position] != ']') {
+                        return fail("Expected ',' or ']'");
+                    }
+                }
+                m_position++;
+            } else if (c == '"') {
+                std::string ignored;
+                if (!parseString(ignored)) return false;
+            } else {
+                size_t end = m_position;
+                while (end < m_text.size() && (std::isalnum(static_cast<unsigned char>(m_text[end])) || m_text[end] == '-' || m_text[end] == '+' || m_text[end] == '.')) end++;
+                if (end == m_position) return fail("Unexpected character");
+                m_position = end;
+            }
+            node.end = m_position;
+            return true;
+        }
+
+        std::string_view m_text;
+        size_t m_position = 0;
+        std::string m_error;
+        // Members point to their values, a deque never moves them
+        std::deque<JsonNode> m_nodes;
+    };
+
+    static bool serializeJson(const PatchValue &value, const std::string &indent, const std::string &unit, std::string &out) {
+        switch (value.type) {
+            case PatchValue::Type::Null: out.append("null"); return true;
+            case PatchValue::Type::Remove: return false;
+            case PatchValue::Type::Boolean: out.append(value.boolean ? "true" : "false"); return true;
+            case PatchValue::Type::Integer: out.append(std::to_string(value.integer)); return true;
+            case PatchValue::Type::Number: return formatNumber(value.number, out);
+            case PatchValue::Type::String: appendQuoted(out, value.string); return true;
+            case PatchValue::Type::Array: {
+                if (value.items.empty()) {
+                    out.append("[]");
+                    return true;
+                }
+                // Short arrays of plain values stay on one line
+                bool inline_ = std::all_of(value.items.begin(), value.items.end(), isScalar);
+                out.push_back('[');
+                for (size_t i = 0; i < value.items.size(); ++i) {
+                    if (i > 0) out.push_back(',');
+                    if (inline_) {
+                        if (i > 0) out.push_back(' ');
+                    } else {
+                        out.append("\n").append(indent).append(unit);
+                    }
+                    if (!serializeJson(value.items[i], indent + unit, unit, out)) return false;
+                }
+                if (!inline_) out.append("\n").append(indent);
+                out.push_back(']');
+                return true;
+            }
+            case PatchValue::Type::Object: {
+                if (value.members.empty()) {
+                    out.append("{}");
+                    return true;
+                }
+                out.push_back('{');
+                bool first = true;
+                for (auto& [key, member] : value.members) {
+                    if (member.type == PatchValue::Type::Remove) continue;
+                    if (!first) out.push_back(',');
+                    first = false;
+                    out.append("\n").append(indent).append(unit);
+                    appendQuoted(out, key);
+                    out.append(": ");
+                    if (!serializeJson(member, indent + unit, unit, out)) return false;
+                }
+                if (!first) out.append("\n").append(indent);
+                out.push_back('}');
+                return true;
+            }
+        }
+        return false;
+    }
+
+    class JsonPatcher {
+        public:
+        JsonPatcher(std::string_view text) : m_text(text), m_unit(detectIndentUnit(text)) {}
+
+        bool patchObject(const JsonNode &object, const PatchValue &patch) {
+            std::string_view indent = getLineIndent(m_text, object.start);
+
+            // Members that are already there are edited in place, the last one wins when a key is repeated
+            std::unordered_map<std::string_view, size_t> index;
+            for (size_t i = 0; i < object.members.size(); ++i) index[object.members[i].key] = i;
+
+            std::vector<bool> removed(object.members.size(), false);
+            std::vector<const std::pair<std::string, PatchValue>*> added;
+            for (auto& member : patch.members) {
+                auto existing = index.find(member.first);
+                if (existing == index.end()) {
+                    if (member.second.type != PatchValue::Type::Remove) added.push_back(&member);
+                    continue;
+                }
+
+                const JsonNode::Member& target = object.members[existing->second];
+                if (member.second.type == PatchValue::Type::Remove) {
+                    removed[existing->second] = true;
+                } else if (member.second.type == PatchValue::Type::Object && target.value->type == JsonNode::Type::Object) {
+                    if (!patchObject(*target.value, member.second)) return false;
+                } else {
+                    std::string value;
+                    if (!serializeJson(member.second, std::string(getLineIndent(m_text, target.keyStart)), m_unit, value)) return fail(member.first);
+                    m_edits.push_back({ target.value->start, target.value->end, std::move(value) });
+                }
+            }
+
+            size_t kept = std::count(removed.begin(), removed.end(), false);
+            if (kept == 0) {
+                // Nothing left to keep the layout of, the content is written again
+                if (object.members.empty() && added.empty()) return true;
+                std::string content;
+                for (size_t i = 0; i < added.size(); ++i) {
+                    content.append(i > 0 ? ",\n" : "\n").append(indent).append(m_unit);
+                    appendQuoted(content, added[i]->first);
+                    content.append(": ");
+                    if (!serializeJson(added[i]->second, std::string(indent) + m_unit, m_unit, content)) return fail(added[i]->first);
+                }
+                content.append("\n").append(indent);
+                if (added.empty()) content.clear();
+                m_edits.push_back({ object.start + 1, object.end - 1, std::move(content) });
+                return true;
+            }
+
+            addRemovals(object, removed);
+
+            if (!added.empty()) {
+                const JsonNode::Member& last = object.members.back();
+                // Objects written on a single line get their new keys on the same line
+                bool multiline = m_text.substr(object.start, object.members.front().keyStart - object.start).find('\n') != std::string_view::npos;
+                std::string memberIndent = multiline ? std::string(getLineIndent(m_text, object.members.front().keyStart)) : std::string(indent);
+                std::string content;
+                for (auto member : added) {
+                    content.append(multiline ? ",\n" + memberIndent : ", ");
+                    appendQuoted(content, member->first);
+                    content.append(": ");
+                    if (!serializeJson(member->second, memberIndent, m_unit, content)) return fail(member->first);
+                }
+                m_edits.push_back({ last.value->end, last.value->end, std::move(content) });
+            }
+            return true;
+        }
+
+        std::string apply() {
+            return applyEdits(m_text, m_edits);
+        }
+
+        const std::string& getError() const { return m_error; }
+
+        private:
+        bool fail(const std::string &key) {
+            m_error = "Invalid value for key '" + key + "'";
+            return false;
+        }
+
+        // Removes runs of members together with the commas between them and the members that are kept
+        void addRemovals(const JsonNode &object, const std::vector<bool> &removed) {
+            const auto& members = object.members;
+            for (size_t i = 0; i < members.size(); ++i) {
+                if (!removed[i]) continue;
+                size_t j = i;
+                while (j + 1 < members.size() && removed[j + 1]) j++;
+                if (j + 1 < members.size()) {
+                    m_edits.push_back({ members[i].keyStart, members[j + 1].keyStart, std::string() });
+                } else {
+                    m_edits.push_back({ members[i - 1].value->end, members[j].value->end, std::string() });
+                }
+                i = j;
+            }
+        }
+
+        std::string_view m_text;
+        std::string m_unit;
+        std::string m_error;
+        std::vector<TextEdit> m_edits;
+    };
+
+    bool patchJson(std::string_view text, const PatchValue &patch, std::string &result, std::string &error) {
+        if (patch.type != PatchValue::Type::Object) {
+            error = "The patch must be a table of keys";
+            return false;
+        }
+
+        // An empty file is patched like an empty object
+        if (text.find_first_not_of(" \t\r\n") == std::string_view::npos) {
+            result.clear();
+            if (!serializeJson(patch, std::string(), "    ", result)) {
+                error = "The patch contains invalid values";
+                return false;
+            }
+            result.push_back('\n');
+            return true;
+        }
+
+        JsonParser parser(text);
+        JsonNode* root;
+        if (!parser.parse(root)) {
+            error = parser.getError();
+            return false;
+        }
+        if (root->type != JsonNode::Type::Object) {
+            error = "The document isn't an object";
+            return false;
+        }
+
+        JsonPatcher patcher(text);
+        if (!patcher.patchObject(*root, patch)) {
+            error = patcher.getError();
+            return false;
+        }
+        result = patcher.apply();
+        return true;
+    }
+
+    // TOML
+
+    // Keys are compared as paths, parts are joined with a separator that can't be part of a key in practice
+    static constexpr char KEY_SEPARATOR = '\x1f';
+    static constexpr std::string_view BARE_VALUE_END = " \t\r\n#,]}";
+
+    struct TomlEntry {
+        std::string path;
+        size_t lineStart;
+        size_t valueStart;
+        size_t valueEnd;
+        size_t lineEnd;
+        // Index of the table it's written in
+        size_t table;
+    };
+
+    struct TomlTable {
+        std::string path;
+        bool isArray = false;
+        size_t headerStart = 0;
+        size_t end = 0;
+        // Where new keys of the table go, after its last key or after its header
+        size_t insertAt = 0;
+    };
+
+    // Only finds where tables, keys and values are, values are skipped without being decoded
+    class TomlScanner {
+        public:
+        TomlScanner(std::string_view text) : m_text(text) {}
+
+        bool scan() {
+            m_tables.push_back({ std::string(), false, 0, m_text.size(), 0 });
+            while (m_position < m_text.size()) {
+                skipSpaces();
+                if (m_position >= m_text.size()) break;
+                char c = m_text[m_position];
+                if (c == '\n' || c == '\r' || c == '#') {
+                    skipLine();
+                } else if (c == '[') {
+                    if (!scanHeader()) return false;
+                } else if (!scanEntry()) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        const std::vector<TomlTable>& getTables() const { return m_tables; }
+        const std::vector<TomlEntry>& getEntries() const { return m_entries; }
+        const std::string& getError() const { return m_error; }
+
+        private:
+        bool fail(const std::string &message) {
+            m_error = message + " at line " + std::to_string(getLineNumber(m_text, m_position));
+            return false;
+        }
+
+        bool peek(std::string_view prefix) const {
+            return m_text.substr(m_position, prefix.size()) == prefix;
+        }
+
+        void skipSpaces() {
+            while (m_position < m_text.size() && (m_text[m_position] == ' ' || m_text[m_position] == '\t')) m_position++;
+        }
+
+        void skipLine() {
+            size_t end = m_text.find('\n', m_position);
+            m_position = end == std::string_view::npos ? m_text.size() : end + 1;
+        }
+
+        // Whitespace, comments and new lines, as allowed between the items of an array
+        void skipBlank() {
+            while (m_position < m_text.size()) {
+                char c = m_text[m_position];
+                if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+                    m_position++;
+                } else if (c == '#') {
+                    size_t end = m_text.find('\n', m_position);
+                    m_position = end == std::string_view::npos ? m_text.size() : end;
+                } else {
+                    break;
+                }
+            }
+        }
+
+        bool parseString(std::string *out) {
+            const char quote = m_text[m_position];
+            const bool literal = quote == '\'';
+            const std::string quotes(3, quote);
+            if (peek(quotes)) {
+                size_t end = m_position + 3;
+                while (true) {
+                    end = m_text.find(quotes, end);
+                    if (end == std::string_view::npos) return fail("Unterminated multi-line string");
+                    size_t backslashes = 0;
+                    while (!literal && m_text[end - backslashes - 1] == '\\') backslashes++;
+                    if (backslashes % 2 == 0) break;
+                    end++;
+                }
+                // Up to two quotes right before the closing ones are part of the content
+                end += 3;
+                for (int extra = 0; extra < 2 && end < m_text.size() && m_text[end] == quote; ++extra) end++;
+                m_position = end;
+                return true;
+            }
+
+            m_position++;
+            while (m_position < m_text.size() && m_text[m_position] != '\n') {
+                char c = m_text[m_position++];
+                if (c == quote) return true;
+                if (!literal && c == '\\' && m_position < m_text.size()) {
+                    char escaped = m_text[m_position++];
+                    if (out == nullptr) continue;
+                    switch (escaped) {
+                        case 'n': out->push_back('\n'); break;
+                        case 't': out->push_back('\t'); break;
+                        default: out->push_back(escaped);
+                    }
+                    continue;
+                }
+                if (out != nullptr) out->push_back(c);
+            }
+            return fail("Unterminated string");
+        }
+
+        bool parseKey(std::string &path) {
+            while (true) {
+                skipSpaces();
+                if (m_position >= m_text.size()) return fail("Expected a key");
+                char c = m_text[m_position];
+                if (c == '"' || c == '\'') {
+                    std::string part;
+                    if (!parseString(&part)) return false;
+                    path.append(part);
+                } else {
+                    size_t start = m_position;
+                    while (m_position < m_text.size() && (std::isalnum(static_cast<unsigned char>(m_text[m_position])) || m_text[m_position] == '_' || m_text[m_position] == '-')) m_position++;
+                    if (start == m_position) return fail("Invalid key");
+                    path.append(m_text.substr(start, m_position - start));
+                }
+                skipSpaces();
+                if (m_position >= m_text.size() || m_text[m_position] != '.') return true;
+                m_position++;
+                path.push_back(KEY_SEPARATOR);
+            }
+        }
+
+        void skipBareValue() {
+            while (m_position < m_text.size() && BARE_VALUE_END.find(m_text[m_position]) == std::string_view::npos) m_position++;
+        }
+
+        bool skipValue(size_t depth) {
+            if (depth > MAX_DEPTH) return fail("The document is nested too deeply");
+            if (m_position >= m_text.size()) return fail("Expected a value");
+
+            char c = m_text[m_position];
+            if (c == '"' || c == '\'') return parseString(nullptr);
+            if (c == '[' || c == '{') {
+                const char close = c == '[' ? ']' : '}';
+                m_position++;
+                while (true) {
+                    skipBlank();
+                    if (m_position >= m_text.size()) return fail("Unterminated value");
+                    if (m_text[m_position] == close) break;
+                    if (close == '}') {
+                        std::string ignored;
+                        if (!parseKey(ignored)) return false;
+                        if (m_position >= m_text.size() || m_text[m_position] != '=') return fail("Expected '='");
+                        m_position++;
+                        skipSpaces();
+                    }
+                    if (!skipValue(depth + 1)) return false;
+                    skipBlank();
+                    if (m_position < m_text.size() && m_text[m_position] == ',') m_position++;
+                }
+                m_position++;
+                return true;
+            }
+
+            size_t start = m_position;
+            skipBareValue();
+            // A date and a time can be separated by a space
+            if (m_position - start == 10 && m_text[start + 4] == '-' && peek(" ") && m_position + 1 < m_text.size() && std::isdigit(static_cast<unsigned char>(m_text[m_position + 1]))) {
+                m_position++;
+                skipBareValue();
+            }
+            if (start == m_position) return fail("Expected a value");
+            return true;
+        }
+
+        bool scanHeader() {
+            size_t start = m_position;
+            bool isArray = peek("[[");
+            m_position += isArray ? 2 : 1;
+            std::string path;
+            if (!parseKey(path)) return false;
+            if (!peek(isArray ? "]]" : "]")) return fail("Expected ']'");
+            m_position += isArray ? 2 : 1;
+            skipLine();
+
+            m_tables.back().end = start;
+            m_tables.push_back({ std::move(path), isArray, start, m_text.size(), m_position });
+            return true;
+        }
+
+        bool scanEntry() {
+            size_t lineStart = m_text.rfind('\n', m_position == 0 ? 0 : m_position - 1);
+            lineStart = lineStart == std::string_view::npos || m_position == 0 ? 0 : lineStart + 1;
+
+            std::string key;
+            if (!parseKey(key)) return false;
+            if (m_position >= m_text.size() || m_text[m_position] != '=') return fail("Expected '='");
+            m_position++;
+            skipSpaces();
+
+            size_t valueStart = m_position;
+            if (!skipValue(0)) return false;
+            size_t valueEnd = m_position;
+            skipSpaces();
+            if (m_position < m_text.size() && m_text[m_position] != '#' && m_text[m_position] != '\n' && m_text[m_position] != '\r') return fail("Expected the end of the line");
+            skipLine();
+
+            TomlTable& table = m_tables.back();
+            table.insertAt = m_position;
+            // Keys of arrays of tables can't be addressed by a patch
+            if (!table.isArray) m_entries.push_back({ table.path.empty() ? key : table.path + KEY_SEPARATOR + key, lineStart, valueStart, valueEnd, m_position, m_tables.size() - 1 });
+            return true;
+        }
+
+        std::string_view m_text;
+        size_t m_position = 0;
+        std::string m_error;
+        std::vector<TomlTable> m_tables;
+        std::vector<TomlEntry> m_entries;
+    };
+
+    // Whether the path is the prefix or one of its children
+    static bool isTomlPathUnder(std::string_view path, std::string_view prefix) {
+        return path.starts_with(prefix) && (path.size() == prefix.size() || path[prefix.size()] == KEY_SEPARATOR);
+    }
+
+    static void appendTomlKey(std::string &out, std::string_view key) {
+        bool bare = !key.empty() && std::all_of(key.begin(), key.end(), [](char c) {
+            return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-';
+        });
+        if (bare) {
+            out.append(key);
+        } else {
+            appendQuoted(out, key);
+        }
+    }
+
+    static void appendTomlPath(std::string &out, std::string_view path) {
+        size_t start = 0;
+        while (true) {
+            size_t end = path.find(KEY_SEPARATOR, start);
+            appendTomlKey(out, path.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start));
+            if (end == std::string_view::npos) return;
+            out.push_back('.');
+            start = end + 1;
+        }
+    }
+
+    // Tables inside values are written as inline tables
+    static bool serializeToml(const PatchValue &value, std::string &out) {
+        switch (value.type) {
+            case PatchValue::Type::Null: return false;
+            case PatchValue::Type::Remove: return false;
+            case PatchValue::Type::Boolean: out.append(value.boolean ? "true" : "false"); return true;
+            case PatchValue::Type::Integer: out.append(std::to_string(value.integer)); return true;
+            case PatchValue::Type::Number: return formatNumber(value.number, out);
+            case PatchValue::Type::String: appendQuoted(out, value.string); return true;
+            case PatchValue::Type::Array: {
+                out.push_back('[');
+                for (size_t i = 0; i < value.items.size(); ++i) {
+                    if (i > 0) out.append(", ");
+                    if (!serializeToml(value.items[i], out)) return false;
+                }
+                out.push_back(']');
+                return true;
+            }
+            case PatchValue::Type::Object: {
+                out.push_back('{');
+                bool first = true;
+                for (auto& [key, member] : value.members) {
+                    if (member.type == PatchValue::Type::Remove) continue;
+                    out.append(first ? " " : ", ");
+                    first = false;
+                    appendTomlKey(out, key);
+                    out.append(" = ");
+                    if (!serializeToml(member, out)) return false;
+                }
+                out.append(first ? "}" : " }");
+                return true;
+            }
+        }
+        return false;
+    }
+
+    class TomlPatcher {
+        public:
+        TomlPatcher(std::string_view text, const TomlScanner &scanner) : m_text(text), m_tables(scanner.getTables()) {
+            for (auto& entry : scanner.getEntries()) {
+                m_entries[entry.path] = &entry;
+                // Dotted keys define their parent tables inside the table they're written in
+                const TomlTable& table = m_tables[entry.table];
+                for (size_t end = entry.path.find(KEY_SEPARATOR, table.path.empty() ? 0 : table.path.size() + 1); end != std::string::npos; end = entry.path.find(KEY_SEPARATOR, end + 1)) {
+                    m_dottedTables.emplace(entry.path.substr(0, end), &table);
+                }
+            }
+            for (auto& table : m_tables) {
+                if (!table.isArray) m_tableIndex.emplace(table.path, &table);
+            }
+        }
+
+        bool patchTable(const std::string &path, const PatchValue &patch) {
+            // New keys of a table only defined by dotted keys are written the same way, a header would define it twice
+            const TomlTable* target = nullptr;
+            std::string prefix;
+            if (auto table = m_tableIndex.find(path); table != m_tableIndex.end()) {
+                target = table->second;
+            } else if (auto dotted = m_dottedTables.find(path); dotted != m_dottedTables.end()) {
+                target = dotted->second;
+                appendTomlPath(prefix, std::string_view(path).substr(target->path.empty() ? 0 : target->path.size() + 1));
+                prefix.push_back('.');
+            }
+
+            std::string lines;
+            for (auto& [key, value] : patch.members) {
+                std::string fullPath = path.empty() ? key : path + KEY_SEPARATOR + key;
+                auto entry = m_entries.find(fullPath);
+
+                if (value.type == PatchValue::Type::Remove) {
+                    if (entry != m_entries.end()) {
+                        m_edits.push_back({ entry->second->lineStart, entry->second->lineEnd, std::string() });
+                    } else {
+                        removeTable(fullPath);
+                    }
+                    continue;
+                }
+
+                // The elements of an array of tables have no key to address them by
+                for (auto& table : m_tables) {
+                    if (table.isArray && isTomlPathUnder(fullPath, table.path)) {
+                        m_error = "Key '" + key + "' is in an array of tables, which a patch can't edit";
+                        return false;
+                    }
+                }
+
+                // Tables are merged, unless the file has them as an inline value which is replaced
+                if (value.type == PatchValue::Type::Object && entry == m_entries.end()) {
+                    if (!patchTable(fullPath, value)) return false;
+                    continue;
+                }
+
+                std::string serialized;
+                if (!serializeToml(value, serialized)) return fail(key);
+                if (entry != m_entries.end()) {
+                    m_edits.push_back({ entry->second->valueStart, entry->second->valueEnd, std::move(serialized) });
+                } else {
+                    lines.append(prefix);
+                    appendTomlKey(lines, key);
+                    lines.append(" = ").append(serialized).append("\n");
+                }
+            }
+
+            if (lines.empty()) return true;
+            if (target == nullptr) {
+                std::string section = "[";
+                appendTomlPath(section, path);
+                section.append("]\n").append(lines);
+                m_newTables.push_back(std::move(section));
+                return true;
+            }
+
+            size_t insertAt = target->insertAt;
+            // Keys of the root table must stay above the first header
+            if (target->path.empty() && insertAt == 0 && m_tables.size() > 1) {
+                insertAt = m_tables[1].headerStart;
+                lines.push_back('\n');
+            }
+            if (insertAt > 0 && m_text[insertAt - 1] != '\n') lines.insert(0, "\n");
+            m_edits.push_back({ insertAt, insertAt, std::move(lines) });
+            return true;
+        }
+
+        std::string apply() {
+            if (!m_newTables.empty()) {
+                std::string tables;
+                if (!m_text.empty() && !m_text.ends_with('\n')) tables.push_back('\n');
+                for (auto& table : m_newTables) {
+                    if (!m_text.empty() || !tables.empty()) tables.push_back('\n');
+                    tables.append(table);
+                }
+                m_edits.push_back({ m_text.size(), m_text.size(), std::move(tables) });
+            }
+            return applyEdits(m_text, m_edits);
+        }
+
+        const std::string& getError() const { return m_error; }
+
+        private:
+        bool fail(const std::string &key) {
+            m_error = "Invalid value for key '" + key + "', TOML has no null";
+            return false;
+        }
+
+        // Every section of the table and its subtables (or of an array of tables), and the dotted keys defining it elsewhere
+        void removeTable(const std::string &path) {
+            for (size_t i = 1; i < m_tables.size(); ++i) {
+                if (isTomlPathUnder(m_tables[i].path, path)) m_edits.push_back({ m_tables[i].headerStart, m_tables[i].end, std::string() });
+            }
+            for (auto& [entryPath, entry] : m_entries) {
+                if (isTomlPathUnder(entryPath, path) && !isTomlPathUnder(m_tables[entry->table].path, path)) m_edits.push_back({ entry->lineStart, entry->lineEnd, std::string() });
+            }
+        }
+
+        std::string_view m_text;
+        const std::vector<TomlTable>& m_tables;
+        std::unordered_map<std::string, const TomlEntry*> m_entries;
+        std::unordered_map<std::string, const TomlTable*> m_tableIndex;
+        std::unordered_map<std::string, const TomlTable*> m_dottedTables;
+        std::vector<TextEdit> m_edits;
+        std::vector<std::string> m_newTables;
+        std::string m_error;
+    };
+
+    bool patchToml(std::string_view text, const PatchValue &patch, std::string &result, std::string &error) {
+        if (patch.type != PatchValue::Type::Object) {
+            error = "The patch must be a table of keys";
+            return false;
+        }
+
+        TomlScanner scanner(text);
+        if (!scanner.scan()) {
+            error = scanner.getError();
+            return false;
+        }
+
+        TomlPatcher patcher(text, scanner);
+        if (!patcher.patchTable(std::string(), patch)) {
+            error = patcher.getError();
+            return false;
+        }
+        result = patcher.apply();
+        return true;
+    }
+
+    // INI
+
+    static std::string_view trim(std::string_view value) {
+        size_t start = value.find_first_not_of(" \t\r\n");
+        if (start == std::string_view::npos) return std::string_view();
+        size_t end = value.find_last_not_of(" \t\r\n");
+        return value.substr(start, end - start + 1);
+    }
+
+    std::string setIniValue(std::string_view text, std::string_view section, std::string_view key, const std::string* value) {
+        // New keys use the same separator as the first key of the file
+        std::string separator;
+        std::string currentSection;
+        bool sectionFound = section.empty();
+        bool keyFound = false;
+        size_t insertAt = std::string_view::npos;
+        std::vector<TextEdit> edits;
+
+        size_t lineStart = 0;
+        while (lineStart < text.size()) {
+            size_t lineEnd = text.find('\n', lineStart);
+            lineEnd = lineEnd == std::string_view::npos ? text.size() : lineEnd + 1;
+            std::string_view line = text.substr(lineStart, lineEnd - lineStart);
+            std::string_view content = trim(line);
+
+            if (content.starts_with('[') && content.ends_with(']')) {
+                // The part before the first section gets its new keys right above it
+                if (section.empty() && currentSection.empty() && insertAt == std::string_view::npos) insertAt = lineStart;
+                currentSection = trim(content.substr(1, content.size() - 2));
+                if (currentSection == section) {
+                    sectionFound = true;
+                    insertAt = lineEnd;
+                }
+            } else if (!content.empty() && content[0] != ';' && content[0] != '#') {
+                size_t separatorStart = line.find_first_of("=:");
+                if (separatorStart != std::string_view::npos) {
+                    std::string_view lineKey = trim(line.substr(0, separatorStart));
+                    size_t keyEnd = line.find(lineKey) + lineKey.size();
+                    size_t valueStart = std::min(line.find_first_not_of(" \t", separatorStart + 1), line.size());
+                    size_t valueEnd = line.find_last_not_of(" \t\r\n") + 1;
+                    if (valueStart > valueEnd) valueStart = valueEnd = separatorStart + 1;
+                    if (separator.empty()) separator = line.substr(keyEnd, valueStart - keyEnd);
+
+                    if (currentSection == section) {
+                        if (lineKey == key && !keyFound) {
+                            keyFound = true;
+                            if (value == nullptr) {
+                                edits.push_back({ lineStart, lineEnd, std::string() });
+                            } else {
+                                edits.push_back({ lineStart + valueStart, lineStart + valueEnd, *value });
+                            }
+                        }
+                        insertAt = lineEnd;
+                    }
+                }
+            }
+            lineStart = lineEnd;
+        }
+
+        if (keyFound || value == nullptr) return applyEdits(text, edits);
+
+        if (separator.empty() || separator.find('\n') != std::string::npos) separator = " = ";
+        std::string line = std::string(key) + separator + *value + "\n";
+        if (!sectionFound) {
+            std::string newSection;
+            if (!text.empty() && !text.ends_with('\n')) newSection.push_back('\n');
+            if (!text.empty()) newSection.push_back('\n');
+            newSection.append("[").append(section).append("]\n").append(line);
+            edits.push_back({ text.size(), text.size(), std::move(newSection) });
+        } else {
+            if (insertAt == std::string_view::npos) insertAt = section.empty() ? 0 : text.size();
+            if (insertAt > 0 && text[insertAt - 1] != '\n') line.insert(0, "\n");
+            edits.push_back({ insertAt, insertAt, std::move(line) });
+        }
+        return applyEdits(text, edits);
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace rdm {
+    // Values set by a patch, built from a Lua table
+    struct PatchValue {
+        enum class Type {
+            Null,
+            Remove,
+            Boolean,
+            Integer,
+            Number,
+            String,
+            Array,
+            Object
+        };
+
+        Type type = Type::Null;
+        bool boolean = false;
+        int64_t integer = 0;
+        double number = 0;
+        std::string string;
+        std::vector<PatchValue> items;
+        // Sorted by key, so new keys are always added in the same order
+        std::vector<std::pair<std::string, PatchValue>> members;
+    };
+
+    // The files are only edited where the patch changes something, so comments, formatting and key order are kept
+    // Objects are merged recursively, any other value replaces the old one and Remove deletes the key
+    bool patchJson(std::string_view text, const PatchValue &patch, std::string &result, std::string &error);
+    bool patchToml(std::string_view text, const PatchValue &patch, std::string &result, std::string &error);
+    // A null value removes the key, an empty section is the part of the file before the first section
+    std::string setIniValue(std::string_view text, std::string_view section, std::string_view key, const std::string* value);
+}
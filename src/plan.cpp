@@ -0,0 +1,195 @@
+#include "plan.hpp"
+#include <algorithm>
+#include <functional>
+#include <sstream>
+#include "logger.hpp"
+#include "utils.hpp"
+
+namespace rdm {
+    // exec adds the exec bit of every class that can read, so '0600' becomes '0700' and not '0711'
+    static std::optional<unsigned> getFinalMode(std::optional<unsigned> mode, bool executable) {
+        if (mode.has_value() && executable) return *mode | ((*mode & 0444) >> 2);
+        return mode;
+    }
+
+    ApplyPlan::ApplyPlan(ModuleManager &moduleManager, const fs::path &destinationRoot, const DestinationFilter &filter)
+    : m_destinationRoot(destinationRoot.lexically_normal()) {
+        for (auto& [moduleName, module] : moduleManager.getModules()) {
+            if (moduleManager.shouldProcessModule(moduleName)) m_modules.push_back(moduleName);
+        }
+        // Sorted so that conflicts are always resolved the same way
+        std::sort(m_modules.begin(), m_modules.end());
+
+        for (auto& moduleName : m_modules) {
+            Module& module = moduleManager.getModules().at(moduleName);
+            std::optional<FileContentMap> generatedFiles = module.getGeneratedFiles();
+
+            if (!generatedFiles.has_value()) {
+                // Modules that ran over their budget already reported it
+                if (!module.wasAborted()) LOG_CUSTOM_ERR(moduleName, "The module '" << moduleName << "' was found but had errors [" << module.getExitCode() << "]: " << module.getErrorString());
+                m_failedModules.push_back(moduleName);
+                continue;
+            } else if (generatedFiles.value().empty()) {
+                LOG_CUSTOM_DEBUG(moduleName, "The module '" << moduleName << "' was found but returned no files.");
+                continue;
+            }
+
+            FileContentMap& files = m_generatedFiles.emplace(moduleName, std::move(generatedFiles.value())).first->second;
+
+            std::vector<PlanEntry> moduleEntries;
+            moduleEntries.reserve(files.size());
+            for (auto& [destination, fileData] : files) {
+                fs::path relativeDestination = normalizeDestination(destination, m_destinationRoot);
+                if (!filter.empty()) {
+                    bool isDirectory = fileData.getDataType() == FileDataType::Directory;
+                    if (isDirectory ? !filter.mayContainSelected(relativeDestination) : !filter.isSelected(relativeDestination)) continue;
+                }
+                moduleEntries.push_back({ std::move(relativeDestination), &fileData, moduleName });
+            }
+            std::sort(moduleEntries.begin(), moduleEntries.end(), [](const PlanEntry &a, const PlanEntry &b) {
+                return a.destination < b.destination;
+            });
+
+            // Explicit files go first so they can override a single file of a Directory() from the same module
+            for (auto& entry : moduleEntries) {
+                const FileData* data = entry.data;
+                std::optional<unsigned> mode = getFinalMode(data->getMode(), data->isExecutable());
+                if (data->getDataType() == FileDataType::Text) {
+                    addOperation({ OperationType::WriteText, entry.destination, fs::path(), data, moduleName, data->isExecutable(), mode, std::nullopt, fs::path() });
+                } else if (data->getDataType() == FileDataType::RawData) {
+                    addOperation({ OperationType::CopyFile, entry.destination, data->getPath(), data, moduleName, data->isExecutable(), mode, std::nullopt, fs::path() });
+                }
+            }
+
+            for (auto& entry : moduleEntries) {
+                const FileData* data = entry.data;
+                if (data->getDataType() != FileDataType::Directory) continue;
+
+                bool shouldAlwaysExec = data->isExecutable() && (data->getExecutablePattern().empty() || data->getExecutablePattern() == "*");
+                // Compiled once per directory instead of once per file
+                GlobPattern execPattern(data->getExecutablePattern());
+                // The last matching rule wins, like in gitignore
+                std::vector<std::pair<PathFilter, unsigned>> modeRules;
+                for (auto& rule : data->getModeRules()) modeRules.emplace_back(PathFilter({ rule.pattern }), rule.mode);
+                // Directories get the file mode with the search bit of every class that can read
+                std::optional<unsigned> directoryMode = getFinalMode(data->getMode(), true);
+                fs::path sourcePath = data->getPath();
+                const fs::path& destination = entry.destination;
+                std::function<bool(const fs::path&, bool)> skip;
+                if (!filter.empty()) {
+                    skip = [&filter, &destination](const fs::path &relativePath, bool isDirectory) {
+                        return isDirectory ? !filter.mayContainSelected(destination / relativePath) : !filter.isSelected(destination / relativePath);
+                    };
+                }
+                for (auto& file : getDirectoryFilesRecursive(sourcePath, PathFilter(data->getIgnorePatterns()), skip)) {
+                    fs::path extraPath = file.lexically_relative(sourcePath);
+                    bool executable = shouldAlwaysExec || (data->isExecutable() && execPattern.matches(file.filename().string()));
+                    std::optional<unsigned> mode = data->getMode();
+                    for (auto& [rule, ruleMode] : modeRules) {
+                        if (rule.isIgnored(extraPath, false)) mode = ruleMode;
+                    }
+                    addOperation({ OperationType::CopyFile, entry.destination / extraPath, file, data, moduleName, executable, getFinalMode(mode, executable), directoryMode, destination });
+                }
+            }
+
+            for (auto& entry : moduleEntries) {
+                m_entries.push_back(std::move(entry));
+            }
+        }
+
+        detectParentConflicts();
+        m_destinationIndex.clear();
+
+        for (auto& conflict : m_conflicts) {
+            std::stringstream owners;
+            for (size_t i = 0; i < conflict.owners.size(); ++i) {
+                if (i > 0) owners << ", ";
+                owners << conflict.owners.at(i);
+            }
+            LOG_ERR("Conflicting destination " << conflict.destination << " is claimed by: " << owners.str() << " (keeping the one from '" << conflict.owners.front() << "')");
+        }
+
+        sortOperations();
+    }
+
+    fs::path ApplyPlan::normalizeDestination(const fs::path &destination, const fs::path &root) {
+        fs::path relative = destination.lexically_normal().lexically_relative(root);
+        if (!relative.has_filename()) relative = relative.parent_path();
+        return relative;
+    }
+
+    void ApplyPlan::addOperation(PlanOperation &&operation) {
+        const std::string key = operation.destination.string();
+        auto existing = m_destinationIndex.find(key);
+        if (existing == m_destinationIndex.end()) {
+            m_destinationIndex.emplace(key, m_operations.size());
+            m_operations.push_back(std::move(operation));
+            return;
+        }
+
+        const PlanOperation& current = m_operations.at(existing->second);
+        if (current.owner == operation.owner && operation.data->getDataType() == FileDataType::Directory && current.data->getDataType() != FileDataType::Directory) {
+            LOG_CUSTOM_DEBUG(operation.owner, "Directory file " << key << " is overridden by an explicit file");
+            return;
+        }
+
+        auto conflict = std::find_if(m_conflicts.begin(), m_conflicts.end(), [&](const PlanConflict &c) { return c.destination == operation.destination; });
+        if (conflict == m_conflicts.end()) {
+            m_conflicts.push_back({ operation.destination, { current.owner } });
+            conflict = m_conflicts.end() - 1;
+        }
+        conflict->owners.push_back(operation.owner);
+    }
+
+    void ApplyPlan::detectParentConflicts() {
+        // A file can't be created inside a path that another operation creates as a file
+        std::vector<PlanOperation> operations;
+        operations.reserve(m_operations.size());
+        for (auto& operation : m_operations) {
+            bool blocked = false;
+            for (fs::path parent = operation.destination.parent_path(); !parent.empty(); parent = parent.parent_path()) {
+                auto existing = m_destinationIndex.find(parent.string());
+                if (existing == m_destinationIndex.end()) continue;
+                m_conflicts.push_back({ parent, { m_operations.at(existing->second).owner, operation.owner } });
+                blocked = true;
+                break;
+            }
+            if (!blocked) operations.push_back(std::move(operation));
+        }
+        m_operations = std::move(operations);
+    }
+
+    void ApplyPlan::sortOperations() {
+        // Grouping by directory lets the executor create and open each directory once
+        std::sort(m_operations.begin(), m_operations.end(), [](const PlanOperation &a, const PlanOperation &b) {
+            const fs::path parentA = a.destination.parent_path();
+            const fs::path parentB = b.destination.parent_path();
+            if (parentA != parentB) return parentA < parentB;
+            return a.destination.filename() < b.destination.filename();
+        });
+    }
+
+    const fs::path& ApplyPlan::getDestinationRoot() const {
+        return m_destinationRoot;
+    }
+
+    const std::vector<std::string>& ApplyPlan::getModules() const {
+        return m_modules;
+    }
+
+    const std::vector<std::string>& ApplyPlan::getFailedModules() const {
+        return m_failedModules;
+    }
+
+    const std::vector<PlanEntry>& ApplyPlan::getEntries() const {
+        return m_entries;
+    }
+
+    const std::vector<PlanOperation>& ApplyPlan::getOperations() const {
+        return m_operations;
+    }
+
+    const std::vector<PlanConflict>& ApplyPlan::getConflicts() const {
+        return m_conflicts;
+    }
+}
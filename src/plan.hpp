@@ -0,0 +1,77 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "glob.hpp"
+#include "modules.hpp"
+
+namespace fs = std::filesystem;
+
+namespace rdm {
+    enum class OperationType {
+        WriteText,
+        CopyFile
+    };
+
+    // A single file that will be created on the destination
+    struct PlanOperation {
+        OperationType type;
+        fs::path destination; // Relative to the destination root
+        fs::path source;
+        const FileData* data;
+        std::string owner;
+        bool executable = false;
+        // Exact permissions from :mode() (exec included), the umask doesn't apply to them
+        std::optional<unsigned> mode;
+        // The directories created for the file at or under directoryModeRoot, from the :mode() of its Directory()
+        std::optional<unsigned> directoryMode;
+        fs::path directoryModeRoot;
+    };
+
+    // A single value returned by RDM_GetFiles, before directories are expanded
+    struct PlanEntry {
+        fs::path destination; // Relative to the destination root
+        const FileData* data;
+        std::string owner;
+    };
+
+    struct PlanConflict {
+        fs::path destination;
+        std::vector<std::string> owners;
+    };
+
+    class ApplyPlan {
+        public:
+        // Only the destinations selected by filter are planned, Directory() walks skip the subtrees it can't select
+        ApplyPlan(ModuleManager &moduleManager, const fs::path &destinationRoot, const DestinationFilter &filter = DestinationFilter());
+        ApplyPlan(ApplyPlan& other) = delete;
+        ApplyPlan& operator=(const ApplyPlan&) = delete;
+
+        const fs::path& getDestinationRoot() const;
+        const std::vector<std::string>& getModules() const;
+        // Modules whose RDM_GetFiles failed, their files are unknown rather than gone
+        const std::vector<std::string>& getFailedModules() const;
+        const std::vector<PlanEntry>& getEntries() const;
+        const std::vector<PlanOperation>& getOperations() const;
+        const std::vector<PlanConflict>& getConflicts() const;
+
+        static fs::path normalizeDestination(const fs::path &destination, const fs::path &root);
+
+        private:
+        void addOperation(PlanOperation &&operation);
+        void detectParentConflicts();
+        void sortOperations();
+
+        const fs::path m_destinationRoot;
+        std::vector<std::string> m_modules;
+        std::vector<std::string> m_failedModules;
+        std::vector<PlanEntry> m_entries;
+        std::vector<PlanOperation> m_operations;
+        std::vector<PlanConflict> m_conflicts;
+        std::unordered_map<std::string, FileContentMap> m_generatedFiles;
+        std::unordered_map<std::string, size_t> m_destinationIndex;
+    };
+}
@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <cstdlib>
+#include <string_view>
 #include "logger.hpp"
 #include "menus.hpp"
 #include "utils.hpp"
@@ -7,14 +9,22 @@
 using namespace rdm;
 
 int main(int argc, char* argv[]) {
-    if(!copyRDMLib()) {
-        LOG_DEBUG("Couldn't copy RDM lib.");
+    if (std::any_of(argv + 1, argv + argc, [](const char* arg) { return std::string_view(arg) == "--startup-trace"; })) {
+        enableStartupTrace();
     }
-    
+    setupLogging(argv + 1, argc - 1);
+    traceStartup("logging");
+
+    // Nothing is written here, the commands that load modules refresh rdmlib.lua themselves
     if (argc == 1) {
         menus::printMainHelp();
         return EXIT_SUCCESS;
     }
 
-    return commands::runCommandHandler(commands::parseCommand(argv[1]), argc, argv);
+    commands::Command command = commands::parseCommand(argv[1]);
+    traceStartup("command lookup");
+    int exitCode = commands::runCommandHandler(command, argc, argv);
+    traceStartup("command");
+    printStartupTrace();
+    return exitCode;
 }
@@ -8,6 +8,49 @@
 --- @return string|nil
 function Read(filename) end
 
+--- @class Buffer A growable string built in C++, appending to it doesn't create intermediate Lua strings
+--- Buffers can be used directly as values of the table returned by RDM_GetFiles
+local Buffer = {}
+
+--- Append strings, numbers or other buffers, returns the buffer so calls can be chained
+--- @param ... string|number|Buffer
+--- @return Buffer
+function Buffer:add(...) end
+
+--- Append the result of string.format(format, ...), returns the buffer so calls can be chained
+--- @param format string
+--- @param ... any
+--- @return Buffer
+function Buffer:addf(format, ...) end
+
+--- Converts the buffer to a FileDescriptor and marks it as executable, the content is never copied into a Lua string
+--- @return FileDescriptor
+function Buffer:exec() end
+
+--- Converts the buffer to a FileDescriptor created with the exact permissions mode (an octal string like "0600")
+--- @param mode string
+--- @return FileDescriptor
+function Buffer:mode(mode) end
+
+--- Get the content of the buffer as a Lua string, not needed to return it from RDM_GetFiles
+--- @return string
+function Buffer:tostring() end
+
+--- Iterate over the lines of a file (without their '\n') without loading the whole file
+--- @param filename string
+--- @return fun(): string|nil
+function ReadLines(filename) end
+
+--- Iterate over a file in pieces of up to size bytes (64 KiB by default) without loading the whole file
+--- @param filename string
+--- @param size? integer
+--- @return fun(): string|nil
+function ReadChunks(filename, size) end
+
+--- Create an empty Buffer
+--- @return Buffer
+function Buffer() end
+
 --- Get a boolean representing if a specific module was specified by the user
 --- @param module string
 --- @return boolean
@@ -37,6 +80,58 @@ function Spawn(filename) end
 --- @return number|nil
 function ForceSpawn(filename) end
 
+--- Get the paths (relative to the module) of the files and directories matching a pattern, sorted
+--- Each part of the pattern between '/' is a glob pattern, '**' matches any number of directories
+--- @param pattern string
+--- @return string[]|nil
+function Glob(pattern) end
+
+--- Get the sorted names of the entries of a directory, nil if it doesn't exist
+--- @param path string
+--- @return string[]|nil
+function ListDir(path) end
+
+--- Get the type ("file", "directory", "symlink" or "other"), size, permission bits and modification time of a path, nil if it doesn't exist
+--- @param path string
+--- @return { type: string, size: integer, mode: integer, mtime: integer }|nil
+function Stat(path) end
+
+--- Edit JSON and TOML text in place, only the changed values are rewritten so comments, formatting and key order are kept
+--- Tables in a patch are merged into the existing ones, any other value replaces the old one
+Json = {}
+Toml = {}
+Ini = {}
+
+--- Sets a key to null, unlike nil which can't be stored in a table
+--- @type lightuserdata
+Json.null = nil
+--- Removes the key it is assigned to
+--- @type lightuserdata
+Json.remove = nil
+--- @type lightuserdata
+Toml.remove = nil
+
+--- Returns the patched text, or nil if it isn't valid JSON (comments and trailing commas are accepted)
+--- @param text string|Buffer
+--- @param patch table
+--- @return string|nil
+function Json.patch(text, patch) end
+
+--- Returns the patched text, or nil if it isn't valid TOML, missing tables are appended as new sections
+--- @param text string|Buffer
+--- @param patch table
+--- @return string|nil
+function Toml.patch(text, patch) end
+
+--- Returns the text with the key of a section set to value, or removed if value is nil
+--- An empty section is the part of the file before the first section
+--- @param text string|Buffer
+--- @param section string
+--- @param key string
+--- @param value? string|number|boolean
+--- @return string|nil
+function Ini.set(text, section, key, value) end
+
 --- Describes that the file must be copied as is (in bytes), useful for non-text files
 --- @param filename string
 --- @return FileDescriptor|nil
@@ -52,7 +147,30 @@ function Directory(path) end
 --- @return FileDescriptor
 function string.exec(self) end
 
+--- Converts a string to a FileDescriptor created with the exact permissions mode (an octal string like "0600")
+--- @param self string
+--- @param mode string
+--- @return FileDescriptor
+function string.mode(self, mode) end
+
 --- Marks a FileDescriptor as executable
 --- @param self FileDescriptor
 --- @return FileDescriptor
-function table.exec(self) end
\ No newline at end of file
+function table.exec(self) end
+
+--- Skips the files of a Directory that match any of the patterns, a pattern containing '/' is matched against
+--- the path relative to the directory and a trailing '/' only matches directories, whose contents are never read
+--- @param self FileDescriptor
+--- @param ... string
+--- @return FileDescriptor
+function table.ignore(self, ...) end
+
+--- Creates the file with the exact permissions mode, an octal string like "0600" (the umask doesn't apply)
+--- With a pattern (matched like the ignore ones) it only sets the mode of the matching files of a Directory, the last matching rule wins
+--- The directories a Directory with a mode creates get it too, with the search bit of every class that can read ("0600" -> "0700")
+--- :exec() adds the exec bit of every class that can read
+--- @param self FileDescriptor
+--- @param mode string
+--- @param pattern? string
+--- @return FileDescriptor
+function table.mode(self, mode, pattern) end
\ No newline at end of file
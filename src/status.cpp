@@ -0,0 +1,161 @@
+#include "status.hpp"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "bundle.hpp"
+#include "logger.hpp"
+#include "utils.hpp"
+
+namespace rdm {
+    static constexpr mode_t EXEC_PERMISSIONS = S_IXUSR | S_IXGRP | S_IXOTH;
+
+    FileView::FileView(std::string_view data) : m_data(data) {}
+
+    FileView::FileView(std::string &&data) : m_owned(std::move(data)) {
+        m_data = m_owned;
+    }
+
+    FileView::FileView(FileView&& other) {
+        *this = std::move(other);
+    }
+
+    FileView& FileView::operator=(FileView&& other) {
+        if (this == &other) return *this;
+        reset();
+        bool isOwned = !other.m_owned.empty() && other.m_data.data() == other.m_owned.data();
+        m_owned = std::move(other.m_owned);
+        m_data = isOwned ? std::string_view(m_owned) : other.m_data;
+        m_mapping = other.m_mapping;
+        m_mappingSize = other.m_mappingSize;
+        other.m_data = std::string_view();
+        other.m_mapping = nullptr;
+        other.m_mappingSize = 0;
+        return *this;
+    }
+
+    FileView::~FileView() {
+        reset();
+    }
+
+    void FileView::reset() {
+        if (m_mapping != nullptr) munmap(m_mapping, m_mappingSize);
+        m_mapping = nullptr;
+        m_mappingSize = 0;
+        m_owned.clear();
+        m_data = std::string_view();
+    }
+
+    bool FileView::map(const fs::path &path, size_t size) {
+        reset();
+        if (size == 0) return true;
+
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) return false;
+
+        madvise(mapping, size, MADV_SEQUENTIAL);
+        m_mapping = mapping;
+        m_mappingSize = size;
+        m_data = std::string_view(static_cast<const char*>(mapping), size);
+        return true;
+    }
+
+    std::string_view FileView::getContent() const {
+        return m_data;
+    }
+
+    // Mirrors what the executor creates: text files are opened with 0666, copies keep the source mode and :mode() replaces both
+    // Without :mode() the umask also applies to the exec bits
+    bool getDesiredSnapshot(const PlanOperation &operation, mode_t umask, FileSnapshot &snapshot) {
+        snapshot.exists = true;
+        if (operation.type == OperationType::WriteText) {
+            snapshot.content = FileView(std::string_view(operation.data->getContent()));
+            snapshot.size = snapshot.content.getContent().size();
+            snapshot.mode = operation.mode.value_or((0666 | (operation.executable ? EXEC_PERMISSIONS : 0)) & ~umask);
+            return true;
+        }
+
+        Bundle* bundle = Bundle::getActive();
+        if (bundle != nullptr && bundle->contains(operation.source)) {
+            const BundleEntry* entry = bundle->find(operation.source);
+            if (entry == nullptr) return false;
+            snapshot.isSymlink = entry->type == BundleEntryType::Symlink;
+            snapshot.content = FileView(bundle->getData(*entry));
+            snapshot.size = entry->size;
+            snapshot.mode = operation.mode.value_or(((entry->mode & 07777) | (operation.executable ? EXEC_PERMISSIONS : 0)) & ~umask);
+            return true;
+        }
+
+        FileSnapshot source;
+        if (!getCurrentSnapshot(operation.source, true, source) || !source.exists || source.isDirectory) return false;
+        snapshot = std::move(source);
+        snapshot.mode = operation.mode.value_or((snapshot.mode | (operation.executable ? EXEC_PERMISSIONS : 0)) & ~umask);
+        return true;
+    }
+
+    bool getCurrentSnapshot(const fs::path &file, bool loadContent, FileSnapshot &snapshot) {
+        struct stat info;
+        if (lstat(file.c_str(), &info) != 0) {
+            snapshot.exists = false;
+            return errno == ENOENT || errno == ENOTDIR;
+        }
+
+        snapshot.exists = true;
+        snapshot.isSymlink = S_ISLNK(info.st_mode);
+        snapshot.isDirectory = S_ISDIR(info.st_mode);
+        snapshot.mode = info.st_mode & 07777;
+        snapshot.size = info.st_size;
+        if (!loadContent || snapshot.isDirectory) return true;
+
+        if (snapshot.isSymlink) {
+            std::error_code error;
+            snapshot.content = FileView(fs::read_symlink(file, error).string());
+            return !error;
+        }
+        return snapshot.content.map(file, snapshot.size);
+    }
+
+    static FileState compareFile(const PlanOperation &operation, const fs::path &file, mode_t umask) {
+        FileSnapshot current;
+        if (!getCurrentSnapshot(file, false, current) || !current.exists) return FileState::Missing;
+
+        FileSnapshot desired;
+        if (!getDesiredSnapshot(operation, umask, desired)) {
+            LOG_CUSTOM_DEBUG(operation.owner, "Couldn't read the source of " << file);
+            return FileState::Modified;
+        }
+
+        if (current.isDirectory || current.isSymlink != desired.isSymlink) return FileState::Modified;
+        // Different sizes can't have the same content, no need to read the file
+        if (!current.isSymlink && current.size != desired.size) return FileState::Modified;
+        if (!getCurrentSnapshot(file, true, current)) return FileState::Modified;
+        if (current.content.getContent() != desired.content.getContent()) return FileState::Modified;
+        if (!current.isSymlink && current.mode != desired.mode) return FileState::ModeChanged;
+        return FileState::InSync;
+    }
+
+    std::vector<FileStatus> getPlanStatus(const ApplyPlan &plan, const fs::path &destinationRoot) {
+        const mode_t currentUmask = getUmask();
+
+        const std::vector<PlanOperation>& operations = plan.getOperations();
+        std::vector<FileStatus> statuses(operations.size());
+        parallelFor(operations.size(), [&](size_t i) {
+            statuses[i] = { &operations[i], compareFile(operations[i], destinationRoot / operations[i].destination, currentUmask) };
+        });
+        return statuses;
+    }
+
+    const char* getFileStateName(FileState state) {
+        switch (state) {
+            case FileState::InSync: return "in-sync";
+            case FileState::Missing: return "missing";
+            case FileState::Modified: return "modified";
+            case FileState::ModeChanged: return "mode-changed";
+        }
+        return "unknown";
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <vector>
+#include "plan.hpp"
+
+namespace fs = std::filesystem;
+
+namespace rdm {
+    enum class FileState {
+        InSync,
+        Missing,
+        Modified,
+        ModeChanged
+    };
+
+    // Read-only view of some content, either borrowed, owned or mapped from a file
+    class FileView {
+        public:
+        FileView() = default;
+        explicit FileView(std::string_view data);
+        explicit FileView(std::string &&data);
+        FileView(FileView&& other);
+        FileView(const FileView&) = delete;
+        FileView& operator=(FileView&& other);
+        ~FileView();
+
+        bool map(const fs::path &path, size_t size);
+        std::string_view getContent() const;
+
+        private:
+        void reset();
+
+        std::string_view m_data;
+        std::string m_owned;
+        void* m_mapping = nullptr;
+        size_t m_mappingSize = 0;
+    };
+
+    // What a destination looks like, or should look like after an apply
+    struct FileSnapshot {
+        bool exists = false;
+        bool isSymlink = false;
+        bool isDirectory = false;
+        mode_t mode = 0;
+        size_t size = 0;
+        FileView content; // Link target for symlinks, only loaded on demand for existing files
+    };
+
+    struct FileStatus {
+        const PlanOperation* operation;
+        FileState state;
+    };
+
+    bool getDesiredSnapshot(const PlanOperation &operation, mode_t umask, FileSnapshot &snapshot);
+    bool getCurrentSnapshot(const fs::path &file, bool loadContent, FileSnapshot &snapshot);
+    std::vector<FileStatus> getPlanStatus(const ApplyPlan &plan, const fs::path &destinationRoot);
+    const char* getFileStateName(FileState state);
+}
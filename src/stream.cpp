@@ -0,0 +1,86 @@
+#include "stream.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include "bundle.hpp"
+
+namespace rdm {
+    static constexpr size_t BUFFER_SIZE = 1 << 16;
+
+    FileStream::~FileStream() {
+        close();
+    }
+
+    bool FileStream::open(const fs::path &path) {
+        close();
+        m_failed = false;
+
+        Bundle* bundle = Bundle::getActive();
+        if (bundle != nullptr && bundle->contains(path)) {
+            const BundleEntry* entry = bundle->find(path);
+            if (entry == nullptr) return false;
+            m_pending = bundle->getData(*entry);
+            return true;
+        }
+
+        m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (m_fd < 0) return false;
+        posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        if (!m_buffer) m_buffer = std::make_unique<char[]>(BUFFER_SIZE);
+        return true;
+    }
+
+    bool FileStream::fill() {
+        if (m_fd < 0) return false;
+        ssize_t bytesRead;
+        do {
+            bytesRead = read(m_fd, m_buffer.get(), BUFFER_SIZE);
+        } while (bytesRead < 0 && errno == EINTR);
+
+        if (bytesRead <= 0) {
+            m_failed = bytesRead < 0;
+            close();
+            return false;
+        }
+        m_pending = std::string_view(m_buffer.get(), bytesRead);
+        return true;
+    }
+
+    bool FileStream::readLine(std::string &line) {
+        line.clear();
+        while (true) {
+            size_t newline = m_pending.find('\n');
+            if (newline != std::string_view::npos) {
+                line.append(m_pending.substr(0, newline));
+                m_pending.remove_prefix(newline + 1);
+                return true;
+            }
+            line.append(m_pending);
+            m_pending = std::string_view();
+            // The last line may not end with a '\n'
+            if (!fill()) return !line.empty();
+        }
+    }
+
+    bool FileStream::readChunk(size_t size, std::string &chunk) {
+        chunk.clear();
+        while (chunk.size() < size) {
+            if (m_pending.empty() && !fill()) break;
+            size_t count = std::min(size - chunk.size(), m_pending.size());
+            chunk.append(m_pending.substr(0, count));
+            m_pending.remove_prefix(count);
+        }
+        return !chunk.empty();
+    }
+
+    bool FileStream::hasFailed() const {
+        return m_failed;
+    }
+
+    void FileStream::close() {
+        if (m_fd >= 0) ::close(m_fd);
+        m_fd = -1;
+        m_pending = std::string_view();
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace fs = std::filesystem;
+
+namespace rdm {
+    // Reads a module source in pieces through a fixed size buffer, so the whole file is never held in memory
+    // Files packed in a bundle are read straight from its mapping
+    class FileStream {
+        public:
+        FileStream() = default;
+        FileStream(FileStream& other) = delete;
+        FileStream& operator=(const FileStream&) = delete;
+        ~FileStream();
+
+        bool open(const fs::path &path);
+        // The line is returned without its '\n', false once everything has been read
+        bool readLine(std::string &line);
+        // Up to size bytes, only the last chunk can be shorter
+        bool readChunk(size_t size, std::string &chunk);
+        bool hasFailed() const;
+        void close();
+
+        private:
+        bool fill();
+
+        int m_fd = -1;
+        bool m_failed = false;
+        std::unique_ptr<char[]> m_buffer;
+        // The unread part of the buffer or of the bundle data
+        std::string_view m_pending;
+    };
+}
@@ -0,0 +1,156 @@
+#include "tar.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sys/sendfile.h>
+#include <unistd.h>
+#include "utils.hpp"
+
+namespace rdm {
+    static constexpr size_t BLOCK_SIZE = 512;
+    static constexpr size_t BUFFER_SIZE = 1 << 16;
+    static constexpr size_t MAX_OCTAL_SIZE = 077777777777; // 11 octal digits
+
+    struct TarHeader {
+        char name[100];
+        char mode[8];
+        char uid[8];
+        char gid[8];
+        char size[12];
+        char mtime[12];
+        char checksum[8];
+        char type;
+        char linkName[100];
+        char magic[6];
+        char version[2];
+        char userName[32];
+        char groupName[32];
+        char deviceMajor[8];
+        char deviceMinor[8];
+        char prefix[155];
+        char padding[12];
+    };
+    static_assert(sizeof(TarHeader) == BLOCK_SIZE, "A tar header must be exactly one block");
+
+    static void writeOctal(char* field, size_t length, unsigned long long value) {
+        std::snprintf(field, length, "%0*llo", static_cast<int>(length - 1), value);
+    }
+
+    TarWriter::TarWriter(int fd, time_t mtime) : m_fd(fd), m_mtime(mtime), m_uid(getuid()), m_gid(getgid()) {
+        m_buffer.reserve(BUFFER_SIZE);
+    }
+
+    bool TarWriter::append(const char* data, size_t size) {
+        if (m_buffer.size() + size > BUFFER_SIZE && !flush()) return false;
+        if (size >= BUFFER_SIZE) {
+            m_failed = m_failed || !writeAll(m_fd, data, size);
+            return !m_failed;
+        }
+        m_buffer.append(data, size);
+        return true;
+    }
+
+    bool TarWriter::flush() {
+        if (!m_buffer.empty()) m_failed = m_failed || !writeAll(m_fd, m_buffer.data(), m_buffer.size());
+        m_buffer.clear();
+        return !m_failed;
+    }
+
+    bool TarWriter::writePadding(size_t size) {
+        static const char zeros[BLOCK_SIZE] = {};
+        size_t remainder = size % BLOCK_SIZE;
+        return remainder == 0 || append(zeros, BLOCK_SIZE - remainder);
+    }
+
+    // Paths and link targets that don't fit ustar's fields are stored in a pax extended header
+    bool TarWriter::writePaxHeader(const std::string &path, size_t size, const std::string &linkTarget) {
+        std::string records;
+        auto addRecord = [&](const std::string &key, const std::string &value) {
+            // The length prefix counts itself, so grow it until it's stable
+            const size_t base = key.size() + value.size() + 3;
+            size_t length = base + 1;
+            while (base + std::to_string(length).size() != length) length = base + std::to_string(length).size();
+            records.append(std::to_string(length)).append(" ").append(key).append("=").append(value).append("\n");
+        };
+
+        if (path.size() > 100) addRecord("path", path);
+        if (linkTarget.size() > 100) addRecord("linkpath", linkTarget);
+        if (size > MAX_OCTAL_SIZE) addRecord("size", std::to_string(size));
+        if (records.empty()) return true;
+
+        return writeHeader("PaxHeader", 0644, records.size(), 'x', std::string())
+            && append(records.data(), records.size())
+            && writePadding(records.size());
+    }
+
+    bool TarWriter::writeHeader(const std::string &path, mode_t mode, size_t size, char type, const std::string &linkTarget) {
+        if (type != 'x' && !writePaxHeader(path, size, linkTarget)) return false;
+
+        TarHeader header{};
+        std::memcpy(header.name, path.data(), std::min(path.size(), sizeof(header.name)));
+        std::memcpy(header.linkName, linkTarget.data(), std::min(linkTarget.size(), sizeof(header.linkName)));
+        writeOctal(header.mode, sizeof(header.mode), mode & 07777);
+        writeOctal(header.uid, sizeof(header.uid), m_uid);
+        writeOctal(header.gid, sizeof(header.gid), m_gid);
+        writeOctal(header.size, sizeof(header.size), size > MAX_OCTAL_SIZE ? 0 : size);
+        writeOctal(header.mtime, sizeof(header.mtime), m_mtime);
+        header.type = type;
+        std::memcpy(header.magic, "ustar", 6);
+        std::memcpy(header.version, "00", 2);
+
+        // The checksum is computed with its own field filled with spaces
+        std::memset(header.checksum, ' ', sizeof(header.checksum));
+        unsigned checksum = 0;
+        for (size_t i = 0; i < BLOCK_SIZE; ++i) checksum += reinterpret_cast<const unsigned char*>(&header)[i];
+        std::snprintf(header.checksum, sizeof(header.checksum), "%06o", checksum);
+
+        return append(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+
+    bool TarWriter::addDirectory(const std::string &path, mode_t mode) {
+        return writeHeader(path.ends_with('/') ? path : path + "/", mode, 0, '5', std::string());
+    }
+
+    bool TarWriter::addFile(const std::string &path, mode_t mode, std::string_view data) {
+        return writeHeader(path, mode, data.size(), '0', std::string())
+            && append(data.data(), data.size())
+            && writePadding(data.size());
+    }
+
+    bool TarWriter::addFile(const std::string &path, mode_t mode, int sourceFd, size_t size) {
+        if (!writeHeader(path, mode, size, '0', std::string()) || !flush()) return false;
+
+        size_t remaining = size;
+        while (remaining > 0) {
+            ssize_t sent = sendfile(m_fd, sourceFd, nullptr, remaining);
+            if (sent > 0) {
+                remaining -= sent;
+                continue;
+            }
+            if (sent < 0 && errno == EINTR) continue;
+            if (sent < 0 && errno != EINVAL && errno != ENOSYS) return !(m_failed = true);
+            break;
+        }
+
+        // Fall back to read/write when sendfile can't handle the descriptors
+        char buffer[64 * 1024];
+        while (remaining > 0) {
+            ssize_t bytesRead = read(sourceFd, buffer, std::min(remaining, sizeof(buffer)));
+            if (bytesRead < 0 && errno == EINTR) continue;
+            if (bytesRead <= 0 || !writeAll(m_fd, buffer, bytesRead)) return !(m_failed = true);
+            remaining -= bytesRead;
+        }
+
+        return writePadding(size);
+    }
+
+    bool TarWriter::addSymlink(const std::string &path, const std::string &target) {
+        return writeHeader(path, 0777, 0, '2', target);
+    }
+
+    bool TarWriter::finish() {
+        static const char zeros[BLOCK_SIZE * 2] = {};
+        return append(zeros, sizeof(zeros)) && flush();
+    }
+}
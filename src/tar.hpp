@@ -0,0 +1,37 @@
+#pragma once
+
+#include <ctime>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+
+namespace rdm {
+    // Streams a POSIX (ustar + pax) archive to a descriptor, nothing is written to disk
+    class TarWriter {
+        public:
+        TarWriter(int fd, time_t mtime);
+        TarWriter(TarWriter& other) = delete;
+        TarWriter& operator=(const TarWriter&) = delete;
+
+        bool addDirectory(const std::string &path, mode_t mode);
+        bool addFile(const std::string &path, mode_t mode, std::string_view data);
+        // The payload goes straight from the source descriptor with sendfile when possible
+        bool addFile(const std::string &path, mode_t mode, int sourceFd, size_t size);
+        bool addSymlink(const std::string &path, const std::string &target);
+        bool finish();
+
+        private:
+        bool writeHeader(const std::string &path, mode_t mode, size_t size, char type, const std::string &linkTarget);
+        bool writePaxHeader(const std::string &path, size_t size, const std::string &linkTarget);
+        bool writePadding(size_t size);
+        bool append(const char* data, size_t size);
+        bool flush();
+
+        const int m_fd;
+        const time_t m_mtime;
+        const uid_t m_uid;
+        const gid_t m_gid;
+        std::string m_buffer;
+        bool m_failed = false;
+    };
+}
@@ -0,0 +1,264 @@
+#include "executor.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <liburing.h>
+#include <string_view>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "bundle.hpp"
+#include "logger.hpp"
+
+#define LOG_CUSTOM_INFO_VERBOSE(name, x) if (options.verbose) LOG_CUSTOM_INFO(name, x);
+#define LOG_CUSTOM_WARN_VERBOSE(name, x) if (options.verbose) LOG_CUSTOM_WARN(name, x);
+
+namespace rdm {
+    // Each file is a chain of at most 4 linked requests using one direct descriptor slot
+    static constexpr unsigned QUEUE_DEPTH = 256;
+    static constexpr unsigned MAX_CHAINS = 64;
+    static constexpr off_t MAX_BATCHED_COPY_SIZE = 1 << 20;
+
+    enum class ChainStage : uint64_t {
+        OpenSource,
+        ReadSource,
+        CloseSource,
+        Unlink,
+        Open,
+        Write,
+        Close
+    };
+
+    struct Chain {
+        const PlanOperation* operation;
+        int dirfd;
+        std::string name;
+        fs::path source;
+        std::string buffer;
+        std::string_view data;
+        mode_t mode;
+        bool readSource = false;
+        bool replaced = false;
+        int unlinkError = 0;
+        int error = 0;
+    };
+
+    static uint64_t packUserData(size_t chain, ChainStage stage) {
+        return (static_cast<uint64_t>(chain) << 8) | static_cast<uint64_t>(stage);
+    }
+
+    // The create mode goes through the umask, which gives the same bits as addExecPermissions in the sync executor
+    static mode_t withExec(mode_t mode, bool executable) {
+        return executable ? mode | S_IXUSR | S_IXGRP | S_IXOTH : mode;
+    }
+
+    // Only regular file contents that fit in memory are batched, everything else goes through executeOperation
+    // Explicit modes need a fchmod, which the ring can't do
+    static bool prepareChain(Chain &chain) {
+        const PlanOperation& operation = *chain.operation;
+        if (operation.mode.has_value()) return false;
+        if (operation.type == OperationType::WriteText) {
+            chain.data = operation.data->getContent();
+            chain.mode = withExec(0666, operation.executable);
+            return true;
+        }
+
+        Bundle* bundle = Bundle::getActive();
+        if (bundle != nullptr && bundle->contains(operation.source)) {
+            const BundleEntry* entry = bundle->find(operation.source);
+            if (entry == nullptr || entry->type == BundleEntryType::Symlink) return false;
+            chain.data = bundle->getData(*entry);
+            chain.mode = withExec(entry->mode & 07777, operation.executable);
+            return true;
+        }
+
+        struct stat info;
+        if (lstat(operation.source.c_str(), &info) != 0 || !S_ISREG(info.st_mode) || info.st_size > MAX_BATCHED_COPY_SIZE) return false;
+        chain.source = operation.source;
+        chain.buffer.resize(info.st_size);
+        chain.mode = withExec(info.st_mode & 07777, operation.executable);
+        chain.readSource = true;
+        return true;
+    }
+
+    static void waitForCompletions(io_uring &ring, unsigned count, std::vector<Chain> &chains) {
+        io_uring_submit_and_wait(&ring, count);
+        for (unsigned i = 0; i < count; ++i) {
+            io_uring_cqe* cqe;
+            if (io_uring_wait_cqe(&ring, &cqe) != 0) break;
+
+            uint64_t userData = io_uring_cqe_get_data64(cqe);
+            Chain& chain = chains.at(userData >> 8);
+            ChainStage stage = static_cast<ChainStage>(userData & 0xff);
+            int result = cqe->res;
+            io_uring_cqe_seen(&ring, cqe);
+
+            if (stage == ChainStage::Unlink) {
+                chain.replaced = result == 0;
+                chain.unlinkError = result < 0 ? -result : 0;
+                continue;
+            }
+
+            if ((stage == ChainStage::ReadSource || stage == ChainStage::Write) && result >= 0 && static_cast<size_t>(result) != chain.data.size()) {
+                result = -EIO;
+            }
+            if (result < 0 && chain.error == 0 && result != -ECANCELED) chain.error = -result;
+        }
+    }
+
+    static void flushChains(io_uring &ring, std::vector<Chain> &chains, const fs::path &destinationRoot, const ExecutorOptions &options, ExecutionReport &report) {
+        // Read the sources of the batched copies first, writes depend on the whole buffer
+        unsigned pending = 0;
+        for (size_t i = 0; i < chains.size(); ++i) {
+            Chain& chain = chains.at(i);
+            if (!chain.readSource) continue;
+            chain.data = chain.buffer;
+
+            io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+            io_uring_prep_openat_direct(sqe, AT_FDCWD, chain.source.c_str(), O_RDONLY | O_CLOEXEC, 0, i);
+            io_uring_sqe_set_data64(sqe, packUserData(i, ChainStage::OpenSource));
+            sqe->flags |= IOSQE_IO_LINK;
+
+            sqe = io_uring_get_sqe(&ring);
+            io_uring_prep_read(sqe, i, chain.buffer.data(), chain.buffer.size(), 0);
+            io_uring_sqe_set_data64(sqe, packUserData(i, ChainStage::ReadSource));
+            sqe->flags |= IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+
+            sqe = io_uring_get_sqe(&ring);
+            io_uring_prep_close_direct(sqe, i);
+            io_uring_sqe_set_data64(sqe, packUserData(i, ChainStage::CloseSource));
+            pending += 3;
+        }
+        if (pending > 0) waitForCompletions(ring, pending, chains);
+
+        // unlink -> open -> write -> close, the unlink is allowed to fail when the file doesn't exist
+        pending = 0;
+        for (size_t i = 0; i < chains.size(); ++i) {
+            Chain& chain = chains.at(i);
+            if (chain.error != 0) continue;
+
+            io_uring_sqe* sqe;
+            if (options.replaceMode == ReplaceMode::Replace) {
+                sqe = io_uring_get_sqe(&ring);
+                io_uring_prep_unlinkat(sqe, chain.dirfd, chain.name.c_str(), 0);
+                io_uring_sqe_set_data64(sqe, packUserData(i, ChainStage::Unlink));
+                sqe->flags |= IOSQE_IO_HARDLINK;
+                pending++;
+            }
+
+            sqe = io_uring_get_sqe(&ring);
+            io_uring_prep_openat_direct(sqe, chain.dirfd, chain.name.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, chain.mode, i);
+            io_uring_sqe_set_data64(sqe, packUserData(i, ChainStage::Open));
+            sqe->flags |= IOSQE_IO_LINK;
+
+            sqe = io_uring_get_sqe(&ring);
+            io_uring_prep_write(sqe, i, chain.data.data(), chain.data.size(), 0);
+            io_uring_sqe_set_data64(sqe, packUserData(i, ChainStage::Write));
+            sqe->flags |= IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+
+            sqe = io_uring_get_sqe(&ring);
+            io_uring_prep_close_direct(sqe, i);
+            io_uring_sqe_set_data64(sqe, packUserData(i, ChainStage::Close));
+            pending += 3;
+        }
+        if (pending > 0) waitForCompletions(ring, pending, chains);
+
+        for (auto& chain : chains) {
+            const std::string& moduleName = chain.operation->owner;
+            const fs::path file = destinationRoot / chain.operation->destination;
+            ExecutionStats& stats = report[moduleName];
+
+            if (chain.error == EEXIST && options.replaceMode == ReplaceMode::Skip) {
+                stats.skippedFiles++;
+                LOG_CUSTOM_INFO_VERBOSE(moduleName, "Skipping " << file);
+                continue;
+            }
+
+            // The create only fails with EEXIST because the unlink before it did, its error is the one worth reporting
+            if (chain.error == EEXIST && chain.unlinkError == EISDIR) {
+                stats.skippedFiles++;
+                LOG_CUSTOM_ERR(moduleName, "Tried to replace a directory with a file at " << file << ", skipping to prevent data loss!");
+                continue;
+            }
+            if (chain.error == EEXIST && chain.unlinkError != 0 && chain.unlinkError != ENOENT) chain.error = chain.unlinkError;
+
+            if (chain.error != 0) {
+                LOG_CUSTOM_ERR(moduleName, "Couldn't create " << file << ": " << std::strerror(chain.error));
+                continue;
+            }
+
+            if (chain.replaced) {
+                LOG_CUSTOM_WARN_VERBOSE(moduleName, "Replaced " << file);
+            } else {
+                LOG_CUSTOM_INFO_VERBOSE(moduleName, "Created " << file);
+            }
+            if (chain.operation->executable) LOG_CUSTOM_INFO_VERBOSE(moduleName, "Made " << file << " executable");
+            stats.modifiedFiles++;
+            stats.writtenFiles.push_back(chain.operation->destination);
+        }
+
+        chains.clear();
+    }
+
+    bool executePlanUring(const std::vector<const PlanOperation*> &operations, const fs::path &destinationRoot, const ExecutorOptions &options, ExecutionReport &report) {
+        io_uring ring;
+        if (io_uring_queue_init(QUEUE_DEPTH, &ring, 0) < 0) return false;
+        if (io_uring_register_files_sparse(&ring, MAX_CHAINS) < 0) {
+            io_uring_queue_exit(&ring);
+            return false;
+        }
+
+        LOG_DEBUG("Using the io_uring executor");
+
+        std::vector<Chain> chains;
+        chains.reserve(MAX_CHAINS);
+        // Queued chains still reference their directory, so descriptors are only closed after a flush
+        std::vector<int> openDirectories;
+        int dirfd = -1;
+        fs::path currentDirectory;
+
+        auto flush = [&]() {
+            flushChains(ring, chains, destinationRoot, options, report);
+            for (int fd : openDirectories) {
+                if (fd != dirfd) close(fd);
+            }
+            openDirectories.clear();
+            if (dirfd >= 0) openDirectories.push_back(dirfd);
+        };
+
+        for (const PlanOperation* operation : operations) {
+            ExecutionStats& stats = report[operation->owner];
+            stats.processedFiles++;
+            LOG_CUSTOM_DEBUG(operation->owner, "Processing: " << destinationRoot / operation->destination);
+
+            const fs::path directory = operation->destination.parent_path();
+            if (openDirectories.empty() || directory != currentDirectory) {
+                currentDirectory = directory;
+                dirfd = openDestinationDirectory(destinationRoot, *operation, &stats.createdDirectories);
+                if (dirfd >= 0) openDirectories.push_back(dirfd);
+            }
+
+            if (dirfd < 0) {
+                stats.skippedFiles++;
+                LOG_CUSTOM_ERR(operation->owner, "Couldn't create the parent directory of " << destinationRoot / operation->destination << ", skipping...");
+                continue;
+            }
+
+            Chain chain{};
+            chain.operation = operation;
+            chain.dirfd = dirfd;
+            chain.name = operation->destination.filename();
+            if (!prepareChain(chain)) {
+                executeOperation(*operation, dirfd, destinationRoot, options, stats);
+                continue;
+            }
+
+            chains.push_back(std::move(chain));
+            if (chains.size() == MAX_CHAINS) flush();
+        }
+
+        dirfd = -1;
+        flush();
+        io_uring_queue_exit(&ring);
+        return true;
+    }
+}
@@ -1,16 +1,32 @@
 #include "utils.hpp"
 #include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
 #include <ctime>
+#include <deque>
 #include <filesystem>
 #include <fstream>
-#include <fnmatch.h>
+#include <mutex>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include "bundle.hpp"
+#include "glob.hpp"
 #include "logger.hpp"
 #include "rdmlib.hpp"
 
-const std::unordered_map<std::string, rdm::Flag> rdm::FLAG_MAP = {
-    { "--verbose", Flag::VERBOSE },
-    { "-v",        Flag::VERBOSE },
-};
+namespace {
+    struct StartupPhase {
+        const char* name;
+        std::chrono::steady_clock::time_point time;
+    };
+}
+
+static bool s_startupTraceEnabled = false;
+static std::vector<StartupPhase> s_startupPhases;
 
 inline void rdm::ltrim(std::string &s) {
     s.erase(s.begin(), std::find_if(s.begin(), s.end(), [](unsigned char ch) {
@@ -33,7 +49,8 @@ fs::path rdm::getUserHome() {
     return std::getenv("HOME");
 }
 
-fs::path rdm::getDataDir() {
+static fs::path resolveDataDir() {
+    using namespace rdm;
     fs::path rdmDataDir;
     std::string dataHome = std::getenv("XDG_DATA_HOME") != NULL ? std::getenv("XDG_DATA_HOME") : "";
     trim(dataHome);
@@ -48,6 +65,32 @@ fs::path rdm::getDataDir() {
     return rdmDataDir;
 }
 
+const fs::path& rdm::getDataDir() {
+    static const fs::path dataDir = resolveDataDir();
+    return dataDir;
+}
+
+const fs::path& rdm::getCacheDir() {
+    static const fs::path cacheDir = []() {
+        std::string cacheHome = std::getenv("XDG_CACHE_HOME") != NULL ? std::getenv("XDG_CACHE_HOME") : "";
+        trim(cacheHome);
+        // Like XDG_DATA_HOME, relative paths are invalid and ignored
+        fs::path dir = cacheHome.empty() || !cacheHome.starts_with('/') ? getUserHome() / ".cache" : fs::path(cacheHome);
+        return dir / "rdm";
+    }();
+    return cacheDir;
+}
+
+const fs::path& rdm::getStateDir() {
+    static const fs::path stateDir = []() {
+        std::string stateHome = std::getenv("XDG_STATE_HOME") != NULL ? std::getenv("XDG_STATE_HOME") : "";
+        trim(stateHome);
+        fs::path dir = stateHome.empty() || !stateHome.starts_with('/') ? getUserHome() / ".local/state" : fs::path(stateHome);
+        return dir / "rdm";
+    }();
+    return stateDir;
+}
+
 fs::path rdm::getBackupDir() {
     return getDataDir() / "backup";
 }
@@ -56,6 +99,12 @@ fs::path rdm::getBackupDir(const std::string &group) {
     return getBackupDir() / group;
 }
 
+bool rdm::pathExists(const fs::path &path) {
+    Bundle* bundle = Bundle::getActive();
+    if (bundle != nullptr && bundle->contains(path)) return bundle->exists(path);
+    return fs::exists(path);
+}
+
 bool rdm::isAllowedPath(const fs::path &base, const fs::path &userPath, bool mustExist) {
     // LOG_DEBUG("Validating path: " << userPath);
     fs::path absoluteBase = fs::weakly_canonical(base);
@@ -64,13 +113,13 @@ bool rdm::isAllowedPath(const fs::path &base, const fs::path &userPath, bool mus
     // LOG_DEBUG("Absolute base: " << absoluteBase);
     // LOG_DEBUG("Absolute user: " << absoluteUser);
 
-    if (mustExist && !fs::exists(absoluteBase)) {
+    if (mustExist && !pathExists(absoluteBase)) {
         LOG_DEBUG("Denied path: " << userPath);
         LOG_DEBUG("[Reason] Path doesn't exist: " << absoluteBase);
         return false;
     }
 
-    if (mustExist && !fs::exists(absoluteUser)) {
+    if (mustExist && !pathExists(absoluteUser)) {
         LOG_DEBUG("Denied path: " << userPath);
         LOG_DEBUG("[Reason] Path doesn't exist: " << absoluteUser);
         return false;
@@ -85,23 +134,145 @@ bool rdm::isAllowedPath(const fs::path &base, const fs::path &userPath, bool mus
 }
 
 std::vector<fs::path> rdm::getDirectoryFilesRecursive(const fs::path &root) {
+    return rdm::getDirectoryFilesRecursive(root, PathFilter());
+}
+
+std::vector<fs::path> rdm::getDirectoryFilesRecursive(const fs::path &root, const PathFilter &filter) {
+    return rdm::getDirectoryFilesRecursive(root, filter, nullptr);
+}
+
+static void collectDirectoryFiles(const fs::path &root, const fs::path &dir, const rdm::PathFilter &filter, const std::function<bool(const fs::path&, bool)> &skip, std::vector<fs::path> &files) {
+    for (auto& entry : fs::directory_iterator(dir)) {
+        bool isDirectory = entry.is_directory() && !entry.is_symlink();
+        if (!filter.empty() || skip) {
+            fs::path relativePath = entry.path().lexically_relative(root);
+            if (!filter.empty() && filter.isIgnored(relativePath, isDirectory)) continue;
+            if (skip && skip(relativePath, isDirectory)) continue;
+        }
+        if (isDirectory) {
+            collectDirectoryFiles(root, entry.path(), filter, skip, files);
+        } else {
+            files.push_back(entry.path());
+        }
+    }
+}
+
+std::vector<fs::path> rdm::getDirectoryFilesRecursive(const fs::path &root, const PathFilter &filter, const std::function<bool(const fs::path&, bool)> &skip) {
+    Bundle* bundle = Bundle::getActive();
+    if (bundle != nullptr && bundle->contains(root)) {
+        auto files = bundle->getDirectoryFiles(root);
+        if (!filter.empty() || skip) {
+            // Bundles list every file at once, skip has to decide on files alone
+            std::erase_if(files, [&](const fs::path &file) {
+                fs::path relativePath = file.lexically_relative(root);
+                return (!filter.empty() && filter.isIgnoredRecursive(relativePath)) || (skip && skip(relativePath, false));
+            });
+        }
+        return files;
+    }
+
     std::vector<fs::path> files;
     files.reserve(8);
-    for (auto& entry : fs::directory_iterator(root)) {
-        if (entry.is_directory() && !entry.is_symlink()) {
-            auto nestedFiles = rdm::getDirectoryFilesRecursive(entry.path());
-            for (auto& nestedFile : nestedFiles) {
-                files.push_back(nestedFile);
+    collectDirectoryFiles(root, root, filter, skip, files);
+    return files;
+}
+
+namespace {
+    // Owners push and pop at the back, idle workers steal the oldest (and usually biggest) directories from the front
+    struct WalkQueue {
+        std::mutex mutex;
+        std::deque<fs::path> directories;
+    };
+}
+
+static bool popDirectory(WalkQueue &queue, bool steal, fs::path &directory) {
+    std::lock_guard lock(queue.mutex);
+    if (queue.directories.empty()) return false;
+    if (steal) {
+        directory = std::move(queue.directories.front());
+        queue.directories.pop_front();
+    } else {
+        directory = std::move(queue.directories.back());
+        queue.directories.pop_back();
+    }
+    return true;
+}
+
+std::vector<fs::path> rdm::findFilesParallel(const fs::path &root, const PathFilter &filter, const std::function<bool(const fs::path&)> &match, std::vector<fs::path>* directories) {
+    std::vector<WalkQueue> queues(std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::vector<fs::path>> results(queues.size());
+    std::vector<std::vector<fs::path>> walkedDirectories(queues.size());
+    // Directories queued or being walked, nothing new can show up once it reaches 0
+    std::atomic<size_t> pending = 0;
+    // Directories waiting in any queue, idle workers sleep until one shows up or the walk is over
+    std::atomic<size_t> queued = 0;
+    std::mutex idleMutex;
+    std::condition_variable idle;
+    // Taking the mutex orders the change before a worker that just checked the condition goes to sleep
+    auto wake = [&](bool all) {
+        { std::lock_guard lock(idleMutex); }
+        if (all) idle.notify_all();
+        else idle.notify_one();
+    };
+
+    auto walk = [&](size_t id, const fs::path &directory) {
+        if (directories != nullptr) walkedDirectories[id].push_back(directory);
+        std::error_code error;
+        for (fs::directory_iterator it(directory, error), end; !error && it != end; it.increment(error)) {
+            const fs::path& path = it->path();
+            std::error_code typeError;
+            bool isDirectory = it->is_directory(typeError);
+            if (!filter.empty() && filter.isIgnored(path.lexically_relative(root), isDirectory)) continue;
+            if (isDirectory) {
+                ++pending;
+                {
+                    std::lock_guard lock(queues[id].mutex);
+                    queues[id].directories.push_back(path);
+                    ++queued;
+                }
+                wake(false);
+            } else if (match(path)) {
+                results[id].push_back(path);
             }
-        } else {
-            files.push_back(entry.path());
         }
+        if (error) LOG_DEBUG("Couldn't walk " << directory << ": " << error.message());
+    };
+
+    auto worker = [&](size_t id) {
+        fs::path directory;
+        while (pending > 0) {
+            bool found = popDirectory(queues[id], false, directory);
+            for (size_t i = 1; !found && i < queues.size(); ++i) found = popDirectory(queues[(id + i) % queues.size()], true, directory);
+            if (!found) {
+                std::unique_lock lock(idleMutex);
+                idle.wait(lock, [&]() { return pending == 0 || queued > 0; });
+                continue;
+            }
+            --queued;
+            walk(id, directory);
+            if (--pending == 0) wake(true);
+        }
+    };
+
+    // The first level tells how much work there is, small trees never start a thread
+    walk(0, root);
+    size_t threadCount = std::min(queues.size(), queues[0].directories.size());
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount > 0 ? threadCount - 1 : 0);
+    for (size_t i = 1; i < threadCount; ++i) threads.emplace_back(worker, i);
+    worker(0);
+    for (auto& thread : threads) thread.join();
+
+    std::vector<fs::path> files = std::move(results[0]);
+    for (size_t i = 1; i < results.size(); ++i) files.insert(files.end(), results[i].begin(), results[i].end());
+    if (directories != nullptr) {
+        for (auto& walked : walkedDirectories) directories->insert(directories->end(), walked.begin(), walked.end());
     }
     return files;
 }
 
 bool rdm::fileMatchesPattern(const std::string &fileName, const std::string &pattern) {
-    return fnmatch(pattern.c_str(), fileName.c_str(), FNM_EXTMATCH) != FNM_NOMATCH;
+    return GlobPattern(pattern).matches(fileName);
 }
 
 void rdm::ensureDataDirExists(bool populate) {
@@ -130,18 +301,29 @@ void rdm::ensureDataDirExists(bool populate) {
 
 bool rdm::copyRDMLib() {
     fs::path destinationLibPath = getDataDir() / "rdmlib.lua";
-    if (!fs::exists(destinationLibPath.parent_path())) return false; // Do not copy if data dir doesn't exist
-
-    if (fs::exists(destinationLibPath))
-        fs::remove(destinationLibPath);
-    
-    std::ofstream libFile(destinationLibPath, std::fstream::binary | std::fstream::out);
-    if (libFile.is_open()) {
-        libFile.write(src_rdmlib_lua, src_rdmlib_lua_len);
-        libFile.close();
+    std::error_code error;
+    if (!fs::is_directory(destinationLibPath.parent_path(), error)) return false; // Do not copy if data dir doesn't exist
+
+    // Comparing the content is as cheap as hashing it, the lib is only a few KiB
+    std::string_view embeddedLib(src_rdmlib_lua, src_rdmlib_lua_len);
+    if (fs::file_size(destinationLibPath, error) == embeddedLib.size() && !error) {
+        std::string currentLib(embeddedLib.size(), '\0');
+        std::ifstream currentFile(destinationLibPath, std::fstream::binary);
+        if (currentFile.read(currentLib.data(), currentLib.size()) && currentLib == embeddedLib) {
+            traceStartup("rdmlib check");
+            return true;
+        }
     }
 
-    return true;
+    // Written next to the old one and renamed over it, so editors never see a partial file
+    fs::path tempLibPath = destinationLibPath;
+    tempLibPath += ".tmp";
+    std::ofstream libFile(tempLibPath, std::fstream::binary | std::fstream::out | std::fstream::trunc);
+    if (!libFile.write(embeddedLib.data(), embeddedLib.size())) return false;
+    libFile.close();
+    fs::rename(tempLibPath, destinationLibPath, error);
+    traceStartup("rdmlib write");
+    return !error;
 }
 
 void rdm::setupBackupDir() {
@@ -169,13 +351,47 @@ void rdm::setupBackupDir(const std::string &group) {
 }
 
 bool rdm::backupEntry(const std::string &group, const fs::path &entry) {
-    fs::path backup_entry = getBackupDir(group) / entry.lexically_relative(getUserHome());
+    return backupEntry(group, getUserHome(), entry);
+}
+
+bool rdm::backupEntry(const std::string &group, const fs::path &root, const fs::path &entry) {
+    fs::path backup_entry = getBackupDir(group) / entry.lexically_relative(root);
     if (fs::exists(backup_entry)) return false;
     copyFileOrSym(entry, backup_entry);
     return true;
 }
 
+// The home keeps its own group so 'rdm restore' can find it, other roots are stored by their path
+// The path is escaped into a single component, nested roots like /srv/a and /srv/a/b must never share a backup tree
+std::string rdm::getBackupGroup(const fs::path &root) {
+    const fs::path normalizedRoot = normalizeRoot(root);
+    if (normalizedRoot == normalizeRoot(getUserHome())) return "home";
+    // 'roots' alone would hold the groups of every other root
+    if (normalizedRoot.relative_path().empty()) return "filesystem";
+
+    std::string group = "roots/";
+    for (char c : normalizedRoot.relative_path().string()) {
+        if (c == '%') group += "%25";
+        else if (c == '/') group += "%2F";
+        else group += c;
+    }
+    return group;
+}
+
+fs::path rdm::normalizeRoot(const fs::path &root) {
+    fs::path normalizedRoot = fs::absolute(root).lexically_normal();
+    if (!normalizedRoot.has_filename() && normalizedRoot != normalizedRoot.root_path()) normalizedRoot = normalizedRoot.parent_path();
+    return normalizedRoot;
+}
+
 void rdm::copyFileOrSym(const fs::path &source, const fs::path &dest) {
+    Bundle* bundle = Bundle::getActive();
+    if (bundle != nullptr && bundle->contains(source)) {
+        const BundleEntry* entry = bundle->find(source);
+        if (entry == nullptr || !bundle->extract(*entry, dest)) LOG_ERR("Couldn't extract " << source << " from the bundle");
+        return;
+    }
+
     fs::create_directories(dest.parent_path());
     if (fs::is_symlink(source)) {
         fs::copy_symlink(source, dest);
@@ -184,6 +400,113 @@ void rdm::copyFileOrSym(const fs::path &source, const fs::path &dest) {
     }
 }
 
+unsigned rdm::getUmask() {
+    static const unsigned mask = []() {
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.starts_with("Umask:")) return static_cast<unsigned>(std::stoul(line.substr(6), nullptr, 8));
+        }
+        mode_t current = umask(0);
+        umask(current);
+        return static_cast<unsigned>(current);
+    }();
+    return mask;
+}
+
+bool rdm::writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+// Runs task(0..count-1) on all cores, tasks are handed out one by one so uneven ones balance out
+void rdm::parallelFor(size_t count, const std::function<void(size_t)> &task) {
+    size_t threadCount = std::min<size_t>(count, std::max(1u, std::thread::hardware_concurrency()));
+    if (threadCount <= 1) {
+        for (size_t i = 0; i < count; ++i) task(i);
+        return;
+    }
+
+    std::atomic<size_t> next = 0;
+    auto worker = [&]() {
+        for (size_t i = next++; i < count; i = next++) task(i);
+    };
+
+    // The active bundle is per thread, workers read from the same one as the caller
+    Bundle* bundle = Bundle::getActive();
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount - 1);
+    for (size_t i = 1; i < threadCount; ++i) {
+        threads.emplace_back([&worker, bundle]() {
+            Bundle::setActive(bundle);
+            worker();
+        });
+    }
+    worker();
+    for (auto& thread : threads) thread.join();
+}
+
+// Logging is configured before running any command so that every message respects it
+void rdm::setupLogging(char* argv[], int count) {
+    std::string format;
+    for (int i = 0; i < count; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-vv") {
+            logger::setLevel(logger::Level::Debug);
+        } else if ((arg == "-v" || arg == "--verbose") && logger::getLevel() < logger::Level::Info) {
+            logger::setLevel(logger::Level::Info);
+        } else if (arg == "--quiet" || arg == "-q") {
+            logger::setLevel(logger::Level::Error);
+        } else if (arg.starts_with("--log-format=")) {
+            format = arg.substr(arg.find('=') + 1);
+        } else if (arg == "--log-format" && i + 1 < count) {
+            format = argv[++i];
+        }
+    }
+
+    if (format == "json") {
+        logger::setFormat(logger::Format::Json);
+    } else if (!format.empty() && format != "text") {
+        LOG_WARN("Unknown log format '" << format << "', valid formats are: text, json");
+    }
+}
+
+void rdm::enableStartupTrace() {
+    s_startupTraceEnabled = true;
+    s_startupPhases.reserve(8);
+    s_startupPhases.push_back({ "start", std::chrono::steady_clock::now() });
+}
+
+void rdm::traceStartup(const char* phase) {
+    if (s_startupTraceEnabled) s_startupPhases.push_back({ phase, std::chrono::steady_clock::now() });
+}
+
+void rdm::printStartupTrace() {
+    if (!s_startupTraceEnabled || s_startupPhases.empty()) return;
+    LOG_FLUSH();
+
+    std::string trace;
+    char line[128];
+    auto toMilliseconds = [](std::chrono::steady_clock::duration duration) {
+        return std::chrono::duration<double, std::milli>(duration).count();
+    };
+    for (size_t i = 1; i < s_startupPhases.size(); ++i) {
+        const StartupPhase& phase = s_startupPhases[i];
+        int length = std::snprintf(line, sizeof(line), "startup-trace: %-16s %8.3f ms (%.3f ms total)\n", phase.name,
+            toMilliseconds(phase.time - s_startupPhases[i - 1].time), toMilliseconds(phase.time - s_startupPhases.front().time));
+        if (length > 0) trace.append(line, std::min<size_t>(length, sizeof(line) - 1));
+    }
+    writeAll(STDERR_FILENO, trace.data(), trace.size());
+}
+
 rdm::ModulesAndFlags rdm::parseModulesAndFlags(char* argv[], int count) {
     ModulesAndFlags maf;
     if (count == 0) return maf;
@@ -196,10 +519,26 @@ rdm::ModulesAndFlags rdm::parseModulesAndFlags(char* argv[], int count) {
 
     int currentArg = 0;
 
+    // Handles both '--option value' and '--option=value'
+    auto parseOption = [&](const std::string &arg) {
+        std::string name = arg.substr(0, arg.find('='));
+        std::optional<Option> option = findByName(OPTION_MAP, name);
+        if (!option.has_value()) return false;
+        if (name.size() < arg.size()) {
+            maf.programOptions[*option].push_back(arg.substr(name.size() + 1));
+        } else if (currentArg < count) {
+            maf.programOptions[*option].push_back(args.at(currentArg++));
+        } else {
+            LOG_WARN("Option '" << arg << "' requires a value, ignoring it...");
+        }
+        return true;
+    };
+
     while (currentArg < count) {
         auto& arg = args.at(currentArg++);
         if (arg.starts_with("-")) {
             if (arg == "-f" || arg == "--flags") break;
+            if (parseOption(arg)) continue;
             if (!parseAndInsertFlag(maf, arg)) LOG_WARN("Found unknown flag '" << arg << "', ignoring it...");
             continue;
         }
@@ -209,6 +548,7 @@ rdm::ModulesAndFlags rdm::parseModulesAndFlags(char* argv[], int count) {
     while (currentArg < count) {
         auto& arg = args.at(currentArg++);
         if (arg.starts_with("-")) {
+            if (parseOption(arg)) continue;
             if (!parseAndInsertFlag(maf, arg)) LOG_WARN("Found unknown flag '" << arg << "', ignoring it...");
             continue;
         }
@@ -219,7 +559,38 @@ rdm::ModulesAndFlags rdm::parseModulesAndFlags(char* argv[], int count) {
 }
 
 bool rdm::parseAndInsertFlag(ModulesAndFlags& maf, const std::string &flag) {
-    if (!FLAG_MAP.contains(flag)) return false;
-    maf.programFlags.insert(FLAG_MAP.at(flag));
+    std::optional<Flag> programFlag = findByName(FLAG_MAP, flag);
+    if (!programFlag.has_value()) return false;
+    maf.programFlags.insert(*programFlag);
     return true;
+}
+
+std::string rdm::getOptionValue(const ModulesAndFlags& maf, Option option) {
+    if (!maf.programOptions.contains(option) || maf.programOptions.at(option).empty()) return std::string();
+    return maf.programOptions.at(option).back();
+}
+rdm::DestinationFilter rdm::getDestinationFilter(const ModulesAndFlags& maf) {
+    auto getPatterns = [&maf](Option option) {
+        std::vector<std::string> patterns;
+        if (!maf.programOptions.contains(option)) return patterns;
+        for (auto pattern : maf.programOptions.at(option)) {
+            if (pattern.starts_with("~/")) pattern.erase(0, 2);
+            patterns.push_back(std::move(pattern));
+        }
+        return patterns;
+    };
+    return DestinationFilter(getPatterns(Option::ONLY), getPatterns(Option::EXCLUDE));
+}
+
+std::vector<fs::path> rdm::getDestinationRoots(const ModulesAndFlags& maf) {
+    std::vector<fs::path> destinationRoots;
+    if (!maf.programOptions.contains(Option::ROOT)) {
+        destinationRoots.push_back(normalizeRoot(getUserHome()));
+        return destinationRoots;
+    }
+    for (auto& root : maf.programOptions.at(Option::ROOT)) {
+        fs::path destinationRoot = normalizeRoot(root);
+        if (std::find(destinationRoots.begin(), destinationRoots.end(), destinationRoot) == destinationRoots.end()) destinationRoots.push_back(destinationRoot);
+    }
+    return destinationRoots;
 }
\ No newline at end of file
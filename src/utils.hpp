@@ -1,44 +1,134 @@
 #pragma once
+#include <array>
 #include <filesystem>
+#include <functional>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
+#include "glob.hpp"
 
 namespace fs = std::filesystem;
 
 namespace rdm {
     enum class Flag {
-        VERBOSE
+        VERBOSE,
+        QUIET,
+        STARTUP_TRACE,
+        TAR,
+        PRUNE
+    };
+
+    enum class Option {
+        BUNDLE,
+        EXCLUDE,
+        IO_BACKEND,
+        LARGE_FILE_SIZE,
+        LOG_FORMAT,
+        LUA_BUDGET,
+        LUA_TIMEOUT,
+        ONLY,
+        OUTPUT,
+        ROOT
     };
 
     struct ModulesAndFlags {
         std::unordered_set<std::string> modules;
         std::unordered_set<std::string> flags;
         std::unordered_set<Flag> programFlags;
+        std::unordered_map<Option, std::vector<std::string>> programOptions;
     };
 
-    extern const std::unordered_map<std::string, Flag> FLAG_MAP;
+    template <typename T, size_t N>
+    using NameTable = std::array<std::pair<std::string_view, T>, N>;
+
+    // Searched linearly, they only have a few entries and nothing has to be built before main runs
+    inline constexpr NameTable<Flag, 8> FLAG_MAP = {{
+        { "--verbose",       Flag::VERBOSE       },
+        { "-v",              Flag::VERBOSE       },
+        { "-vv",             Flag::VERBOSE       },
+        { "--quiet",         Flag::QUIET         },
+        { "-q",              Flag::QUIET         },
+        { "--startup-trace", Flag::STARTUP_TRACE },
+        { "--tar",           Flag::TAR           },
+        { "--prune",         Flag::PRUNE         },
+    }};
+
+    inline constexpr NameTable<Option, 11> OPTION_MAP = {{
+        { "--bundle",          Option::BUNDLE          },
+        { "--exclude",         Option::EXCLUDE         },
+        { "--io-backend",      Option::IO_BACKEND      },
+        { "--large-file-size", Option::LARGE_FILE_SIZE },
+        { "--log-format",      Option::LOG_FORMAT      },
+        { "--lua-budget",      Option::LUA_BUDGET      },
+        { "--lua-timeout",     Option::LUA_TIMEOUT     },
+        { "--only",            Option::ONLY            },
+        { "--output",          Option::OUTPUT          },
+        { "-o",                Option::OUTPUT          },
+        { "--root",            Option::ROOT            },
+    }};
+
+    template <typename T, size_t N>
+    constexpr std::optional<T> findByName(const NameTable<T, N> &table, std::string_view name) {
+        for (auto& [key, value] : table) {
+            if (key == name) return value;
+        }
+        return std::nullopt;
+    }
 
     inline void ltrim(std::string &str);
     inline void rtrim(std::string &str);
     void trim(std::string &str);
     
+    bool pathExists(const fs::path &path);
     bool isAllowedPath(const fs::path &base, const fs::path &userPath, bool mustExist);
     std::vector<fs::path> getDirectoryFilesRecursive(const fs::path &root);
+    std::vector<fs::path> getDirectoryFilesRecursive(const fs::path &root, const PathFilter &filter);
+    // skip gets the path relative to root of every entry, skipped directories aren't walked
+    std::vector<fs::path> getDirectoryFilesRecursive(const fs::path &root, const PathFilter &filter, const std::function<bool(const fs::path&, bool)> &skip);
     bool fileMatchesPattern(const std::string &fileName, const std::string &pattern);
+    // Work-stealing walk of root on all cores, filter prunes entries by their path relative to root and match picks the files to return, in no particular order
+    // Every walked directory (root included) is added to directories when it isn't null
+    std::vector<fs::path> findFilesParallel(const fs::path &root, const PathFilter &filter, const std::function<bool(const fs::path&)> &match, std::vector<fs::path>* directories = nullptr);
 
-    fs::path getDataDir();
+    // Resolved from the environment on first use, never touches the disk
+    const fs::path& getDataDir();
+    // $XDG_CACHE_HOME/rdm, for files rdm can always rebuild
+    const fs::path& getCacheDir();
+    // $XDG_STATE_HOME/rdm, for what rdm knows about this machine (like who owns each applied file)
+    const fs::path& getStateDir();
     fs::path getBackupDir();
     fs::path getBackupDir(const std::string &group);
     fs::path getUserHome();
     void ensureDataDirExists(bool populate);
+    // Only writes rdmlib.lua when the copy in the data dir differs from the embedded one
     bool copyRDMLib();
     void setupBackupDir();
     void setupBackupDir(const std::string &group);
     bool backupEntry(const std::string &group, const fs::path &entry);
+    bool backupEntry(const std::string &group, const fs::path &root, const fs::path &entry);
+    std::string getBackupGroup(const fs::path &root);
+    // Absolute and normalized without a trailing separator, so '/srv/x/' and '/srv/x' are the same root
+    fs::path normalizeRoot(const fs::path &root);
     void copyFileOrSym(const fs::path &source, const fs::path &dest);
+    bool writeAll(int fd, const char* data, size_t size);
+    // Read once, without the umask(0) round trip that would race with threads creating files
+    unsigned getUmask();
+    void parallelFor(size_t count, const std::function<void(size_t)> &task);
 
+    void setupLogging(char* argv[], int count);
+    // --startup-trace, the time spent in each phase of startup is printed to stderr once the command is done
+    void enableStartupTrace();
+    void traceStartup(const char* phase);
+    void printStartupTrace();
     ModulesAndFlags parseModulesAndFlags(char* argv[], int count);
     bool parseAndInsertFlag(ModulesAndFlags& maf, const std::string &flag);
+    std::string getOptionValue(const ModulesAndFlags& maf, Option option);
+    // From --only and --exclude, a leading '~/' is dropped since destinations are relative to the root
+    DestinationFilter getDestinationFilter(const ModulesAndFlags& maf);
+    // Every --root once, normalized, or the user's home without any
+    std::vector<fs::path> getDestinationRoots(const ModulesAndFlags& maf);
 }
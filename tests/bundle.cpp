@@ -0,0 +1,199 @@
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+#include "bundle.hpp"
+#include "check.hpp"
+
+// Bundles packed from a directory are read back, crafted ones with corrupted headers and entries must be refused
+
+using namespace rdm;
+
+namespace {
+    struct PackedFile {
+        std::string path;
+        std::string data;
+    };
+}
+
+static fs::path s_directory;
+
+static void writeFile(const fs::path &path, std::string_view content) {
+    fs::create_directories(path.parent_path());
+    std::ofstream(path, std::ios::binary) << content;
+}
+
+static std::string readFile(const fs::path &path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// Same layout as Bundle::pack, misalignment bytes go right before the table of contents
+static std::string buildBundle(const std::vector<PackedFile> &files, size_t misalignment = 0) {
+    std::string image(sizeof(BundleHeader), '\0');
+    std::vector<BundleEntry> entries;
+    std::string strings;
+    for (auto& file : files) {
+        BundleEntry entry{};
+        entry.offset = image.size();
+        entry.size = file.data.size();
+        entry.pathOffset = strings.size();
+        entry.pathLength = file.path.size();
+        entry.mode = 0644;
+        entry.type = BundleEntryType::File;
+        entries.push_back(entry);
+        image.append(file.data);
+        strings.append(file.path);
+    }
+    image.append((alignof(BundleEntry) - image.size() % alignof(BundleEntry)) % alignof(BundleEntry) + misalignment, '\0');
+
+    BundleHeader header{};
+    std::memcpy(header.magic, "RDMB", 4);
+    header.version = Bundle::VERSION;
+    header.entryCount = entries.size();
+    header.tocOffset = image.size();
+    header.stringsOffset = image.size() + entries.size() * sizeof(BundleEntry);
+    image.append(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(BundleEntry));
+    image.append(strings);
+    std::memcpy(image.data(), &header, sizeof(header));
+    return image;
+}
+
+static BundleHeader getHeader(const std::string &image) {
+    BundleHeader header;
+    std::memcpy(&header, image.data(), sizeof(header));
+    return header;
+}
+
+template<typename Edit>
+static std::string editHeader(std::string image, Edit edit) {
+    BundleHeader header = getHeader(image);
+    edit(header);
+    std::memcpy(image.data(), &header, sizeof(header));
+    return image;
+}
+
+template<typename Edit>
+static std::string editEntry(std::string image, size_t index, Edit edit) {
+    const size_t offset = getHeader(image).tocOffset + index * sizeof(BundleEntry);
+    BundleEntry entry;
+    std::memcpy(&entry, image.data() + offset, sizeof(entry));
+    edit(entry);
+    std::memcpy(image.data() + offset, &entry, sizeof(entry));
+    return image;
+}
+
+// The error of a refused bundle, empty if it opened
+static std::string openBundle(const std::string &image) {
+    const fs::path file = s_directory / "crafted.rdmb";
+    writeFile(file, image);
+    Bundle bundle(file, s_directory / "root");
+    return bundle.isOpen() ? std::string() : bundle.getErrorString();
+}
+
+static void testCrafted() {
+    const std::vector<PackedFile> files = { { "a.txt", "hello" }, { "dir/b", "bee" } };
+    const std::string valid = buildBundle(files);
+    CHECK_EQ(openBundle(valid), "");
+    CHECK_EQ(openBundle(buildBundle({})), "");
+
+    const fs::path file = s_directory / "crafted.rdmb";
+    writeFile(file, valid);
+    Bundle bundle(file, s_directory / "root");
+    const BundleEntry* entry = bundle.find(s_directory / "root" / "dir/b");
+    if (CHECK(entry != nullptr)) {
+        CHECK_EQ(bundle.getData(*entry), "bee");
+        CHECK_EQ(bundle.getEntryPath(*entry), "dir/b");
+    }
+    CHECK(bundle.find(s_directory / "root" / "dir") == nullptr);
+    CHECK(bundle.exists(s_directory / "root" / "dir"));
+    CHECK(!bundle.contains(s_directory / "elsewhere"));
+
+    CHECK(openBundle("RDMB").ends_with("file is too small"));
+    CHECK(openBundle(editHeader(valid, [](BundleHeader &header) { header.magic[0] = 'X'; })).ends_with("bad magic"));
+    CHECK(openBundle(editHeader(valid, [](BundleHeader &header) { header.version++; })).starts_with("Unsupported bundle version"));
+    CHECK(openBundle(valid.substr(0, valid.size() - 40)).ends_with("corrupted table of contents"));
+
+    // Sizes chosen so that a sum in the bounds checks would wrap around and pass
+    auto corrupted = [](BundleHeader &header) { header.tocOffset = UINT64_MAX - 7; };
+    CHECK(openBundle(editHeader(valid, corrupted)).ends_with("corrupted table of contents"));
+    CHECK(openBundle(editHeader(valid, [](BundleHeader &header) { header.entryCount = UINT64_MAX / sizeof(BundleEntry) + 2; })).ends_with("corrupted table of contents"));
+    CHECK(openBundle(editHeader(valid, [](BundleHeader &header) { header.stringsOffset = UINT64_MAX; })).ends_with("corrupted table of contents"));
+    CHECK(openBundle(buildBundle(files, 1)).ends_with("unaligned table of contents, pack it again"));
+
+    CHECK(openBundle(editEntry(valid, 1, [](BundleEntry &entry) { entry.offset = UINT64_MAX - 1; })).ends_with("entry out of bounds"));
+    CHECK(openBundle(editEntry(valid, 1, [](BundleEntry &entry) { entry.size = UINT64_MAX; })).ends_with("entry out of bounds"));
+    CHECK(openBundle(editEntry(valid, 0, [&valid](BundleEntry &entry) { entry.size = valid.size() - entry.offset + 1; })).ends_with("entry out of bounds"));
+    CHECK(openBundle(editEntry(valid, 1, [](BundleEntry &entry) { entry.pathOffset = UINT32_MAX - 2; })).ends_with("entry out of bounds"));
+    CHECK(openBundle(editEntry(valid, 1, [](BundleEntry &entry) { entry.pathLength = UINT32_MAX; })).ends_with("entry out of bounds"));
+    CHECK(openBundle(editEntry(valid, 1, [](BundleEntry &entry) { entry.pathLength++; })).ends_with("entry out of bounds"));
+
+    Bundle missing(s_directory / "missing.rdmb", s_directory);
+    CHECK(!missing.isOpen());
+    CHECK(missing.getErrorString().starts_with("Couldn't open bundle"));
+}
+
+static void testPack() {
+    const fs::path root = s_directory / "packed";
+    writeFile(root / "a.txt", "hello\n");
+    writeFile(root / "themes/dark.conf", std::string(100000, 'd'));
+    writeFile(root / "themes/odd", "x");
+    writeFile(root / "empty", "");
+    fs::create_symlink("a.txt", root / "link");
+    fs::permissions(root / "themes/odd", fs::perms::owner_all);
+
+    const fs::path file = s_directory / "packed.rdmb";
+    if (!CHECK(Bundle::pack(root, file))) return;
+    // An odd sized payload right before the table of contents still leaves it aligned
+    CHECK_EQ(getHeader(readFile(file)).tocOffset % alignof(BundleEntry), 0u);
+
+    Bundle bundle(file, root);
+    if (!CHECK(bundle.isOpen())) {
+        std::cerr << "  " << bundle.getErrorString() << '\n';
+        return;
+    }
+    for (auto path : { "a.txt", "themes/dark.conf", "themes/odd", "empty" }) {
+        const BundleEntry* entry = bundle.find(root / path);
+        if (!CHECK(entry != nullptr)) continue;
+        CHECK(entry->type == BundleEntryType::File);
+        CHECK(bundle.getData(*entry) == readFile(root / path));
+    }
+    const BundleEntry* odd = bundle.find(root / "themes/odd");
+    if (odd != nullptr) CHECK_EQ(odd->mode & 0777, 0700u);
+
+    const BundleEntry* link = bundle.find(root / "link");
+    if (CHECK(link != nullptr)) {
+        CHECK(link->type == BundleEntryType::Symlink);
+        CHECK_EQ(bundle.getData(*link), "a.txt");
+    }
+
+    const std::vector<fs::path> themes = bundle.getDirectoryFiles(root / "themes");
+    CHECK(themes == std::vector<fs::path>({ root / "themes/dark.conf", root / "themes/odd" }));
+    CHECK_EQ(bundle.getDirectoryFiles(root).size(), 5u);
+    CHECK(bundle.getModulePaths().empty());
+
+    const BundleEntry* dark = bundle.find(root / "themes/dark.conf");
+    if (dark != nullptr && CHECK(bundle.extract(*dark, s_directory / "extracted/dark.conf"))) {
+        CHECK(readFile(s_directory / "extracted/dark.conf") == std::string(100000, 'd'));
+    }
+}
+
+int main() {
+    std::string directory = (fs::temp_directory_path() / "rdm-test-bundle-XXXXXX").string();
+    if (mkdtemp(directory.data()) == nullptr) {
+        std::cerr << "Couldn't create a temporary directory\n";
+        return 1;
+    }
+    s_directory = directory;
+
+    testCrafted();
+    testPack();
+
+    std::error_code error;
+    fs::remove_all(s_directory, error);
+    return rdm::test::finish();
+}
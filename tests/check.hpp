@@ -0,0 +1,34 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+
+// Assertions shared by the unit tests, a failed check is printed and the test keeps going so one run shows every failure
+namespace rdm::test {
+    inline int s_failures = 0;
+
+    inline bool check(bool passed, const char* expression, const char* file, int line) {
+        if (!passed) {
+            std::cerr << file << ':' << line << ": check failed: " << expression << '\n';
+            s_failures++;
+        }
+        return passed;
+    }
+
+    template<typename A, typename B>
+    bool checkEqual(const A &actual, const B &expected, const char* expression, const char* file, int line) {
+        if (actual == expected) return true;
+        std::cerr << file << ':' << line << ": check failed: " << expression << "\n  actual:   " << actual << "\n  expected: " << expected << '\n';
+        s_failures++;
+        return false;
+    }
+
+    // Exit code of the test executable
+    inline int finish() {
+        if (s_failures > 0) std::cerr << s_failures << " check(s) failed\n";
+        return s_failures > 0 ? 1 : 0;
+    }
+}
+
+#define CHECK(expression) rdm::test::check((expression), #expression, __FILE__, __LINE__)
+#define CHECK_EQ(actual, expected) rdm::test::checkEqual((actual), (expected), #actual " == " #expected, __FILE__, __LINE__)
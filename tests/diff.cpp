@@ -0,0 +1,189 @@
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "check.hpp"
+#include "diff.hpp"
+
+// The unified diffs are applied back to the old text, and random pairs of texts check the edit scripts are minimal
+
+using namespace rdm;
+
+static std::vector<std::string_view> splitLines(std::string_view text) {
+    std::vector<std::string_view> lines;
+    while (!text.empty()) {
+        size_t end = text.find('\n');
+        end = end == std::string_view::npos ? text.size() : end + 1;
+        lines.push_back(text.substr(0, end));
+        text.remove_prefix(end);
+    }
+    return lines;
+}
+
+// "12,3" or "12", which is a single line
+static void parseRange(std::string_view range, size_t &start, size_t &length) {
+    size_t comma = range.find(',');
+    start = std::stoul(std::string(range.substr(0, comma)));
+    length = comma == std::string_view::npos ? 1 : std::stoul(std::string(range.substr(comma + 1)));
+}
+
+// Like patch, fails if a context or removed line doesn't match the old text
+static bool applyDiff(std::string_view oldText, std::string_view diff, std::string &result) {
+    const std::vector<std::string_view> oldLines = splitLines(oldText);
+    const std::vector<std::string_view> lines = splitLines(diff);
+    // Equal texts have an empty diff
+    if (lines.empty()) {
+        result = oldText;
+        return true;
+    }
+    if (lines.size() < 2 || !lines[0].starts_with("--- ") || !lines[1].starts_with("+++ ")) return false;
+
+    result.clear();
+    size_t position = 0;
+    for (size_t i = 2; i < lines.size();) {
+        std::string_view header = lines[i++];
+        if (!header.starts_with("@@ -")) return false;
+        size_t oldStart, oldLength, newStart, newLength;
+        size_t plus = header.find(" +");
+        parseRange(header.substr(4, plus - 4), oldStart, oldLength);
+        parseRange(header.substr(plus + 2, header.find(" @@") - plus - 2), newStart, newLength);
+
+        // An empty range starts after the line it names
+        size_t first = oldLength == 0 ? oldStart : oldStart - 1;
+        if (first < position || first > oldLines.size()) return false;
+        while (position < first) result.append(oldLines[position++]);
+
+        size_t removed = 0, added = 0;
+        while (i < lines.size() && !lines[i].starts_with("@@")) {
+            std::string line(lines[i].substr(1));
+            const char type = lines[i++][0];
+            if (i < lines.size() && lines[i] == "\\ No newline at end of file\n") {
+                line.pop_back();
+                i++;
+            }
+            if (type == '+') {
+                result.append(line);
+                added++;
+                continue;
+            }
+            if (position >= oldLines.size() || oldLines[position] != line) return false;
+            position++;
+            if (type == ' ') {
+                result.append(line);
+                added++;
+            } else if (type != '-') {
+                return false;
+            }
+            removed++;
+        }
+        if (removed != oldLength || added != newLength) return false;
+    }
+    while (position < oldLines.size()) result.append(oldLines[position++]);
+    return true;
+}
+
+static size_t countLines(std::string_view diff, char type) {
+    size_t count = 0;
+    for (auto line : splitLines(diff)) {
+        if (line.starts_with(type) && !line.starts_with("--- ") && !line.starts_with("+++ ")) count++;
+    }
+    return count;
+}
+
+// Lines that must be deleted or added, from the longest common subsequence
+static size_t getMinimumChanges(std::string_view oldText, std::string_view newText) {
+    const std::vector<std::string_view> a = splitLines(oldText), b = splitLines(newText);
+    std::vector<std::vector<size_t>> common(a.size() + 1, std::vector<size_t>(b.size() + 1, 0));
+    for (size_t i = 1; i <= a.size(); ++i) {
+        for (size_t j = 1; j <= b.size(); ++j) {
+            common[i][j] = a[i - 1] == b[j - 1] ? common[i - 1][j - 1] + 1 : std::max(common[i - 1][j], common[i][j - 1]);
+        }
+    }
+    return a.size() + b.size() - 2 * common[a.size()][b.size()];
+}
+
+static std::string stripColors(std::string_view text) {
+    std::string result;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '\033') {
+            i = text.find('m', i);
+            continue;
+        }
+        result.push_back(text[i]);
+    }
+    return result;
+}
+
+static void checkRoundTrip(std::string_view oldText, std::string_view newText, size_t context) {
+    const std::string diff = getUnifiedDiff(oldText, newText, "a", "b", false, context);
+    std::string applied;
+    if (!CHECK(applyDiff(oldText, diff, applied)) || !CHECK_EQ(applied, newText) || !CHECK_EQ(countLines(diff, '-') + countLines(diff, '+'), getMinimumChanges(oldText, newText))) {
+        std::cerr << "  old:\n" << oldText << "\n  new:\n" << newText << "\n  diff:\n" << diff;
+    }
+}
+
+static void testFormat() {
+    CHECK_EQ(getUnifiedDiff("same\n", "same\n", "a", "b", false), "");
+    CHECK_EQ(getUnifiedDiff("a\nb\nc\n", "a\nB\nc\n", "old", "new", false), "--- old\n+++ new\n@@ -1,3 +1,3 @@\n a\n-b\n+B\n c\n");
+    CHECK_EQ(getUnifiedDiff("", "new\n", "a", "b", false), "--- a\n+++ b\n@@ -0,0 +1 @@\n+new\n");
+    CHECK_EQ(getUnifiedDiff("old\n", "", "a", "b", false), "--- a\n+++ b\n@@ -1 +0,0 @@\n-old\n");
+    CHECK_EQ(getUnifiedDiff("x\ny", "x\ny\n", "a", "b", false), "--- a\n+++ b\n@@ -1,2 +1,2 @@\n x\n-y\n\\ No newline at end of file\n+y\n");
+
+    // Changes more than two contexts apart get their own hunk
+    std::string oldText, near, far;
+    for (int i = 0; i < 20; ++i) oldText += std::to_string(i) + "\n";
+    near = oldText;
+    near.replace(near.find("2\n"), 2, "two\n").replace(near.find("9\n"), 2, "nine\n");
+    far = oldText;
+    far.replace(far.find("2\n"), 2, "two\n").replace(far.find("10\n"), 3, "ten\n");
+    CHECK_EQ(countLines(getUnifiedDiff(oldText, near, "a", "b", false), '@'), 1u);
+    CHECK_EQ(getUnifiedDiff(oldText, far, "a", "b", false), "--- a\n+++ b\n@@ -1,6 +1,6 @@\n 0\n 1\n-2\n+two\n 3\n 4\n 5\n@@ -8,7 +8,7 @@\n 7\n 8\n 9\n-10\n+ten\n 11\n 12\n 13\n");
+    CHECK_EQ(getUnifiedDiff(oldText, far, "a", "b", false, 0), "--- a\n+++ b\n@@ -3 +3 @@\n-2\n+two\n@@ -11 +11 @@\n-10\n+ten\n");
+
+    CHECK_EQ(stripColors(getUnifiedDiff(oldText, far, "a", "b", true)), getUnifiedDiff(oldText, far, "a", "b", false));
+}
+
+static void testRoundTrips() {
+    checkRoundTrip("a\nb\nc\n", "c\nb\na\n", 3);
+    checkRoundTrip("a\nb\nc\na\nb\nb\na\n", "c\nb\na\nb\na\nc\n", 3);
+    checkRoundTrip("no newline", "no newline\n", 3);
+    checkRoundTrip("x\n", "", 3);
+
+    // Few distinct lines, so the texts share a lot and the middle snakes matter
+    uint64_t state = 0x2545f4914f6cdd1d;
+    auto random = [&state](size_t bound) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return static_cast<size_t>(state % bound);
+    };
+    auto randomText = [&random]() {
+        std::string text;
+        size_t lines = random(40);
+        for (size_t i = 0; i < lines; ++i) text.append(1, static_cast<char>('a' + random(5))).push_back('\n');
+        if (!text.empty() && random(4) == 0) text.pop_back();
+        return text;
+    };
+    for (int i = 0; i < 2000; ++i) {
+        const std::string oldText = randomText();
+        const std::string newText = random(3) == 0 ? oldText + randomText() : randomText();
+        checkRoundTrip(oldText, newText, random(5));
+    }
+}
+
+static void testBinary() {
+    CHECK(!isBinary("plain text\n"));
+    CHECK(isBinary(std::string_view("\x7f" "ELF\0\0", 6)));
+    // Only the start is looked at, like git
+    std::string late(9000, 'x');
+    late.push_back('\0');
+    CHECK(!isBinary(late));
+}
+
+int main() {
+    testFormat();
+    testRoundTrips();
+    testBinary();
+    return rdm::test::finish();
+}
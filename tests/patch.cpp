@@ -0,0 +1,160 @@
+#include <string>
+#include <utility>
+#include <vector>
+#include "check.hpp"
+#include "patch.hpp"
+
+// Json.patch, Toml.patch and Ini.set: what they change, what they keep byte for byte and what they refuse
+
+using namespace rdm;
+
+static PatchValue integer(int64_t value) {
+    PatchValue patch;
+    patch.type = PatchValue::Type::Integer;
+    patch.integer = value;
+    return patch;
+}
+
+static PatchValue string(const std::string &value) {
+    PatchValue patch;
+    patch.type = PatchValue::Type::String;
+    patch.string = value;
+    return patch;
+}
+
+static PatchValue remove() {
+    PatchValue patch;
+    patch.type = PatchValue::Type::Remove;
+    return patch;
+}
+
+// Members must be given sorted by key, like the Lua side builds them
+static PatchValue object(std::vector<std::pair<std::string, PatchValue>> members) {
+    PatchValue patch;
+    patch.type = PatchValue::Type::Object;
+    patch.members = std::move(members);
+    return patch;
+}
+
+static std::string json(std::string_view text, const PatchValue &patch) {
+    std::string result, error;
+    if (!CHECK(patchJson(text, patch, result, error))) std::cerr << "  " << error << '\n';
+    return result;
+}
+
+static std::string toml(std::string_view text, const PatchValue &patch) {
+    std::string result, error;
+    if (!CHECK(patchToml(text, patch, result, error))) std::cerr << "  " << error << '\n';
+    return result;
+}
+
+static std::string jsonError(std::string_view text, const PatchValue &patch) {
+    std::string result, error;
+    CHECK(!patchJson(text, patch, result, error));
+    return error;
+}
+
+static std::string tomlError(std::string_view text, const PatchValue &patch) {
+    std::string result, error;
+    CHECK(!patchToml(text, patch, result, error));
+    return error;
+}
+
+static void testJson() {
+    const std::string settings = "{\n    // comment\n    \"a\": 1,\n    \"b\": {\"c\": true},\n    \"d\": [1, 2],\n}\n";
+    CHECK_EQ(json(settings, object({})), settings);
+
+    const PatchValue patch = object({
+        { "a", integer(5) },
+        { "b", object({ { "c", remove() }, { "e", string("x") } }) },
+        { "d", remove() },
+        { "z", string("new") }
+    });
+    const std::string patched = json(settings, patch);
+    CHECK_EQ(patched, "{\n    // comment\n    \"a\": 5,\n    \"b\": {\n        \"e\": \"x\"\n    },\n    \"z\": \"new\",\n}\n");
+    CHECK_EQ(json(patched, patch), patched);
+
+    CHECK_EQ(json("", object({ { "k", object({ { "x", integer(1) } }) } })), "{\n    \"k\": {\n        \"x\": 1\n    }\n}\n");
+    CHECK_EQ(json("{\"s\": 1}", object({ { "s", string("a\"b\\c\n\x01") } })), "{\"s\": \"a\\\"b\\\\c\\n\\u0001\"}");
+
+    // Escaped keys are matched by what they decode to
+    CHECK_EQ(json("{\"caf\\u00e9\": 1}", object({ { "caf\xc3\xa9", integer(2) } })), "{\"caf\\u00e9\": 2}");
+    CHECK_EQ(json("{\"\\ud83d\\ude00\": 1}", object({ { "\xf0\x9f\x98\x80", integer(2) } })), "{\"\\ud83d\\ude00\": 2}");
+
+    CHECK(jsonError("{\"\\ud83d\\u0041\": 1}", object({})).starts_with("Invalid low surrogate"));
+    CHECK(jsonError("{\"\\ud83dx\": 1}", object({})).starts_with("Unpaired surrogate"));
+    CHECK(jsonError("{\"\\ude00\": 1}", object({})).starts_with("Unpaired surrogate"));
+    CHECK(jsonError("{\"\\u12\": 1}", object({})).starts_with("Invalid unicode escape"));
+    CHECK(!jsonError("[1, 2]", object({})).empty());
+    CHECK(!jsonError("{\"a\": 1} 2", object({})).empty());
+    CHECK(!jsonError("{\"a\": 1", object({})).empty());
+}
+
+static void testToml() {
+    const std::string config = "title = \"x\" # kept\n\n[server]\nport = 80\nhost = 'a'\n";
+    CHECK_EQ(toml(config, object({})), config);
+
+    const PatchValue patch = object({
+        { "new", integer(1) },
+        { "server", object({ { "port", integer(8080) }, { "tls", string("on") } }) },
+        { "title", string("y") }
+    });
+    const std::string patched = toml(config, patch);
+    CHECK_EQ(patched, "title = \"y\" # kept\nnew = 1\n\n[server]\nport = 8080\nhost = 'a'\ntls = \"on\"\n");
+    CHECK_EQ(toml(patched, patch), patched);
+
+    CHECK_EQ(toml("a = 1\n", object({ { "fresh", object({ { "a b", integer(2) } }) } })), "a = 1\n\n[fresh]\n\"a b\" = 2\n");
+    CHECK_EQ(toml("a = 1\n[server]\nport = 80\n", object({ { "server", remove() } })), "a = 1\n");
+    CHECK(tomlError("a = 1\n", object({ { "a", PatchValue() } })).starts_with("Invalid value for key 'a'"));
+    CHECK(!tomlError("a = \n", object({})).empty());
+}
+
+static void testTomlDottedKeys() {
+    const std::string config = "a.b = 1\n\n[server]\nhttp.port = 80\n";
+    CHECK_EQ(toml(config, object({ { "a", object({ { "b", integer(2) } }) } })), "a.b = 2\n\n[server]\nhttp.port = 80\n");
+    // A [a] or [server.http] header would define the table a second time
+    CHECK_EQ(toml(config, object({ { "a", object({ { "c", integer(3) } }) } })), "a.b = 1\na.c = 3\n\n[server]\nhttp.port = 80\n");
+    CHECK_EQ(toml(config, object({ { "server", object({ { "http", object({ { "host", string("h") }, { "port", integer(81) } }) } }) } })),
+        "a.b = 1\n\n[server]\nhttp.port = 81\nhttp.host = \"h\"\n");
+    CHECK_EQ(toml(config, object({ { "a", remove() } })), "\n[server]\nhttp.port = 80\n");
+    CHECK_EQ(toml("\"x.y\".z = 1\n", object({ { "x.y", object({ { "w", integer(2) } }) } })), "\"x.y\".z = 1\n\"x.y\".w = 2\n");
+    // Defining a super-table after its subtables is valid
+    CHECK_EQ(toml("[a.b]\nx = 1\n", object({ { "a", object({ { "c", integer(3) } }) } })), "[a.b]\nx = 1\n\n[a]\nc = 3\n");
+}
+
+static void testTomlArraysOfTables() {
+    const std::string config = "top = 1\n[[arr]]\nq = 1\n[arr.sub]\nx = 1\n\n[[arr]]\nq = 2\n[other]\nv = 1\n";
+    CHECK_EQ(toml(config, object({ { "new", integer(3) } })), "top = 1\nnew = 3\n[[arr]]\nq = 1\n[arr.sub]\nx = 1\n\n[[arr]]\nq = 2\n[other]\nv = 1\n");
+    CHECK_EQ(toml(config, object({ { "other", object({ { "v", integer(2) } }) } })), "top = 1\n[[arr]]\nq = 1\n[arr.sub]\nx = 1\n\n[[arr]]\nq = 2\n[other]\nv = 2\n");
+    CHECK_EQ(toml(config, object({ { "arr", remove() } })), "top = 1\n[other]\nv = 1\n");
+
+    // The elements have no key to address them by
+    CHECK(tomlError(config, object({ { "arr", object({ { "q", integer(3) } }) } })).starts_with("Key 'arr' is in an array of tables"));
+    CHECK(tomlError(config, object({ { "arr", object({ { "sub", object({ { "x", integer(3) } }) } }) } })).starts_with("Key 'arr' is in an array of tables"));
+    CHECK(!tomlError(config, object({ { "arr", integer(1) } })).empty());
+}
+
+static void testIni() {
+    const std::string ini = "top=1\n[main]\nkey = value\nother = 2\n\n[next]\nx: y\n";
+    const std::string value = "NEW";
+    CHECK_EQ(setIniValue(ini, "main", "key", &value), "top=1\n[main]\nkey = NEW\nother = 2\n\n[next]\nx: y\n");
+    CHECK_EQ(setIniValue(ini, "main", "added", &value), "top=1\n[main]\nkey = value\nother = 2\nadded=NEW\n\n[next]\nx: y\n");
+    CHECK_EQ(setIniValue(ini, "", "first", &value), "top=1\nfirst=NEW\n[main]\nkey = value\nother = 2\n\n[next]\nx: y\n");
+    CHECK_EQ(setIniValue(ini, "gone", "k", &value), ini + "\n[gone]\nk=NEW\n");
+    CHECK_EQ(setIniValue(ini, "main", "other", nullptr), "top=1\n[main]\nkey = value\n\n[next]\nx: y\n");
+    CHECK_EQ(setIniValue(ini, "next", "missing", nullptr), ini);
+
+    // Setting the current value and adding then removing a key both give back the same file
+    const std::string current = "value";
+    CHECK_EQ(setIniValue(ini, "main", "key", &current), ini);
+    CHECK_EQ(setIniValue(setIniValue(ini, "next", "added", &value), "next", "added", nullptr), ini);
+}
+
+int main() {
+    testJson();
+    testToml();
+    testTomlDottedKeys();
+    testTomlArraysOfTables();
+    testIni();
+    return rdm::test::finish();
+}
@@ -0,0 +1,205 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <vector>
+#include "check.hpp"
+#include "tar.hpp"
+
+// Archives are written to a temporary file and read back with a minimal ustar + pax reader
+
+using namespace rdm;
+
+static constexpr size_t BLOCK_SIZE = 512;
+static constexpr time_t MTIME = 1700000000;
+
+namespace {
+    struct TarEntry {
+        std::string path;
+        char type;
+        mode_t mode;
+        std::string linkTarget;
+        std::string data;
+        uint64_t mtime;
+    };
+}
+
+static uint64_t parseOctal(std::string_view field) {
+    return std::strtoull(std::string(field.substr(0, field.find('\0'))).c_str(), nullptr, 8);
+}
+
+static std::string_view getField(std::string_view header, size_t offset, size_t length) {
+    std::string_view field = header.substr(offset, length);
+    return field.substr(0, field.find('\0'));
+}
+
+// Fails on a bad checksum, a truncated archive or a missing end of archive
+static bool readArchive(std::string_view archive, std::vector<TarEntry> &entries) {
+    if (archive.size() % BLOCK_SIZE != 0) return false;
+    std::string paxPath, paxLinkTarget;
+    for (size_t position = 0; position + BLOCK_SIZE <= archive.size();) {
+        std::string_view header = archive.substr(position, BLOCK_SIZE);
+        position += BLOCK_SIZE;
+        if (header.find_first_not_of('\0') == std::string_view::npos) {
+            // Two zero blocks end the archive
+            return position + BLOCK_SIZE == archive.size() && archive.substr(position).find_first_not_of('\0') == std::string_view::npos;
+        }
+
+        unsigned checksum = 0;
+        for (size_t i = 0; i < BLOCK_SIZE; ++i) checksum += i >= 148 && i < 156 ? ' ' : static_cast<unsigned char>(header[i]);
+        if (checksum != parseOctal(header.substr(148, 8)) || getField(header, 257, 6) != "ustar") return false;
+
+        const uint64_t size = parseOctal(header.substr(124, 12));
+        if (size > archive.size() - position) return false;
+        std::string_view data = archive.substr(position, size);
+        position += (size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+
+        const char type = header[156];
+        if (type == 'x') {
+            // Records are "<length> <key>=<value>\n", the length counts the whole record
+            while (!data.empty()) {
+                size_t space = data.find(' ');
+                size_t length = std::stoul(std::string(data.substr(0, space)));
+                if (space == std::string_view::npos || length > data.size() || data[length - 1] != '\n') return false;
+                std::string_view record = data.substr(space + 1, length - space - 2);
+                size_t equals = record.find('=');
+                if (record.substr(0, equals) == "path") paxPath = record.substr(equals + 1);
+                if (record.substr(0, equals) == "linkpath") paxLinkTarget = record.substr(equals + 1);
+                data.remove_prefix(length);
+            }
+            continue;
+        }
+
+        TarEntry& entry = entries.emplace_back();
+        entry.path = paxPath.empty() ? std::string(getField(header, 0, 100)) : paxPath;
+        entry.linkTarget = paxLinkTarget.empty() ? std::string(getField(header, 157, 100)) : paxLinkTarget;
+        entry.type = type;
+        entry.mode = parseOctal(header.substr(100, 8));
+        entry.mtime = parseOctal(header.substr(136, 12));
+        entry.data = data;
+        paxPath.clear();
+        paxLinkTarget.clear();
+    }
+    return false;
+}
+
+static std::string readFile(int fd) {
+    std::string content;
+    char buffer[4096];
+    lseek(fd, 0, SEEK_SET);
+    ssize_t bytesRead;
+    while ((bytesRead = read(fd, buffer, sizeof(buffer))) > 0) content.append(buffer, bytesRead);
+    return content;
+}
+
+static int createTempFile() {
+    char path[] = "/tmp/rdm-test-tar-XXXXXX";
+    int fd = mkstemp(path);
+    unlink(path);
+    return fd;
+}
+
+static void testEntries() {
+    int fd = createTempFile();
+    if (!CHECK(fd >= 0)) return;
+
+    std::string longPath = ".config/";
+    while (longPath.size() < 300) longPath += "very-long-directory/";
+    longPath += "file";
+    const std::string longTarget(150, 't');
+    const std::string large(200000, 'L');
+
+    TarWriter writer(fd, MTIME);
+    CHECK(writer.addDirectory(".config", 0755));
+    CHECK(writer.addFile(".config/a.txt", 0644, std::string_view("hello\n")));
+    CHECK(writer.addFile(".config/empty", 0600, std::string_view()));
+    CHECK(writer.addFile(longPath, 0755, std::string_view("x")));
+    CHECK(writer.addSymlink(".config/link", "a.txt"));
+    CHECK(writer.addSymlink(".config/far", longTarget));
+    CHECK(writer.addFile(".config/large", 0644, large));
+    CHECK(writer.addFile(".config/exact", 0644, std::string(BLOCK_SIZE, 'e')));
+
+    // Copied with sendfile from a regular file, with read and write from a pipe
+    int source = createTempFile();
+    int pipes[2];
+    if (CHECK(source >= 0) && CHECK(pipe(pipes) == 0)) {
+        const std::string content = "from a descriptor\n";
+        CHECK(write(source, content.data(), content.size()) == static_cast<ssize_t>(content.size()));
+        lseek(source, 0, SEEK_SET);
+        CHECK(writer.addFile(".config/sent", 0640, source, content.size()));
+        CHECK(write(pipes[1], content.data(), content.size()) == static_cast<ssize_t>(content.size()));
+        close(pipes[1]);
+        CHECK(writer.addFile(".config/piped", 0640, pipes[0], content.size()));
+        close(pipes[0]);
+        close(source);
+    }
+    CHECK(writer.finish());
+
+    std::vector<TarEntry> entries;
+    const std::string archive = readFile(fd);
+    close(fd);
+    if (!CHECK(readArchive(archive, entries)) || !CHECK_EQ(entries.size(), 10u)) return;
+
+    CHECK_EQ(entries[0].path, ".config/");
+    CHECK_EQ(entries[0].type, '5');
+    CHECK_EQ(entries[0].mode, 0755u);
+    CHECK_EQ(entries[0].mtime, static_cast<uint64_t>(MTIME));
+    CHECK_EQ(entries[1].path, ".config/a.txt");
+    CHECK_EQ(entries[1].type, '0');
+    CHECK_EQ(entries[1].data, "hello\n");
+    CHECK_EQ(entries[2].data, "");
+    CHECK_EQ(entries[2].mode, 0600u);
+    CHECK_EQ(entries[3].path, longPath);
+    CHECK_EQ(entries[3].data, "x");
+    CHECK_EQ(entries[4].type, '2');
+    CHECK_EQ(entries[4].linkTarget, "a.txt");
+    CHECK_EQ(entries[5].linkTarget, longTarget);
+    CHECK(entries[6].data == large);
+    CHECK_EQ(entries[7].data.size(), BLOCK_SIZE);
+    CHECK_EQ(entries[8].path, ".config/sent");
+    CHECK_EQ(entries[8].data, "from a descriptor\n");
+    CHECK_EQ(entries[9].path, ".config/piped");
+    CHECK_EQ(entries[9].data, "from a descriptor\n");
+}
+
+// The length prefix of a pax record counts its own digits, paths around 100 bytes long move it from 2 to 3
+static void testPaxLengths() {
+    int fd = createTempFile();
+    if (!CHECK(fd >= 0)) return;
+
+    std::vector<std::string> paths;
+    for (size_t length = 85; length < 120; ++length) paths.push_back(std::string(length - 1, 'p') + std::to_string(length % 10));
+    TarWriter writer(fd, MTIME);
+    for (auto& path : paths) CHECK(writer.addFile(path, 0644, std::string_view(path)));
+    CHECK(writer.finish());
+
+    std::vector<TarEntry> entries;
+    const std::string archive = readFile(fd);
+    close(fd);
+    if (!CHECK(readArchive(archive, entries)) || !CHECK_EQ(entries.size(), paths.size())) return;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        CHECK_EQ(entries[i].path, paths[i]);
+        CHECK_EQ(entries[i].data, paths[i]);
+    }
+}
+
+static void testWriteError() {
+    int fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (!CHECK(fd >= 0)) return;
+    TarWriter writer(fd, MTIME);
+    // Small entries are only buffered, the error shows up once the buffer is flushed and sticks
+    writer.addFile("a", 0644, std::string_view("a"));
+    CHECK(!writer.finish());
+    CHECK(!writer.addFile("b", 0644, std::string(200000, 'b')));
+    close(fd);
+}
+
+int main() {
+    testEntries();
+    testPaxLengths();
+    testWriteError();
+    return rdm::test::finish();
+}